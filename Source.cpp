@@ -3,518 +3,8962 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cctype>
+#include <cmath>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include <limits>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 
 // Constants
-#define MAX_INTERSECTIONS 100 // Maximum number of intersections
-const int INF = 99999; // A large value to represent "infinite" distance
-
-// Structure for roads (edges)
-struct Edge {
-    int to;       // Destination index
-    int weight;   // Weight (travel time or congestion level)
-    Edge* next;   // Pointer to the next road
+const int INF = 1000000000; // A large value to represent "infinite" distance (large maps exceed 99999)
 
-    Edge() : to(-1), weight(0), next(NULL) {} // Initialize members
-};
+// Hot-path instrumentation (see Metrics). Build with -DTRAFFIC_METRICS=0 to compile it out.
+#ifndef TRAFFIC_METRICS
+#define TRAFFIC_METRICS 1
+#endif
+#if TRAFFIC_METRICS
+#define METRICS_ONLY(statement) statement
+#else
+#define METRICS_ONLY(statement)
+#endif
 
 // Structure for intersections (nodes)
-// Structure for intersections (nodes)
+// Names live in the graph's NameTable; an intersection's index is its interned name ID.
 struct Intersection {
-    string name;            // Name of the intersection
-    Edge* head;             // Head of the linked list of roads
     int trafficSignal;      // Green light duration for the intersection (in seconds)
+    float x, y;             // Map position in any planar unit; only valid if hasCoordinates
     bool emergencyOverride; // Flag to indicate if traffic signal is overridden for emergency vehicles
+    bool hasCoordinates;
 
-    Intersection() : name(""), head(NULL), trafficSignal(30), emergencyOverride(false) {} // Initialize with default traffic signal duration
+    Intersection() : trafficSignal(30), x(0), y(0), emergencyOverride(false), hasCoordinates(false) {} // Initialize with default traffic signal duration
 };
 
+// Vehicle loaded from vehicles.csv
+struct Vehicle {
+    int id;          // Interned vehicle ID
+    int origin;      // Start intersection
+    int destination; // End intersection
+};
 
-
-// Graph Class
-class TrafficGraph {
-private:
-    Intersection intersections[MAX_INTERSECTIONS];
-    int count;
-    int roadVehicleCounts[MAX_INTERSECTIONS][MAX_INTERSECTIONS]; // Tracking vehicle counts on roads
-    bool closedRoads[MAX_INTERSECTIONS][MAX_INTERSECTIONS]; // Road closure status
+// Emergency vehicle loaded from emergency_vehicles.csv
+struct EmergencyVehicle {
+    int id;          // Interned vehicle ID
+    int origin;      // Start intersection
+    int destination; // End intersection
+    int priority;    // Higher values are more urgent
+};
 
 
+// Growable array of trivially copyable values with a std::vector-like interface.
+// Unlike std::vector it can also adopt memory it does not own, such as a section of a
+// mapped snapshot file: reads and in-place writes use that memory directly, and only
+// growing the array copies the contents into owned heap storage.
+template <typename T>
+class Column {
 public:
-    TrafficGraph() : count(0) {
-        // Initialize vehicle count to 0 and closed roads to false
-        for (int i = 0; i < MAX_INTERSECTIONS; ++i) {
-            for (int j = 0; j < MAX_INTERSECTIONS; ++j) {
-                roadVehicleCounts[i][j] = 0; // Initialize all roads with 0 vehicles
-                closedRoads[i][j] = false; // No roads are closed initially
-            }
+    Column() : items(nullptr), count(0), capacity(0), owned(true) {}
+    Column(const Column& other) : items(nullptr), count(0), capacity(0), owned(true) {
+        append(other.items, other.count);
+    }
+    Column& operator=(const Column& other) {
+        if (this != &other) {
+            clear();
+            append(other.items, other.count);
         }
+        return *this;
     }
-    void monitorTraffic() {
-        cout << "\nReal-Time Traffic Monitoring:\n";
-        for (int i = 0; i < count; ++i) {
-            cout << "Intersection: " << intersections[i].name << "\n";
-            Edge* current = intersections[i].head;
-            while (current != NULL) {
-                cout << "  Road to " << intersections[current->to].name
-                    << " - Vehicle Count: " << roadVehicleCounts[i][current->to]
-                    << " - Weight: " << current->weight << "\n";
-                current = current->next;
-            }
-            cout << "-----------------------------------\n";
+    ~Column() { release(); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T& back() { return items[count - 1]; }
+
+    void reserve(size_t wanted) {
+        if (wanted > capacity) {
+            reallocate(wanted);
+        }
+    }
+
+    void push_back(const T& value) {
+        if (count == capacity) {
+            reallocate(capacity < 8 ? 8 : capacity * 2);
+        }
+        items[count++] = value;
+    }
+
+    void pop_back() { count--; }
+
+    void resize(size_t newSize, const T& value = T()) {
+        if (newSize > capacity) {
+            reallocate(newSize > capacity * 2 ? newSize : capacity * 2);
+        }
+        for (size_t i = count; i < newSize; ++i) {
+            items[i] = value;
         }
+        count = newSize;
     }
 
+    void assign(size_t newSize, const T& value) {
+        count = 0;
+        resize(newSize, value);
+    }
 
-    // Function to load and display the content of a file
-    void loadAndDisplayFile(const string& filename) {
-        ifstream file(filename);
-        if (!file.is_open()) { // Check if the file opens successfully
-            cout << "Error: Unable to open file " << filename << "\n";
+    void append(const T* values, size_t valueCount) {
+        if (valueCount == 0) {
             return;
         }
+        if (count + valueCount > capacity) {
+            reallocate(count + valueCount > capacity * 2 ? count + valueCount : capacity * 2);
+        }
+        memcpy((void*)(items + count), (const void*)values, valueCount * sizeof(T));
+        count += valueCount;
+    }
+
+    void clear() { count = 0; }
+
+    void swap(Column& other) {
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(owned, other.owned);
+    }
+
+    // Use external memory in place; the caller keeps it alive while the column refers to it
+    void adopt(T* external, size_t size) {
+        release();
+        items = external;
+        count = size;
+        capacity = size;
+        owned = false;
+    }
+
+private:
+    T* items;
+    size_t count;
+    size_t capacity;
+    bool owned; // False while 'items' points into adopted memory
+
+    void reallocate(size_t newCapacity) {
+        T* fresh = (T*)malloc(newCapacity * sizeof(T));
+        if (fresh == nullptr) {
+            throw bad_alloc();
+        }
+        if (count > 0) {
+            memcpy((void*)fresh, (const void*)items, count * sizeof(T));
+        }
+        release();
+        items = fresh;
+        capacity = newCapacity;
+        owned = true;
+    }
 
-        cout << "\nContents of " << filename << ":\n";
-        string line;
-        while (getline(file, line)) {
-            cout << line << "\n"; // Display each line of the file
+    void release() {
+        if (owned) {
+            free(items);
         }
+        items = nullptr;
+        capacity = 0;
+        owned = true;
+    }
+};
 
-        file.close();
-        cout << "-------------------------------------\n";
+// Binary snapshot layout (version 1):
+//   SnapshotHeader, then one SnapshotSection entry per array, then the arrays themselves,
+//   each starting on a 64-byte boundary. Arrays are stored exactly as they sit in memory,
+//   so a loader maps the file and points each Column at its section without parsing.
+const char SNAPSHOT_MAGIC[8] = { 'T', 'R', 'A', 'F', 'S', 'N', 'A', 'P' };
+const unsigned SNAPSHOT_VERSION = 5; // 2: intersections carry coordinates, 3: roads carry base weights, 4: travel-time profiles, 5: green shares
+const unsigned SNAPSHOT_BYTE_ORDER = 0x01020304; // Detects files written on another byte order
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+struct SnapshotHeader {
+    char magic[8];
+    unsigned version;
+    unsigned byteOrder;
+    unsigned sectionCount;
+    unsigned reserved;
+    unsigned long long fileSize;
+};
+
+struct SnapshotSection {
+    unsigned long long offset;   // Byte offset of the array from the start of the file
+    unsigned long long count;    // Number of elements
+    unsigned elementSize;        // sizeof the element type when the file was written
+    unsigned reserved;
+};
+
+// Collects the arrays that make up a snapshot and writes them out in one go
+class SnapshotWriter {
+public:
+    template <typename T>
+    void add(const Column<T>& column) {
+        addRaw(column.data(), column.size(), sizeof(T));
     }
 
-    void adjustGreenLightDuration(int intersectionIndex) {
-        // If emergency vehicle is overriding the signal, set a fixed duration (e.g., 10 seconds for emergency)
-        if (intersections[intersectionIndex].emergencyOverride) {
-            intersections[intersectionIndex].trafficSignal = 10; // Emergency override to 10 seconds
-            cout << "Emergency override: Green light at " << intersections[intersectionIndex].name
-                << " is fixed to 10 seconds." << endl;
-            return;
+    // Add a small array that may not outlive the call; the writer keeps its own copy
+    template <typename T>
+    void addCopy(const T* values, size_t count) {
+        copies.push_back(vector<char>((const char*)values, (const char*)(values + count)));
+        addRaw(copies.back().data(), count, sizeof(T));
+    }
+
+    void addRaw(const void* data, size_t count, size_t elementSize) {
+        PendingSection section = { data, count, (unsigned)elementSize };
+        sections.push_back(section);
+    }
+
+    bool write(const string& filename) const {
+        ofstream file(filename, ios::binary | ios::trunc);
+        if (!file.is_open()) {
+            return false;
         }
 
-        // Otherwise, adjust the green light duration based on traffic density
-        int totalVehicleCount = 0;
-        Edge* current = intersections[intersectionIndex].head;
+        vector<SnapshotSection> table(sections.size());
+        size_t offset = alignUp(sizeof(SnapshotHeader) + sizeof(SnapshotSection) * sections.size());
+        for (size_t i = 0; i < sections.size(); ++i) {
+            table[i].offset = offset;
+            table[i].count = sections[i].count;
+            table[i].elementSize = sections[i].elementSize;
+            table[i].reserved = 0;
+            offset = alignUp(offset + sections[i].count * sections[i].elementSize);
+        }
 
-        while (current != NULL) {
-            int vehicleCount = roadVehicleCounts[intersectionIndex][current->to];
-            totalVehicleCount += vehicleCount;
-            current = current->next;
+        SnapshotHeader header;
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+        header.sectionCount = (unsigned)sections.size();
+        header.reserved = 0;
+        header.fileSize = offset;
+
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)table.data(), (streamsize)(sizeof(SnapshotSection) * table.size()));
+        size_t written = sizeof(header) + sizeof(SnapshotSection) * table.size();
+        static const char padding[SNAPSHOT_ALIGNMENT] = { 0 };
+        for (size_t i = 0; i < sections.size(); ++i) {
+            file.write(padding, (streamsize)(table[i].offset - written));
+            size_t bytes = sections[i].count * sections[i].elementSize;
+            file.write((const char*)sections[i].data, (streamsize)bytes);
+            written = table[i].offset + bytes;
         }
+        file.write(padding, (streamsize)(offset - written));
+        return file.good();
+    }
 
-        // Adjust green light duration based on traffic density (simple model)
-        int newDuration = 30 + totalVehicleCount / 10; // Example: 10 vehicles per second increase the green light duration by 1 second
-        intersections[intersectionIndex].trafficSignal = newDuration;
+private:
+    struct PendingSection {
+        const void* data;
+        size_t count;
+        unsigned elementSize;
+    };
+    vector<PendingSection> sections;
+    vector<vector<char> > copies; // Moving the outer vector keeps each buffer in place
 
-        cout << "Adjusted green light duration at " << intersections[intersectionIndex].name
-            << " to " << newDuration << " seconds due to traffic density." << endl;
+    static size_t alignUp(size_t value) {
+        return (value + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
     }
+};
 
+// Hands out the arrays of a mapped snapshot in the order they were written
+class SnapshotReader {
+public:
+    SnapshotReader(char* data, size_t size) : base(data), length(size), table(nullptr), sectionCount(0), nextSection(0) {}
 
+    // Check the header and section table; returns false for foreign or damaged files
+    bool open() {
+        if (length < sizeof(SnapshotHeader)) {
+            return false;
+        }
+        const SnapshotHeader* header = (const SnapshotHeader*)base;
+        if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+            || header->version != SNAPSHOT_VERSION || header->byteOrder != SNAPSHOT_BYTE_ORDER
+            || header->fileSize != length) {
+            return false;
+        }
+        sectionCount = header->sectionCount;
+        if (sizeof(SnapshotHeader) + sizeof(SnapshotSection) * (size_t)sectionCount > length) {
+            return false;
+        }
+        table = (const SnapshotSection*)(base + sizeof(SnapshotHeader));
+        for (unsigned i = 0; i < sectionCount; ++i) {
+            if (table[i].offset % SNAPSHOT_ALIGNMENT != 0 || table[i].offset > length || table[i].elementSize == 0
+                || table[i].count > (length - table[i].offset) / table[i].elementSize) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    // Public method to access the vehicle count for a specific road
-    int getVehicleCount(int fromIndex, int toIndex) {
-        return roadVehicleCounts[fromIndex][toIndex];
+    // Point a column at the next section; fails if the element type does not match
+    template <typename T>
+    bool next(Column<T>& column) {
+        if (nextSection >= sectionCount || table[nextSection].elementSize != sizeof(T)) {
+            return false;
+        }
+        const SnapshotSection& section = table[nextSection++];
+        column.adopt((T*)(base + section.offset), (size_t)section.count);
+        return true;
     }
-    void setVehicleCount(int fromIndex, int toIndex, int count)
-    {
-        // Ensure the indices are valid
-        if (fromIndex < 0 || fromIndex >= MAX_INTERSECTIONS || toIndex < 0 || toIndex >= MAX_INTERSECTIONS) {
-            cout << "Invalid intersection indices." << endl;
-            return;
+
+    bool finished() const { return nextSection == sectionCount; }
+
+private:
+    char* base;
+    size_t length;
+    const SnapshotSection* table;
+    unsigned sectionCount;
+    unsigned nextSection;
+};
+
+
+// String interning table for intersection names.
+// Names are stored back to back in one character arena and map to dense integer IDs
+// through a flat open-addressing hash table (linear probing, power-of-two size), so a
+// lookup hashes the key once and usually touches a single slot.
+class NameTable {
+public:
+    NameTable() { slots.assign(16, -1); }
+
+    int size() const { return (int)nameStart.size(); }
+
+    // Name of an ID; the view stays valid until the next intern call
+    string_view name(int id) const {
+        return string_view(arena.data() + nameStart[id], (size_t)nameLength[id]);
+    }
+
+    // ID of a name, or -1 if it was never interned
+    int find(string_view key) const {
+        unsigned hash = hashOf(key);
+        size_t mask = slots.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            int id = slots[slot];
+            if (id == -1) {
+                return -1;
+            }
+            if (nameHash[id] == hash && name(id) == key) {
+                return id;
+            }
         }
+    }
 
-        // Update the vehicle count for the road from 'fromIndex' to 'toIndex'
-        roadVehicleCounts[fromIndex][toIndex] = count;
+    // ID of a name, adding it to the table if needed
+    int intern(string_view key) {
+        unsigned hash = hashOf(key);
+        size_t mask = slots.size() - 1;
+        size_t slot = hash & mask;
+        for (; slots[slot] != -1; slot = (slot + 1) & mask) {
+            int id = slots[slot];
+            if (nameHash[id] == hash && name(id) == key) {
+                return id;
+            }
+        }
 
-        // If the roads are bidirectional, set the reverse road count as well
-        roadVehicleCounts[toIndex][fromIndex] = count;
+        int id = size();
+        nameStart.push_back((int)arena.size());
+        nameLength.push_back((int)key.size());
+        nameHash.push_back(hash);
+        arena.append(key.data(), key.size());
+        slots[slot] = id;
 
-        // Output for debugging purposes
-        cout << "Vehicle count from " << intersections[fromIndex].name
-            << " to " << intersections[toIndex].name
-            << " set to " << count << endl;
+        // Keep the load factor at or below one half
+        if ((size_t)size() * 2 > slots.size()) {
+            rehash(slots.size() * 2);
+        }
+        return id;
+    }
 
-        // Adjust the green light duration based on the vehicle counts
-        adjustGreenLightDuration(fromIndex);
-        adjustGreenLightDuration(toIndex);
+    // Make room for 'count' names totalling 'bytes' characters without reallocating
+    void reserve(int count, size_t bytes) {
+        arena.reserve(bytes);
+        nameStart.reserve(count);
+        nameLength.reserve(count);
+        nameHash.reserve(count);
+        size_t wanted = 16;
+        while (wanted < (size_t)count * 2) {
+            wanted *= 2;
+        }
+        if (wanted > slots.size()) {
+            rehash(wanted);
+        }
     }
 
+    void clear() {
+        arena.clear();
+        nameStart.clear();
+        nameLength.clear();
+        nameHash.clear();
+        slots.assign(16, -1);
+    }
 
+    void swap(NameTable& other) {
+        arena.swap(other.arena);
+        nameStart.swap(other.nameStart);
+        nameLength.swap(other.nameLength);
+        nameHash.swap(other.nameHash);
+        slots.swap(other.slots);
+    }
 
+    void saveSections(SnapshotWriter& writer) const {
+        writer.add(arena);
+        writer.add(nameStart);
+        writer.add(nameLength);
+        writer.add(nameHash);
+        writer.add(slots);
+    }
 
-    int findIntersection(const string& name) {
-        for (int i = 0; i < count; i++) {
-            if (intersections[i].name == name) {
-                return i; // Intersection found
+    bool loadSections(SnapshotReader& reader) {
+        if (!(reader.next(arena) && reader.next(nameStart) && reader.next(nameLength)
+            && reader.next(nameHash) && reader.next(slots)
+            && nameLength.size() == nameStart.size() && nameHash.size() == nameStart.size()
+            && slots.size() >= 16 && (slots.size() & (slots.size() - 1)) == 0)) {
+            return false;
+        }
+        // Every name must lie inside the arena
+        for (int id = 0; id < size(); ++id) {
+            if (nameStart[id] < 0 || nameLength[id] < 0
+                || (size_t)nameStart[id] + (size_t)nameLength[id] > arena.size()) {
+                return false;
             }
         }
-        return -1; // Intersection not found
+        // Lookups only end at an empty slot, so the stored slots are not trusted: they are
+        // rebuilt from the names, keeping the load factor at or below one half
+        if ((size_t)size() * 2 > slots.size()) {
+            return false;
+        }
+        for (int id = 0; id < size(); ++id) {
+            nameHash[id] = hashOf(name(id));
+        }
+        rehash(slots.size());
+        return true;
     }
 
-    void adjustRoadWeightForCongestion(int fromIndex, int toIndex) {
-        int vehicleCount = roadVehicleCounts[fromIndex][toIndex];
-        int congestionLevel = vehicleCount / 10; // You can change the divisor to better fit traffic scale
-
-        if (congestionLevel > 0) {
-            Edge* current = intersections[fromIndex].head;
-            while (current != NULL) {
-                if (current->to == toIndex) {
-                    current->weight += congestionLevel;  // Increase weight based on congestion
-                    cout << "Increased weight on road from " << intersections[fromIndex].name
-                        << " to " << intersections[toIndex].name << " due to congestion."
-                        << " New weight: " << current->weight << endl;
-                    return;
-                }
-                current = current->next;
+private:
+    Column<char> arena;          // All names, back to back
+    Column<int> nameStart;       // Offset of each name in the arena
+    Column<int> nameLength;      // Length of each name
+    Column<unsigned> nameHash;   // Cached hash of each name, used when rehashing
+    Column<int> slots;           // Hash slots holding IDs, -1 when empty
+
+    // 32-bit FNV-1a
+    static unsigned hashOf(string_view key) {
+        unsigned hash = 2166136261u;
+        for (size_t i = 0; i < key.size(); ++i) {
+            hash ^= (unsigned char)key[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void rehash(size_t newSize) {
+        slots.assign(newSize, -1);
+        size_t mask = newSize - 1;
+        for (int id = 0; id < size(); ++id) {
+            size_t slot = nameHash[id] & mask;
+            while (slots[slot] != -1) {
+                slot = (slot + 1) & mask;
             }
+            slots[slot] = id;
         }
     }
+};
 
 
-    // Method to recalculate the route when rerouting is required
-    void rerouteTraffic(int fromIndex, int toIndex) {
-        // Adjust the road weight based on congestion
-        adjustRoadWeightForCongestion(fromIndex, toIndex);
+// Road storage in compressed sparse row (CSR) form.
+// Every intersection owns one contiguous row of outgoing roads, and all per-road data
+// (target, weight, vehicle count, closure flag) lives in edge-indexed arrays, so memory
+// grows with V + E and a row is scanned without following pointers.
+// Rows keep some spare capacity; a full row is moved to the end of the arrays with
+// twice the room, and the arrays are compacted once too many abandoned slots pile up.
+// Arc indices therefore stay valid only until the next addArc call.
+class RoadNetwork {
+public:
+    // Edge-indexed arrays (one entry per directed road slot)
+    Column<int> targets;             // Destination intersection of the road
+    Column<int> weights;             // Weight (travel time or congestion level)
+    Column<int> baseWeights;         // Weight without congestion, as loaded or last set
+    Column<int> vehicleCounts;       // Vehicles currently on the road
+    Column<unsigned char> closed;    // Road closure status
+    Column<int> profiles;            // Travel-time profile (see TravelTimeProfiles), -1 if none
+    Column<int> greenShares;         // Share of the tail's signal cycle for traffic arriving from the head, 0 = equal split
+
+    RoadNetwork() : liveArcs(0), wastedSlots(0) {}
+
+    int nodeCount() const { return (int)rowStart.size(); }
+    int arcCount() const { return liveArcs; }
+
+    // First and one-past-last arc of an intersection's row
+    int rowBegin(int node) const { return rowStart[node]; }
+    int rowEnd(int node) const { return rowStart[node] + rowDegree[node]; }
+    int degree(int node) const { return rowDegree[node]; }
 
-        // Recalculate the shortest path after adjusting the road weight
-        cout << "Recalculating the shortest path due to traffic congestion...\n";
-        string fromName = intersections[fromIndex].name;
-        string toName = intersections[toIndex].name;
-        dijkstra(fromName, toName);
+    // Add an intersection with an empty row and return its index
+    int addNode() {
+        rowStart.push_back((int)targets.size());
+        rowDegree.push_back(0);
+        rowCapacity.push_back(0);
+        return (int)rowStart.size() - 1;
     }
 
+    // Add a directed road and return its arc index
+    int addArc(int from, int to, int weight) {
+        if (rowDegree[from] == rowCapacity[from]) {
+            growRow(from);
+        }
+        int arc = rowStart[from] + rowDegree[from];
+        targets[arc] = to;
+        weights[arc] = weight;
+        baseWeights[arc] = weight;
+        vehicleCounts[arc] = 0;
+        closed[arc] = 0;
+        profiles[arc] = -1;
+        greenShares[arc] = 0;
+        rowDegree[from]++;
+        liveArcs++;
+        return arc;
+    }
 
-    void addIntersection(const string& name) {
-        // Check if the intersection already exists
-        if (findIntersection(name) != -1) {
-            cout << "Intersection already exists: " << name << endl;
-            return;
+    // Remove the road from -> to; returns false if there is none. The last road of the row
+    // moves into the freed slot, so the row stays dense and its next addArc reuses the slot.
+    // Arc indices of that row change, and so does the order of its roads.
+    bool removeArc(int from, int to) {
+        int arc = findArc(from, to);
+        if (arc == -1) {
+            return false;
         }
-        // Check if we've reached the maximum number of intersections
-        if (count >= MAX_INTERSECTIONS) {
-            cout << "Maximum intersections reached." << endl;
-            return;
+        int last = rowEnd(from) - 1;
+        if (arc != last) {
+            copySlot(last, arc);
         }
-        // Add the new intersection
-        intersections[count].name = name;
-        intersections[count].head = nullptr;
-        count++;
-        cout << "Intersection added: " << name << endl;
+        targets[last] = -1;
+        rowDegree[from]--;
+        liveArcs--;
+        return true;
     }
 
+    // Make room for 'count' intersections without reallocating
+    void reserveNodes(int count) {
+        rowStart.reserve(count);
+        rowDegree.reserve(count);
+        rowCapacity.reserve(count);
+    }
 
+    // Give each row room for additional[node] more roads in a single rewrite, so the
+    // following addArc calls never move a row (the fill pass of a two-pass bulk build)
+    void reserveRows(const vector<int>& additional) {
+        repack(additional, 0);
+    }
 
-    // Method to add a road between two intersections
-   // Method to add a road between two intersections
-    void addRoad(const string& from, const string& to, int weight) {
-        // Find the indices of the intersections
-        int fromIndex = findIntersection(from);
-        int toIndex = findIntersection(to);
+    void clear() {
+        targets.clear();
+        weights.clear();
+        baseWeights.clear();
+        vehicleCounts.clear();
+        closed.clear();
+        profiles.clear();
+        greenShares.clear();
+        rowStart.clear();
+        rowDegree.clear();
+        rowCapacity.clear();
+        liveArcs = 0;
+        wastedSlots = 0;
+    }
 
-        // Check if one or both intersections do not exist
-        if (fromIndex == -1) {
-            cout << "Intersection not found: " << from << endl;
-            return;
+    // Like clear, but also hands the memory of every array back
+    void release() {
+        RoadNetwork empty;
+        swap(empty);
+    }
+
+    void swap(RoadNetwork& other) {
+        targets.swap(other.targets);
+        weights.swap(other.weights);
+        baseWeights.swap(other.baseWeights);
+        vehicleCounts.swap(other.vehicleCounts);
+        closed.swap(other.closed);
+        profiles.swap(other.profiles);
+        greenShares.swap(other.greenShares);
+        rowStart.swap(other.rowStart);
+        rowDegree.swap(other.rowDegree);
+        rowCapacity.swap(other.rowCapacity);
+        std::swap(liveArcs, other.liveArcs);
+        std::swap(wastedSlots, other.wastedSlots);
+    }
+
+    void saveSections(SnapshotWriter& writer) const {
+        int header[2] = { liveArcs, wastedSlots };
+        writer.addCopy(header, 2);
+        writer.add(rowStart);
+        writer.add(rowDegree);
+        writer.add(rowCapacity);
+        writer.add(targets);
+        writer.add(weights);
+        writer.add(baseWeights);
+        writer.add(vehicleCounts);
+        writer.add(closed);
+        writer.add(profiles);
+        writer.add(greenShares);
+    }
+
+    bool loadSections(SnapshotReader& reader) {
+        Column<int> counters;
+        if (!reader.next(counters) || counters.size() != 2) {
+            return false;
         }
-        if (toIndex == -1) {
-            cout << "Intersection not found: " << to << endl;
-            return;
+        liveArcs = counters[0];
+        wastedSlots = counters[1];
+        if (!(reader.next(rowStart) && reader.next(rowDegree) && reader.next(rowCapacity)
+            && reader.next(targets) && reader.next(weights) && reader.next(baseWeights)
+            && reader.next(vehicleCounts) && reader.next(closed) && reader.next(profiles)
+            && reader.next(greenShares))) {
+            return false;
+        }
+        size_t slots = targets.size();
+        if (rowDegree.size() != rowStart.size() || rowCapacity.size() != rowStart.size()
+            || weights.size() != slots || baseWeights.size() != slots || vehicleCounts.size() != slots || closed.size() != slots
+            || profiles.size() != slots || greenShares.size() != slots) {
+            return false;
+        }
+        for (size_t node = 0; node < rowStart.size(); ++node) {
+            if (rowStart[node] < 0 || rowDegree[node] < 0 || rowDegree[node] > rowCapacity[node]
+                || (size_t)rowStart[node] + (size_t)rowCapacity[node] > slots) {
+                return false;
+            }
+            // Live roads must lead to an intersection of this network
+            for (int arc = rowStart[node]; arc < rowStart[node] + rowDegree[node]; ++arc) {
+                if (targets[arc] < 0 || targets[arc] >= (int)rowStart.size()) {
+                    return false;
+                }
+            }
         }
+        return true;
+    }
 
-        // Check for duplicate roads (optional)
-        Edge* current = intersections[fromIndex].head;
-        while (current) {
-            if (current->to == toIndex) {
-                cout << "Road already exists between " << from << " and " << to << endl;
+    // Index of the road from -> to, or -1 if there is none
+    int findArc(int from, int to) const {
+        int end = rowEnd(from);
+        for (int arc = rowStart[from]; arc < end; ++arc) {
+            if (targets[arc] == to) {
+                return arc;
+            }
+        }
+        return -1;
+    }
+
+private:
+    Column<int> rowStart;    // First arc slot of each row
+    Column<int> rowDegree;   // Number of roads in each row
+    Column<int> rowCapacity; // Number of slots reserved for each row
+    int liveArcs;            // Roads currently stored
+    int wastedSlots;         // Slots abandoned by rows that were moved
+
+    // Move a full row to the end of the arrays with twice the room
+    void growRow(int node) {
+        int oldStart = rowStart[node];
+        int oldCapacity = rowCapacity[node];
+        int newCapacity = oldCapacity < 2 ? 4 : oldCapacity * 2;
+
+        // Reclaim abandoned slots first so the arrays stay proportional to the road count
+        if (wastedSlots > liveArcs + 64) {
+            compact();
+            oldStart = rowStart[node];
+            oldCapacity = rowCapacity[node];
+            if (rowDegree[node] < oldCapacity) {
                 return;
             }
-            current = current->next;
         }
-        // Adding road in the opposite direction for bi-directional graph
-        Edge* reverseEdge = new Edge();
-        reverseEdge->to = fromIndex;
-        reverseEdge->weight = weight;
-        reverseEdge->next = intersections[toIndex].head;
-        intersections[toIndex].head = reverseEdge;
 
+        int newStart = (int)targets.size();
+        resizeSlots(newStart + newCapacity);
+        for (int i = 0; i < rowDegree[node]; ++i) {
+            copySlot(oldStart + i, newStart + i);
+        }
+        rowStart[node] = newStart;
+        rowCapacity[node] = newCapacity;
+        wastedSlots += oldCapacity;
+    }
 
-        // Create the new road (edge)
-        Edge* newEdge = new Edge();
-        newEdge->to = toIndex;
-        newEdge->weight = weight;
+    // Rewrite all rows back to back, keeping a little slack in each one
+    void compact() {
+        repack(vector<int>(), 2);
+    }
 
-        // Insert the new edge at the head of the adjacency list
-        newEdge->next = intersections[fromIndex].head;
-        intersections[fromIndex].head = newEdge;
+    // Rewrite all rows back to back; row i gets room for extra[i] more roads (plus
+    // 'slack' for rows that are not empty), so a bulk build fills rows without moving them
+    void repack(const vector<int>& extra, int slack) {
+        int n = nodeCount();
+        vector<int> capacity(n);
+        int total = 0;
+        for (int node = 0; node < n; ++node) {
+            int wanted = rowDegree[node] + (node < (int)extra.size() ? extra[node] : 0);
+            capacity[node] = wanted + (wanted > 0 ? slack : 0);
+            total += capacity[node];
+        }
 
-        // Feedback to the user
-        cout << "Road added between " << from << " and " << to << " with weight " << weight << endl;
+        RoadNetwork packed;
+        packed.resizeSlots(total);
+        int next = 0;
+        for (int node = 0; node < n; ++node) {
+            for (int i = 0; i < rowDegree[node]; ++i) {
+                int from = rowStart[node] + i;
+                packed.targets[next + i] = targets[from];
+                packed.weights[next + i] = weights[from];
+                packed.baseWeights[next + i] = baseWeights[from];
+                packed.vehicleCounts[next + i] = vehicleCounts[from];
+                packed.closed[next + i] = closed[from];
+                packed.profiles[next + i] = profiles[from];
+                packed.greenShares[next + i] = greenShares[from];
+            }
+            rowStart[node] = next;
+            rowCapacity[node] = capacity[node];
+            next += capacity[node];
+        }
+
+        targets.swap(packed.targets);
+        weights.swap(packed.weights);
+        baseWeights.swap(packed.baseWeights);
+        vehicleCounts.swap(packed.vehicleCounts);
+        closed.swap(packed.closed);
+        profiles.swap(packed.profiles);
+        greenShares.swap(packed.greenShares);
+        wastedSlots = 0;
     }
 
+    void resizeSlots(int size) {
+        targets.resize(size, -1);
+        weights.resize(size, 0);
+        baseWeights.resize(size, 0);
+        vehicleCounts.resize(size, 0);
+        closed.resize(size, 0);
+        profiles.resize(size, -1);
+        greenShares.resize(size, 0);
+    }
 
-    // Method to update the weight (time) of an existing road
-    void updateRoadWeight(const string& from, const string& to, int newWeight) {
-        int fromIndex = findIntersection(from);
-        int toIndex = findIntersection(to);
+    void copySlot(int from, int to) {
+        targets[to] = targets[from];
+        weights[to] = weights[from];
+        baseWeights[to] = baseWeights[from];
+        vehicleCounts[to] = vehicleCounts[from];
+        closed[to] = closed[from];
+        profiles[to] = profiles[from];
+        greenShares[to] = greenShares[from];
+    }
+};
 
-        if (fromIndex == -1 || toIndex == -1) {
-            cout << "One or both intersections not found: " << from << ", " << to << endl;
-            return;
+
+
+// Piecewise-linear travel-time functions over one day. A profile is a list of (second of
+// the day, travel time) breakpoints; between them the travel time is interpolated
+// linearly, and after the last breakpoint it runs on to the first one of the next day.
+// Every segment falls by at most one second per second, so leaving later never means
+// arriving earlier (the FIFO property time-dependent searches rely on). Identical
+// profiles are stored once: roads refer to them by ID, and a city's roads typically
+// share a handful of shapes.
+class TravelTimeProfiles {
+public:
+    static const int DAY = 86400; // Seconds in the period every profile repeats with
+
+    TravelTimeProfiles() { pointStart.push_back(0); }
+
+    int count() const { return (int)lowest.size(); }
+    int pointCount() const { return (int)pointTime.size(); }
+
+    // ID of the profile through the given (second of the day, travel time) breakpoints,
+    // adding it if it is new. Returns -1 unless the seconds are strictly increasing within
+    // one day, the travel times are non-negative and no segment violates FIFO.
+    int add(const vector<pair<int, int> >& points) {
+        if (!validBreakpoints((int)points.size(), [&](int i) { return points[i].first; },
+            [&](int i) { return points[i].second; })) {
+            return -1;
         }
 
-        Edge* current = intersections[fromIndex].head;
-        while (current != NULL) {
-            if (current->to == toIndex) {
-                current->weight = newWeight;
-                cout << "Updated road weight from " << from << " to " << to << " to " << newWeight << endl;
-                return;
-            }
-            current = current->next;
+        string key((const char*)points.data(), points.size() * sizeof(points[0]));
+        int id = shapes.intern(key);
+        if (id < count()) {
+            return id;
+        }
+        int minimum = INF;
+        for (size_t i = 0; i < points.size(); ++i) {
+            pointTime.push_back(points[i].first);
+            pointValue.push_back(points[i].second);
+            minimum = min(minimum, points[i].second);
         }
-        cout << "Road not found: " << from << " to " << to << endl;
+        pointStart.push_back((int)pointTime.size());
+        lowest.push_back(minimum);
+        return id;
     }
-    // Method to display current traffic signal timers
-    void displaySignalTimers() {
-        cout << "\nCurrent Traffic Signal Timers:\n";
-        for (int i = 0; i < count; ++i) {
-            cout << intersections[i].name << " - Green Light Duration: "
-                << intersections[i].trafficSignal << " seconds.\n";
+
+    // Travel time of a road with this profile when it is entered 'time' seconds after
+    // midnight of any day (time >= 0)
+    int travelTime(int profile, int time) const {
+        int first = pointStart[profile];
+        int last = pointStart[profile + 1];
+        if (last - first == 1) {
+            return pointValue[first];
+        }
+        int t = time % DAY;
+        const int* times = pointTime.data();
+        int next = (int)(upper_bound(times + first, times + last, t) - times); // First breakpoint after t
+        int previous = next - 1;
+        int previousTime;
+        int nextTime;
+        if (next == first) {
+            previous = last - 1; // Still on the segment that started yesterday
+            previousTime = times[previous] - DAY;
+        }
+        else {
+            previousTime = times[previous];
+        }
+        if (next == last) {
+            next = first; // On the segment that ends tomorrow
+            nextTime = times[next] + DAY;
+        }
+        else {
+            nextTime = times[next];
         }
+        int v0 = pointValue[previous];
+        int v1 = pointValue[next];
+        return v0 + (int)((long long)(v1 - v0) * (t - previousTime) / (nextTime - previousTime));
     }
 
+    // Smallest travel time over the day
+    int minimum(int profile) const { return lowest[profile]; }
 
-    // Method to calculate the shortest path using Dijkstra's Algorithm
-    void dijkstra(const string& startName, const string& endName) {
-        int startIndex = findIntersection(startName);
-        int endIndex = findIntersection(endName);
+    void clear() {
+        TravelTimeProfiles empty;
+        swap(empty);
+    }
 
-        // If one or both intersections are not found
-        if (startIndex == -1 || endIndex == -1) {
-            cout << "Start or end intersection not found: " << startName << ", " << endName << endl;
-            return;
+    void swap(TravelTimeProfiles& other) {
+        shapes.swap(other.shapes);
+        pointStart.swap(other.pointStart);
+        pointTime.swap(other.pointTime);
+        pointValue.swap(other.pointValue);
+        lowest.swap(other.lowest);
+    }
+
+    void saveSections(SnapshotWriter& writer) const {
+        shapes.saveSections(writer);
+        writer.add(pointStart);
+        writer.add(pointTime);
+        writer.add(pointValue);
+        writer.add(lowest);
+    }
+
+    bool loadSections(SnapshotReader& reader) {
+        if (!(shapes.loadSections(reader) && reader.next(pointStart) && reader.next(pointTime)
+            && reader.next(pointValue) && reader.next(lowest))) {
+            return false;
+        }
+        if (pointStart.size() != lowest.size() + 1 || shapes.size() != count() || pointStart[0] != 0
+            || pointValue.size() != pointTime.size() || pointStart[count()] != pointCount()) {
+            return false;
+        }
+        // Every profile must follow the rules add() enforces, with its true minimum
+        for (int profile = 0; profile < count(); ++profile) {
+            int first = pointStart[profile];
+            int points = pointStart[profile + 1] - first;
+            if (points <= 0 || !validBreakpoints(points, [&](int i) { return pointTime[first + i]; },
+                [&](int i) { return pointValue[first + i]; })) {
+                return false;
+            }
+            if (lowest[profile] != *min_element(pointValue.begin() + first, pointValue.begin() + first + points)) {
+                return false;
+            }
         }
+        return true;
+    }
 
-        // Show green light durations for the start and end intersections
-        cout << "Green light duration at " << startName << ": "
-            << intersections[startIndex].trafficSignal << " seconds." << endl;
-        cout << "Green light duration at " << endName << ": "
-            << intersections[endIndex].trafficSignal << " seconds." << endl;
+private:
+    NameTable shapes;        // Breakpoints of each profile as raw bytes, to find duplicates
+    Column<int> pointStart;  // First breakpoint of each profile, plus one past the last
+    Column<int> pointTime;   // Second of the day of each breakpoint, increasing per profile
+    Column<int> pointValue;  // Travel time at each breakpoint
+    Column<int> lowest;      // Smallest travel time of each profile
+
+    // At least one breakpoint, seconds strictly increasing within one day, non-negative
+    // travel times and no segment (including the one across midnight) that falls faster
+    // than time passes
+    template <typename TimeAt, typename ValueAt>
+    static bool validBreakpoints(int points, TimeAt timeAt, ValueAt valueAt) {
+        if (points == 0) {
+            return false;
+        }
+        for (int i = 0; i < points; ++i) {
+            if (timeAt(i) < 0 || timeAt(i) >= DAY || valueAt(i) < 0 || (i > 0 && timeAt(i) <= timeAt(i - 1))) {
+                return false;
+            }
+        }
+        for (int i = 0; i < points; ++i) {
+            int next = i + 1 < points ? i + 1 : 0;
+            int length = i + 1 < points ? timeAt(next) - timeAt(i) : timeAt(next) + DAY - timeAt(i);
+            if (points > 1 && valueAt(i) - valueAt(next) > length) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Travel time of a road entered at 'time': its profile plus the congestion currently on
+// it (weight above base weight), or just its weight if it has no profile
+inline int roadTravelTime(const RoadNetwork& roads, const TravelTimeProfiles& profiles, int arc, int time) {
+    int profile = roads.profiles[arc];
+    if (profile == -1) {
+        return roads.weights[arc];
+    }
+    return profiles.travelTime(profile, time) + max(0, roads.weights[arc] - roads.baseWeights[arc]);
+}
+
+// A position on the map, in the same planar unit as the intersection coordinates
+struct MapPoint {
+    float x;
+    float y;
+};
 
-        // Initialize distances, visited status, and previous node tracker
-        int dist[MAX_INTERSECTIONS];
-        bool visited[MAX_INTERSECTIONS];
-        int prev[MAX_INTERSECTIONS];
+// Where a map position lies on the road network: the closest point of the road
+// from -> to sits 'fraction' of the way along it, 'distance' units from the position
+struct RoadSnap {
+    int from;       // -1 if there was no road to snap to
+    int to;
+    float fraction; // 0 at 'from', 1 at 'to'
+    float distance;
+};
+
+// Static R-tree packed along the Hilbert curve. Items are sorted by the Hilbert index of
+// their box centres and grouped NODE_SIZE at a time, level by level up to a single root,
+// so the whole tree is two flat arrays: neighbouring items on the map are neighbours in
+// memory and a query touches a handful of cache lines per level. Queries report leaves,
+// numbered in that order, so callers keep their per-item data in leaf order as well.
+// The tree never changes after build; a map edit means building it again.
+class PackedRTree {
+public:
+    static const int NODE_SIZE = 16;
+    static const int MAX_STACK = 8 * NODE_SIZE; // Deep enough for 16^8 items
+
+    struct Box {
+        float minX, minY, maxX, maxY;
+    };
+
+    int size() const { return (int)items.size(); }
+
+    // Position in the boxes given to build of the item at a leaf
+    int item(int leaf) const { return items[leaf]; }
+
+    // Hilbert index of a point within the extent of the tree (points outside count as
+    // on its edge); sorting queries by it makes consecutive ones land near each other
+    unsigned curvePosition(float x, float y) const {
+        double fx = min(max((x - extent.minX) / width, 0.0), 1.0);
+        double fy = min(max((y - extent.minY) / height, 0.0), 1.0);
+        return hilbertIndex((unsigned)(65535 * fx), (unsigned)(65535 * fy));
+    }
 
+    // Index the given boxes
+    void build(const vector<Box>& itemBoxes) {
+        int count = (int)itemBoxes.size();
+        minX.clear();
+        minY.clear();
+        maxX.clear();
+        maxY.clear();
+        items.clear();
+        levelStart.clear();
+        if (count == 0) {
+            return;
+        }
+        extent = itemBoxes[0];
+        for (int i = 1; i < count; ++i) {
+            extent = merge(extent, itemBoxes[i]);
+        }
+        width = max(extent.maxX - extent.minX, 1e-30f);
+        height = max(extent.maxY - extent.minY, 1e-30f);
+        vector<pair<unsigned, int> > order(count);
         for (int i = 0; i < count; ++i) {
-            dist[i] = INF;    // Set all distances to infinity
-            visited[i] = false;  // Mark all as unvisited
-            prev[i] = -1;     // No previous nodes initially
+            const Box& box = itemBoxes[i];
+            order[i] = make_pair(curvePosition((box.minX + box.maxX) / 2, (box.minY + box.maxY) / 2), i);
         }
-        dist[startIndex] = 0; // Distance to the start node is zero
+        sort(order.begin(), order.end());
 
-        // Main Dijkstra loop
+        items.resize(count);
+        levelStart.push_back(0);
         for (int i = 0; i < count; ++i) {
-            int minDist = INF, u = -1;
+            items[i] = order[i].second;
+            appendBox(itemBoxes[order[i].second]);
+        }
+        padLevel();
+        int levelBegin = 0;
+        int levelSize = count;
+        while (levelSize > 1) {
+            int parentBegin = (int)minX.size();
+            levelStart.push_back(parentBegin);
+            for (int child = 0; child < levelSize; child += NODE_SIZE) {
+                Box box = boxAt(levelBegin + child);
+                for (int i = child + 1; i < min(child + NODE_SIZE, levelSize); ++i) {
+                    box = merge(box, boxAt(levelBegin + i));
+                }
+                appendBox(box);
+            }
+            levelBegin = parentBegin;
+            levelSize = (int)minX.size() - parentBegin;
+            padLevel();
+        }
+    }
+
+    // Leaf closest to (x, y) by the squared distance itemDistance(leaf) returns (infinity
+    // leaves an item out), or -1 if there is none. 'bestDistance' receives its squared
+    // distance. Branch and bound: a depth-first walk, nearest child first, skips every
+    // box farther away than the best item so far. The bound is seeded with leaf 'hint'
+    // (a nearby answer, such as the previous one of a batch in Hilbert order) or else by
+    // a greedy descent to the nearest box on every level, so the walk rarely opens more
+    // than a node or two per level.
+    template <typename ItemDistance>
+    int nearest(float x, float y, ItemDistance itemDistance, double& bestDistance, int hint = -1) const {
+        bestDistance = numeric_limits<double>::infinity();
+        if (items.empty()) {
+            return -1;
+        }
+        float distances[NODE_SIZE];
+        int top = (int)levelStart.size() - 1;
+        if (hint < 0 || hint >= size()) {
+            hint = 0;
+            for (int level = top; level > 0; --level) {
+                nodeDistances(level - 1, hint, x, y, distances);
+                int closest = 0;
+                for (int i = 1; i < NODE_SIZE; ++i) {
+                    if (distances[i] < distances[closest]) {
+                        closest = i;
+                    }
+                }
+                hint = hint * NODE_SIZE + closest;
+            }
+        }
+        int best = -1;
+        double seed = itemDistance(hint);
+        if (seed < bestDistance) {
+            bestDistance = seed;
+            best = hint;
+        }
+        if (top == 0) {
+            return best;
+        }
+
+        int stackLevel[MAX_STACK];
+        int stackNode[MAX_STACK];
+        float stackDistance[MAX_STACK];
+        int depth = 0;
+        stackLevel[depth] = top;
+        stackNode[depth] = 0;
+        stackDistance[depth++] = 0;
+        while (depth > 0) {
+            depth--;
+            if (stackDistance[depth] >= bestDistance) {
+                continue; // The bound tightened since the node was pushed
+            }
+            int level = stackLevel[depth];
+            int node = stackNode[depth];
+            nodeDistances(level - 1, node, x, y, distances);
+            if (level == 1) {
+                for (int i = 0; i < NODE_SIZE; ++i) {
+                    if (distances[i] < bestDistance) {
+                        double distance = itemDistance(node * NODE_SIZE + i);
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = node * NODE_SIZE + i;
+                        }
+                    }
+                }
+                continue;
+            }
+            // Push the children worth opening farthest first, so the nearest is popped next
+            int first = depth;
+            for (int i = 0; i < NODE_SIZE; ++i) {
+                if (distances[i] >= bestDistance) {
+                    continue;
+                }
+                int slot = depth++;
+                while (slot > first && stackDistance[slot - 1] < distances[i]) {
+                    stackLevel[slot] = stackLevel[slot - 1];
+                    stackNode[slot] = stackNode[slot - 1];
+                    stackDistance[slot] = stackDistance[slot - 1];
+                    slot--;
+                }
+                stackLevel[slot] = level - 1;
+                stackNode[slot] = node * NODE_SIZE + i;
+                stackDistance[slot] = distances[i];
+            }
+        }
+        return best;
+    }
+
+private:
+    // Boxes as four parallel arrays: the leaves (items in Hilbert order), then each level
+    // of parents up to the root. Every level is padded with empty boxes to whole nodes,
+    // so a node is always NODE_SIZE boxes and its distances come out of one straight loop
+    // the compiler turns into vector instructions.
+    vector<float> minX, minY, maxX, maxY;
+    vector<int> items;      // Item of each leaf
+    vector<int> levelStart; // First box of each level; level 0 holds the leaves
+    Box extent = {};        // Bounds of all items, and their size for curvePosition
+    double width = 1, height = 1;
+
+    // Squared distances from (x, y) to the boxes of 'node' on 'level' (infinity for padding)
+    void nodeDistances(int level, int node, float x, float y, float* distances) const {
+        int begin = levelStart[level] + node * NODE_SIZE;
+        const float* lowX = minX.data() + begin;
+        const float* lowY = minY.data() + begin;
+        const float* highX = maxX.data() + begin;
+        const float* highY = maxY.data() + begin;
+        for (int i = 0; i < NODE_SIZE; ++i) {
+            // (a + |a|) / 2 is max(a, 0) without a comparison, which keeps the loop
+            // branch-free; at most one side of a box can be positive
+            float left = lowX[i] - x, right = x - highX[i];
+            float below = lowY[i] - y, above = y - highY[i];
+            float dx = (left + fabs(left)) * 0.5f + (right + fabs(right)) * 0.5f;
+            float dy = (below + fabs(below)) * 0.5f + (above + fabs(above)) * 0.5f;
+            distances[i] = dx * dx + dy * dy;
+        }
+    }
+
+    Box boxAt(int slot) const {
+        Box box = { minX[slot], minY[slot], maxX[slot], maxY[slot] };
+        return box;
+    }
+
+    void appendBox(const Box& box) {
+        minX.push_back(box.minX);
+        minY.push_back(box.minY);
+        maxX.push_back(box.maxX);
+        maxY.push_back(box.maxY);
+    }
+
+    // Fill the last level up to a whole node with boxes no point is near
+    void padLevel() {
+        const float far = numeric_limits<float>::infinity();
+        Box empty = { far, far, -far, -far };
+        while ((minX.size() - levelStart.back()) % NODE_SIZE != 0) {
+            appendBox(empty);
+        }
+    }
+
+    static Box merge(const Box& a, const Box& b) {
+        Box box = { min(a.minX, b.minX), min(a.minY, b.minY), max(a.maxX, b.maxX), max(a.maxY, b.maxY) };
+        return box;
+    }
+
+    // Position of (x, y) along a Hilbert curve over a 65536 x 65536 grid
+    static unsigned hilbertIndex(unsigned x, unsigned y) {
+        unsigned index = 0;
+        for (unsigned side = 1u << 15; side > 0; side >>= 1) {
+            unsigned rx = (x & side) ? 1 : 0;
+            unsigned ry = (y & side) ? 1 : 0;
+            index += side * side * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = 65535 - x;
+                    y = 65535 - y;
+                }
+                unsigned swap = x;
+                x = y;
+                y = swap;
+            }
+        }
+        return index;
+    }
+};
+
+// Nearest-intersection and nearest-road lookups for map positions: one packed R-tree
+// over the intersections that have coordinates and one over the roads between them
+// (each road once, whichever way it runs). Positions and road ends are copied next to
+// the leaves in leaf order, so a query reads no intersection data. Built from a snapshot
+// of the coordinates; rebuild it after intersections move or roads are added or removed.
+class SpatialIndex {
+public:
+    void build(const RoadNetwork& roads, const Column<Intersection>& intersections) {
+        int nodes = roads.nodeCount();
+        vector<PackedRTree::Box> boxes;
+        vector<int> items;
+        for (int u = 0; u < nodes; ++u) {
+            if (intersections[u].hasCoordinates) {
+                PackedRTree::Box box = { intersections[u].x, intersections[u].y, intersections[u].x, intersections[u].y };
+                boxes.push_back(box);
+                items.push_back(u);
+            }
+        }
+        nodeTree.build(boxes);
+        points.resize(items.size());
+        for (size_t leaf = 0; leaf < items.size(); ++leaf) {
+            int u = items[nodeTree.item((int)leaf)];
+            points[leaf].node = u;
+            points[leaf].x = intersections[u].x;
+            points[leaf].y = intersections[u].y;
+        }
+
+        boxes.clear();
+        vector<Segment> found;
+        for (int u = 0; u < nodes; ++u) {
+            if (!intersections[u].hasCoordinates) {
+                continue;
+            }
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int v = roads.targets[arc];
+                if (!intersections[v].hasCoordinates || (v < u && roads.findArc(v, u) != -1)) {
+                    continue; // No position, or indexed from the other end
+                }
+                Segment segment = { intersections[u].x, intersections[u].y, intersections[v].x, intersections[v].y, u, v };
+                PackedRTree::Box box = { min(segment.ax, segment.bx), min(segment.ay, segment.by),
+                    max(segment.ax, segment.bx), max(segment.ay, segment.by) };
+                boxes.push_back(box);
+                found.push_back(segment);
+            }
+        }
+        roadTree.build(boxes);
+        segments.resize(found.size());
+        for (size_t leaf = 0; leaf < found.size(); ++leaf) {
+            segments[leaf] = found[roadTree.item((int)leaf)];
+        }
+    }
+
+    int indexedIntersections() const { return nodeTree.size(); }
+    int indexedRoads() const { return roadTree.size(); }
+
+    // Closest intersection to (px, py), or -1 if none has coordinates
+    int nearestIntersection(float px, float py, float* distance = nullptr) const {
+        double best;
+        int leaf = nodeTree.nearest(px, py, [&](int i) {
+            double dx = (double)points[i].x - px;
+            double dy = (double)points[i].y - py;
+            return dx * dx + dy * dy;
+        }, best);
+        if (distance) {
+            *distance = leaf == -1 ? 0 : (float)sqrt(best);
+        }
+        return leaf == -1 ? -1 : points[leaf].node;
+    }
+
+    // Closest point of any road to (px, py) among the roads accept(from, to) allows;
+    // returns false (snap.from = -1) if there is none. 'hint', if given, names the leaf
+    // of a nearby earlier answer (or -1) to start from and receives this one's.
+    template <typename Accept>
+    bool nearestRoad(float px, float py, RoadSnap& snap, Accept accept, int* hint = nullptr) const {
+        double best;
+        int leaf = roadTree.nearest(px, py, [&](int i) {
+            if (!accept(segments[i].from, segments[i].to)) {
+                return numeric_limits<double>::infinity();
+            }
+            double fraction;
+            return segmentDistance(segments[i], px, py, fraction);
+        }, best, hint ? *hint : -1);
+        if (hint) {
+            *hint = leaf;
+        }
+        snap.from = -1;
+        snap.to = -1;
+        snap.fraction = 0;
+        snap.distance = 0;
+        if (leaf == -1) {
+            return false;
+        }
+        double fraction;
+        segmentDistance(segments[leaf], px, py, fraction);
+        snap.from = segments[leaf].from;
+        snap.to = segments[leaf].to;
+        snap.fraction = (float)fraction;
+        snap.distance = (float)sqrt(best);
+        return true;
+    }
+
+    bool nearestRoad(float px, float py, RoadSnap& snap, int* hint = nullptr) const {
+        return nearestRoad(px, py, snap, [](int, int) { return true; }, hint);
+    }
+
+    // Sort key that puts positions near each other on the map next to each other
+    unsigned curvePosition(float px, float py) const { return roadTree.curvePosition(px, py); }
+
+private:
+    struct Point {
+        float x, y;
+        int node;
+    };
+    struct Segment {
+        float ax, ay, bx, by; // Positions of the two ends
+        int from, to;
+    };
+
+    PackedRTree nodeTree;
+    vector<Point> points;     // Intersection at each leaf of nodeTree
+    PackedRTree roadTree;
+    vector<Segment> segments; // Road at each leaf of roadTree
+
+    // Squared distance from (px, py) to a road; 'fraction' receives the position of the
+    // closest point along it
+    static double segmentDistance(const Segment& segment, float px, float py, double& fraction) {
+        double dx = (double)segment.bx - segment.ax, dy = (double)segment.by - segment.ay;
+        double lengthSquared = dx * dx + dy * dy;
+        fraction = lengthSquared > 0 ? ((px - segment.ax) * dx + (py - segment.ay) * dy) / lengthSquared : 0;
+        fraction = min(max(fraction, 0.0), 1.0);
+        double cx = segment.ax + fraction * dx - px;
+        double cy = segment.ay + fraction * dy - py;
+        return cx * cx + cy * cy;
+    }
+};
+
+
+
+// Indexed 4-ary min-heap over intersection indices.
+// Each node appears at most once, so a better distance lowers the key in place.
+class IndexedDaryHeap {
+public:
+    void resize(int nodeCount) { position.assign(nodeCount, -1); items.clear(); }
+    bool empty() const { return items.empty(); }
+    int topKey() const { return items[0].key; }
+
+    void clear() {
+        for (size_t i = 0; i < items.size(); ++i) {
+            position[items[i].node] = -1;
+        }
+        items.clear();
+    }
+
+    // Insert a node, or lower its key if it is already queued
+    void pushOrDecrease(int node, int key) {
+        int slot = position[node];
+        if (slot == -1) {
+            slot = (int)items.size();
+            items.push_back(HeapItem{ key, node });
+        }
+        else if (key < items[slot].key) {
+            items[slot].key = key;
+        }
+        else {
+            return;
+        }
+        siftUp(slot);
+    }
+
+    // Remove the node with the smallest key and return it
+    int pop() {
+        int node = items[0].node;
+        position[node] = -1;
+        HeapItem last = items.back();
+        items.pop_back();
+        if (!items.empty()) {
+            items[0] = last;
+            position[last.node] = 0;
+            siftDown(0);
+        }
+        return node;
+    }
+
+private:
+    static const int ARITY = 4;
+    struct HeapItem {
+        int key;
+        int node;
+    };
+    vector<HeapItem> items;
+    vector<int> position; // Slot of each node in 'items', or -1 when not queued
+
+    void siftUp(int slot) {
+        HeapItem item = items[slot];
+        while (slot > 0) {
+            int parent = (slot - 1) / ARITY;
+            if (items[parent].key <= item.key) {
+                break;
+            }
+            items[slot] = items[parent];
+            position[items[slot].node] = slot;
+            slot = parent;
+        }
+        items[slot] = item;
+        position[item.node] = slot;
+    }
+
+    void siftDown(int slot) {
+        HeapItem item = items[slot];
+        int size = (int)items.size();
+        while (true) {
+            int first = slot * ARITY + 1;
+            if (first >= size) {
+                break;
+            }
+            int last = first + ARITY < size ? first + ARITY : size;
+            int best = first;
+            for (int child = first + 1; child < last; ++child) {
+                if (items[child].key < items[best].key) {
+                    best = child;
+                }
+            }
+            if (items[best].key >= item.key) {
+                break;
+            }
+            items[slot] = items[best];
+            position[items[slot].node] = slot;
+            slot = best;
+        }
+        items[slot] = item;
+        position[item.node] = slot;
+    }
+};
+
+// Radix heap for monotone non-negative integer keys (Dijkstra never pops a key
+// smaller than the previous one). Entries go into buckets by the highest bit in which
+// they differ from the last popped key; outdated entries are skipped by the caller.
+class RadixHeap {
+public:
+    RadixHeap() : last(0), size(0) {}
+
+    bool empty() const { return size == 0; }
+
+    void clear() {
+        for (int i = 0; i < BUCKETS; ++i) {
+            buckets[i].clear();
+        }
+        last = 0;
+        size = 0;
+    }
+
+    void push(int key, int node) {
+        buckets[bucketOf((unsigned)key)].push_back(HeapItem{ (unsigned)key, node });
+        size++;
+    }
+
+    // Remove an entry with the smallest key; returns its node and stores the key
+    int pop(int& key) {
+        if (buckets[0].empty()) {
+            int i = 1;
+            while (buckets[i].empty()) {
+                i++;
+            }
+            unsigned newLast = buckets[i][0].key;
+            for (size_t j = 1; j < buckets[i].size(); ++j) {
+                if (buckets[i][j].key < newLast) {
+                    newLast = buckets[i][j].key;
+                }
+            }
+            last = newLast;
+            for (size_t j = 0; j < buckets[i].size(); ++j) {
+                buckets[bucketOf(buckets[i][j].key)].push_back(buckets[i][j]);
+            }
+            buckets[i].clear();
+        }
+        HeapItem item = buckets[0].back();
+        buckets[0].pop_back();
+        size--;
+        key = (int)item.key;
+        return item.node;
+    }
+
+private:
+    static const int BUCKETS = 33;
+    struct HeapItem {
+        unsigned key;
+        int node;
+    };
+    vector<HeapItem> buckets[BUCKETS];
+    unsigned last; // Key of the most recently popped entry
+    int size;
+
+    int bucketOf(unsigned key) const {
+        unsigned diff = key ^ last;
+        if (diff == 0) {
+            return 0;
+        }
+#if defined(__GNUC__)
+        return 32 - __builtin_clz(diff);
+#else
+        int bit = 0;
+        while (diff >>= 1) {
+            bit++;
+        }
+        return bit + 1;
+#endif
+    }
+};
+
+// Priority queue used by the shortest path engine
+enum HeapKind {
+    DARY_HEAP,  // Indexed 4-ary heap with decrease-key
+    RADIX_HEAP  // Radix heap for small non-negative integer weights
+};
+
+// Per-search scratch arrays. Only the entries a search touched are reset before the
+// next one, so short queries on a large map do not pay for clearing every node.
+struct SearchWorkspace {
+    vector<int> dist;
+    vector<int> prev;
+    vector<unsigned char> settled;
+    vector<int> touched;
+    vector<unsigned char> targetMark; // Targets of a one-to-many search
+    vector<int> scratch;              // Free list for callers of the search
+    IndexedDaryHeap daryHeap;
+    RadixHeap radixHeap;
+    int settledCount;                 // Nodes settled by the last search
+    long long scannedRoads;           // Roads looked at from them (only counted with TRAFFIC_METRICS)
+    int heapPushes;                   // Inserts and decrease-keys (only counted with TRAFFIC_METRICS)
+
+    SearchWorkspace() : settledCount(0), scannedRoads(0), heapPushes(0) {}
+
+    void prepare(int nodeCount) {
+        settledCount = 0;
+        scannedRoads = 0;
+        heapPushes = 0;
+        if ((int)dist.size() != nodeCount) {
+            dist.assign(nodeCount, INF);
+            prev.assign(nodeCount, -1);
+            settled.assign(nodeCount, 0);
+            daryHeap.resize(nodeCount);
+            radixHeap.clear();
+            touched.clear();
+            return;
+        }
+        for (size_t i = 0; i < touched.size(); ++i) {
+            int node = touched[i];
+            dist[node] = INF;
+            prev[node] = -1;
+            settled[node] = 0;
+        }
+        touched.clear();
+        daryHeap.clear();
+        radixHeap.clear();
+    }
+
+    void reach(int node, int distance, int previous) {
+        METRICS_ONLY(heapPushes++); // Every caller queues the node it reaches
+        if (dist[node] == INF) {
+            touched.push_back(node);
+        }
+        dist[node] = distance;
+        prev[node] = previous;
+    }
+};
+
+// Dijkstra search from 'source' over open roads. After each node is settled,
+// stopAfter(node) decides whether the search can end early.
+template <typename StopCondition>
+void dijkstraSearch(const RoadNetwork& roads, int source, HeapKind heapKind, SearchWorkspace& ws, StopCondition stopAfter) {
+    ws.prepare(roads.nodeCount());
+    ws.reach(source, 0, -1);
+
+    const int* targets = roads.targets.data();
+    const int* weights = roads.weights.data();
+    const unsigned char* closed = roads.closed.data();
+
+    if (heapKind == DARY_HEAP) {
+        ws.daryHeap.pushOrDecrease(source, 0);
+    }
+    else {
+        ws.radixHeap.push(0, source);
+    }
+
+    while (true) {
+        int u;
+        if (heapKind == DARY_HEAP) {
+            if (ws.daryHeap.empty()) break;
+            u = ws.daryHeap.pop();
+        }
+        else {
+            if (ws.radixHeap.empty()) break;
+            int key;
+            u = ws.radixHeap.pop(key);
+            if (ws.settled[u] || key > ws.dist[u]) continue; // Outdated entry
+        }
+
+        ws.settled[u] = 1;
+        ws.settledCount++;
+        if (stopAfter(u)) break;
+        METRICS_ONLY(ws.scannedRoads += roads.degree(u));
+
+        // Relax the contiguous row of roads leaving u
+        int du = ws.dist[u];
+        int end = roads.rowEnd(u);
+        for (int arc = roads.rowBegin(u); arc < end; ++arc) {
+            int v = targets[arc];
+            if (closed[arc] || ws.settled[v]) continue;
+            int candidate = du + weights[arc];
+            if (candidate < ws.dist[v]) {
+                ws.reach(v, candidate, u);
+                if (heapKind == DARY_HEAP) {
+                    ws.daryHeap.pushOrDecrease(v, candidate);
+                }
+                else {
+                    ws.radixHeap.push(candidate, v);
+                }
+            }
+        }
+    }
+}
+
+// Shortest path search from 'source' over open roads. Stops once 'target' is settled,
+// or explores everything reachable when 'target' is -1. Returns the distance to the
+// target (INF if unreachable); dist/prev in the workspace stay valid until the next search.
+int runDijkstra(const RoadNetwork& roads, int source, int target, HeapKind heapKind, SearchWorkspace& ws) {
+    dijkstraSearch(roads, source, heapKind, ws, [target](int node) { return node == target; });
+    return target == -1 ? 0 : ws.dist[target];
+}
+
+// One-to-many search: stops as soon as every node in targets[0..count) is settled
+void runDijkstraToTargets(const RoadNetwork& roads, int source, const int* targets, int count,
+    HeapKind heapKind, SearchWorkspace& ws) {
+    ws.targetMark.resize(roads.nodeCount(), 0);
+    int remaining = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!ws.targetMark[targets[i]]) {
+            ws.targetMark[targets[i]] = 1;
+            remaining++;
+        }
+    }
+
+    dijkstraSearch(roads, source, heapKind, ws, [&](int node) {
+        if (ws.targetMark[node]) {
+            remaining--;
+        }
+        return remaining == 0;
+    });
+
+    for (int i = 0; i < count; ++i) {
+        ws.targetMark[targets[i]] = 0;
+    }
+}
+
+
+
+// Persistent pool of worker threads for data-parallel loops. Threads are started on
+// first use and sleep between jobs; the calling thread takes part as worker 0, so a
+// pool of size 1 runs everything inline.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threadCount = 0) : workerCount(threadCount), job(nullptr), jobSize(0),
+        generation(0), running(0), stopping(false), nextIndex(0) {
+        if (workerCount <= 0) {
+            workerCount = (int)thread::hardware_concurrency();
+        }
+        if (workerCount <= 0) {
+            workerCount = 1;
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> lock(poolMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+    }
+
+    // Number of workers, including the calling thread
+    int size() const { return workerCount; }
+
+    // Run task(worker, index) for every index in [0, count) and wait for all of them.
+    // Indices are handed out one at a time, so uneven tasks still balance.
+    void parallelFor(int count, const function<void(int, int)>& task) {
+        if (count <= 0) {
+            return;
+        }
+        if (workerCount == 1 || count == 1) {
+            for (int i = 0; i < count; ++i) {
+                task(0, i);
+            }
+            return;
+        }
+        startThreads();
+
+        {
+            lock_guard<mutex> lock(poolMutex);
+            job = &task;
+            jobSize = count;
+            nextIndex.store(0);
+            running = workerCount - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        unique_lock<mutex> lock(poolMutex);
+        finished.wait(lock, [this] { return running == 0; });
+        job = nullptr;
+    }
+
+private:
+    int workerCount;
+    vector<thread> threads;
+    mutex poolMutex;
+    condition_variable wake;     // Signals a new job (or shutdown) to the workers
+    condition_variable finished; // Signals the caller that every worker is done
+    const function<void(int, int)>* job;
+    int jobSize;
+    unsigned generation;         // Incremented for each job so workers never run one twice
+    int running;                 // Workers still busy with the current job
+    bool stopping;
+    atomic<int> nextIndex;
+
+    WorkerPool(const WorkerPool&);            // Not copyable
+    WorkerPool& operator=(const WorkerPool&);
+
+    void startThreads() {
+        if (!threads.empty()) {
+            return;
+        }
+        for (int worker = 1; worker < workerCount; ++worker) {
+            threads.push_back(thread(&WorkerPool::workerLoop, this, worker));
+        }
+    }
+
+    void work(int worker) {
+        while (true) {
+            int index = nextIndex.fetch_add(1);
+            if (index >= jobSize) {
+                break;
+            }
+            (*job)(worker, index);
+        }
+    }
+
+    void workerLoop(int worker) {
+        unsigned seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> lock(poolMutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            work(worker);
+            {
+                lock_guard<mutex> lock(poolMutex);
+                running--;
+            }
+            finished.notify_one();
+        }
+    }
+};
+
+// Unbounded single-producer single-consumer queue without locks. Items go into linked
+// blocks: the producer publishes each item with a release store of its block's fill
+// count, and the consumer frees a block once it has read all of it and the producer has
+// moved on to the next one.
+template <typename T>
+class SpscQueue {
+public:
+    SpscQueue() : head(new Block()), readIndex(0), tail(head) {}
+
+    ~SpscQueue() {
+        while (head != nullptr) {
+            Block* next = head->next.load(memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+
+    // Producer side
+    void push(const T& item) {
+        int index = tail->count.load(memory_order_relaxed);
+        if (index == BLOCK_SIZE) {
+            Block* block = new Block();
+            tail->next.store(block, memory_order_release);
+            tail = block;
+            index = 0;
+        }
+        tail->items[index] = item;
+        tail->count.store(index + 1, memory_order_release);
+    }
+
+    // Consumer side; returns false if the queue is empty
+    bool pop(T& item) {
+        if (readIndex == BLOCK_SIZE) {
+            Block* next = head->next.load(memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+            delete head;
+            head = next;
+            readIndex = 0;
+        }
+        if (readIndex == head->count.load(memory_order_acquire)) {
+            return false;
+        }
+        item = head->items[readIndex++];
+        return true;
+    }
+
+private:
+    static const int BLOCK_SIZE = 1024;
+
+    struct Block {
+        T items[BLOCK_SIZE];
+        atomic<int> count;
+        atomic<Block*> next;
+
+        Block() : count(0), next(nullptr) {}
+    };
+
+    alignas(64) Block* head; // Consumer side
+    int readIndex;
+    alignas(64) Block* tail; // Producer side
+
+    SpscQueue(const SpscQueue&);            // Not copyable
+    SpscQueue& operator=(const SpscQueue&);
+};
+
+// Reusable barrier for a fixed group of threads. Waiters spin briefly and then yield,
+// so short phases stay cheap and more threads than cores still make progress.
+class SpinBarrier {
+public:
+    explicit SpinBarrier(int threadCount) : threads(threadCount), waiting(0), phase(0) {}
+
+    void wait() {
+        unsigned current = phase.load(memory_order_acquire);
+        if (waiting.fetch_add(1, memory_order_acq_rel) + 1 == threads) {
+            waiting.store(0, memory_order_relaxed);
+            phase.fetch_add(1, memory_order_release); // Releases everyone
+            return;
+        }
+        int spins = 0;
+        while (phase.load(memory_order_acquire) == current) {
+            if (++spins > 64) {
+                this_thread::yield();
+            }
+        }
+    }
+
+private:
+    int threads;
+    atomic<int> waiting;
+    atomic<unsigned> phase;
+};
+
+// Single-writer publication of immutable versions for lock-free readers (epoch-based
+// RCU). A Reader pins the current version by announcing the epoch it started in on a
+// free slot; publish() swaps the new version in with one atomic exchange and deletes an
+// old version only once every reader that could still hold it has left.
+template <typename T>
+class Versioned {
+public:
+    static const int READER_SLOTS = 64; // Readers pinned at once; further readers spin
+
+    class Reader {
+    public:
+        explicit Reader(const Versioned& owner) : owner(owner), slot(owner.enter()), version(owner.current.load()) {}
+        ~Reader() { owner.slots[slot].store(0); }
+
+        const T* get() const { return version; } // Null if nothing was published yet
+
+    private:
+        const Versioned& owner;
+        int slot;
+        const T* version;
+
+        Reader(const Reader&);            // Not copyable
+        Reader& operator=(const Reader&);
+    };
+
+    Versioned() : current(nullptr), epoch(1) {
+        for (int i = 0; i < READER_SLOTS; ++i) {
+            slots[i].store(0);
+        }
+    }
+    ~Versioned() {
+        delete current.load();
+        for (size_t i = 0; i < retired.size(); ++i) {
+            delete retired[i].first;
+        }
+    }
+
+    // Make 'version' the one new readers see. Writer thread only.
+    void publish(unique_ptr<T> version) {
+        const T* old = current.exchange(version.release());
+        unsigned long long retiredAt = epoch.fetch_add(1) + 1;
+        if (old != nullptr) {
+            retired.push_back(make_pair(old, retiredAt));
+        }
+        reclaim();
+    }
+
+    // Old versions still waiting for readers to leave. Writer thread only.
+    size_t retiredCount() const { return retired.size(); }
+
+private:
+    mutable atomic<unsigned long long> slots[READER_SLOTS]; // Epoch of the pinning reader, 0 = free
+    atomic<const T*> current;
+    atomic<unsigned long long> epoch;
+    vector<pair<const T*, unsigned long long> > retired; // Version and the epoch it was replaced in
+
+    // Claim a free slot, starting at one picked by thread so readers rarely collide
+    int enter() const {
+        size_t start = hash<thread::id>()(this_thread::get_id());
+        while (true) {
+            for (int i = 0; i < READER_SLOTS; ++i) {
+                int slot = (int)((start + i) % READER_SLOTS);
+                unsigned long long expected = 0;
+                if (slots[slot].load(memory_order_relaxed) == 0
+                    && slots[slot].compare_exchange_strong(expected, epoch.load())) {
+                    return slot;
+                }
+            }
+            this_thread::yield();
+        }
+    }
+
+    // Delete the versions replaced before the oldest epoch a reader is still in
+    void reclaim() {
+        unsigned long long oldest = ~0ULL;
+        for (int i = 0; i < READER_SLOTS; ++i) {
+            unsigned long long pinned = slots[i].load();
+            if (pinned != 0 && pinned < oldest) {
+                oldest = pinned;
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].second <= oldest) {
+                delete retired[i].first;
+            }
+            else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    Versioned(const Versioned&);            // Not copyable
+    Versioned& operator=(const Versioned&);
+};
+
+// Structured event log. Records are small fixed-size structs; each thread appends to its
+// own lock-free ring and a background thread drains the rings into a binary file, so a
+// logging call never waits for I/O. A full ring drops records (they are counted) rather
+// than blocking. Run the program with --decode-log to turn a file into text.
+enum LogLevel {
+    LOG_OFF,   // Nothing is recorded
+    LOG_INFO,  // User-level actions: road changes and closures, routes, loads, batch and run summaries
+    LOG_DEBUG  // Also per-item detail: roads loaded, vehicle counts, signal changes, simulated reroutes
+};
+
+// Record types; the comment lists the meaning of the arguments
+enum LogEvent {
+    LOG_DATA_LOADED,     // file (0-4 in loadAllData order), records, rows skipped
+    LOG_ROAD_ADDED,      // from, to, weight
+    LOG_ROAD_REMOVED,    // from, to
+    LOG_ROAD_WEIGHT,     // from, to, weight
+    LOG_ROAD_CLOSED,     // from, to, closed (1) or reopened (0)
+    LOG_VEHICLE_COUNT,   // from, to, count
+    LOG_COUNT_BATCH,     // readings applied, skipped, weights changed, signals changed
+    LOG_SIGNAL_CHANGED,  // intersection, green seconds
+    LOG_ROUTE,           // start, end, distance, nodes settled, RoutingAlgorithm
+    LOG_EMERGENCY_ROUTE, // start, end, RoutingAlgorithm
+    LOG_REROUTE,         // vehicle, intersection, destination, simulated second
+    LOG_SIMULATION,      // arrived, stranded, en route, reroutes, simulated seconds
+    LOG_EMERGENCY_DISPATCH, // vehicle, start, end, priority, seconds held for other corridors
+    LOG_SIGNAL_PLAN,     // signalized intersections, plans changed, microseconds
+    LOG_ASSIGNMENT,      // trips assigned, trips unroutable, Frank-Wolfe steps, relative gap (ppm), milliseconds
+    LOG_EVENT_TYPES
+};
+
+struct LogRecord {
+    long long time;        // Nanoseconds since the log was opened
+    unsigned short event;  // LogEvent
+    unsigned short thread; // Ring the record came through, numbered in order of first use
+    int args[5];
+};
+
+const char EVENT_LOG_MAGIC[4] = { 'T', 'L', 'O', 'G' };
+const unsigned EVENT_LOG_VERSION = 1;
+
+// One per process (the rings are per thread): see eventLog below
+class EventLog {
+public:
+    static const unsigned RING_SIZE = 8192;  // Records per thread (a power of two)
+    static constexpr int DRAIN_INTERVAL_MS = 20;
+
+    EventLog() : level(LOG_OFF), file(nullptr), stopping(false), dropped(0), nextThread(0) {}
+    ~EventLog() {
+        close();
+        for (size_t i = 0; i < rings.size(); ++i) {
+            delete rings[i];
+        }
+    }
+
+    bool enabled(LogLevel wanted) const { return wanted != LOG_OFF && level.load(memory_order_relaxed) >= wanted; }
+    LogLevel getLevel() const { return (LogLevel)level.load(); }
+    bool isOpen() const { return file != nullptr; }
+    long long droppedCount() const { return dropped.load(); }
+
+    // Start logging to 'filename' at 'newLevel', closing any open log first.
+    // Returns false if the file cannot be created.
+    bool open(const string& filename, LogLevel newLevel) {
+        close();
+        file = fopen(filename.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        unsigned header[2] = { EVENT_LOG_VERSION, (unsigned)sizeof(LogRecord) };
+        fwrite(EVENT_LOG_MAGIC, 1, sizeof(EVENT_LOG_MAGIC), file);
+        fwrite(header, sizeof(unsigned), 2, file);
+        {
+            lock_guard<mutex> lock(ringsMutex);
+            for (size_t i = 0; i < rings.size(); ++i) {
+                rings[i]->tail.store(rings[i]->head.load(memory_order_acquire), memory_order_release); // Stale records
+            }
+        }
+        dropped.store(0);
+        started = chrono::steady_clock::now();
+        stopping = false;
+        drainer = thread(&EventLog::drainLoop, this);
+        level.store(newLevel);
+        return true;
+    }
+
+    // Change the level of an open log
+    void setLevel(LogLevel newLevel) {
+        if (file != nullptr) {
+            level.store(newLevel);
+        }
+    }
+
+    // Stop recording, write out what is buffered and close the file
+    void close() {
+        if (file == nullptr) {
+            return;
+        }
+        level.store(LOG_OFF);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        drainer.join();
+        drain();
+        fclose(file);
+        file = nullptr;
+    }
+
+    // Record an event if 'wanted' is enabled. A disabled level costs one relaxed load.
+    void add(LogLevel wanted, LogEvent event, int a = 0, int b = 0, int c = 0, int d = 0, int e = 0) {
+        if (!enabled(wanted)) {
+            return;
+        }
+        Ring* ring = localRing();
+        unsigned head = ring->head.load(memory_order_relaxed);
+        if (head - ring->tail.load(memory_order_acquire) == RING_SIZE) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        LogRecord& record = ring->records[head & (RING_SIZE - 1)];
+        record.time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+        record.event = (unsigned short)event;
+        record.thread = ring->number;
+        record.args[0] = a;
+        record.args[1] = b;
+        record.args[2] = c;
+        record.args[3] = d;
+        record.args[4] = e;
+        ring->head.store(head + 1, memory_order_release);
+    }
+
+private:
+    struct Ring {
+        LogRecord records[RING_SIZE];
+        alignas(64) atomic<unsigned> head; // Next record the owning thread writes
+        alignas(64) atomic<unsigned> tail; // Next record the drainer reads
+        atomic<bool> retired;              // The owning thread has exited
+        unsigned short number;
+
+        Ring() : head(0), tail(0), retired(false), number(0) {}
+    };
+
+    // Marks the calling thread's ring as retired when the thread exits
+    struct RingHandle {
+        Ring* ring;
+
+        RingHandle() : ring(nullptr) {}
+        ~RingHandle() {
+            if (ring != nullptr) {
+                ring->retired.store(true, memory_order_release);
+            }
+        }
+    };
+
+    atomic<int> level;
+    FILE* file;
+    chrono::steady_clock::time_point started;
+    thread drainer;
+    mutex wakeMutex;
+    condition_variable wake;
+    bool stopping;                // Guarded by wakeMutex
+    atomic<long long> dropped;
+    mutex ringsMutex;             // Guards 'rings'; taken by a thread's first record, never after
+    vector<Ring*> rings;
+    unsigned short nextThread;
+
+    Ring* localRing() {
+        static thread_local RingHandle handle;
+        if (handle.ring == nullptr) {
+            Ring* ring = new Ring();
+            lock_guard<mutex> lock(ringsMutex);
+            ring->number = nextThread++;
+            rings.push_back(ring);
+            handle.ring = ring;
+        }
+        return handle.ring;
+    }
+
+    void drainLoop() {
+        while (true) {
+            bool stop;
+            {
+                unique_lock<mutex> lock(wakeMutex);
+                wake.wait_for(lock, chrono::milliseconds(DRAIN_INTERVAL_MS), [this] { return stopping; });
+                stop = stopping;
+            }
+            if (stop) {
+                return; // close() drains the rest
+            }
+            drain();
+        }
+    }
+
+    // Write every ring's pending records; free the rings of threads that have exited
+    void drain() {
+        lock_guard<mutex> lock(ringsMutex);
+        size_t kept = 0;
+        for (size_t i = 0; i < rings.size(); ++i) {
+            Ring* ring = rings[i];
+            bool retired = ring->retired.load(memory_order_acquire);
+            unsigned head = ring->head.load(memory_order_acquire);
+            unsigned tail = ring->tail.load(memory_order_relaxed);
+            while (tail != head) {
+                unsigned start = tail & (RING_SIZE - 1);
+                unsigned count = min(head - tail, RING_SIZE - start);
+                fwrite(ring->records + start, sizeof(LogRecord), count, file);
+                tail += count;
+            }
+            ring->tail.store(tail, memory_order_release);
+            if (retired) {
+                delete ring;
+            }
+            else {
+                rings[kept++] = ring;
+            }
+        }
+        rings.resize(kept);
+        fflush(file);
+    }
+
+    EventLog(const EventLog&);            // Not copyable
+    EventLog& operator=(const EventLog&);
+};
+
+EventLog eventLog;
+
+// Instrumentation counters and latency histograms. Every thread adds to its own shard
+// (plain relaxed stores, no shared cache lines); a snapshot sums the shards. With
+// TRAFFIC_METRICS set to 0 the calls below compile to nothing.
+enum MetricCounter {
+    COUNT_ROUTE_QUERIES,     // Point-to-point route queries
+    COUNT_NODES_SETTLED,     // Intersections settled (or hierarchy nodes scanned) by them
+    COUNT_ROADS_SCANNED,     // Roads looked at from settled intersections
+    COUNT_HEAP_PUSHES,       // Heap inserts and decrease-keys
+    COUNT_NAME_LOOKUPS,      // findIntersection calls
+    COUNT_REROUTES,          // rerouteTraffic calls
+    COUNT_SIGNAL_UPDATES,    // Green times recomputed
+    COUNT_CONGESTION_UPDATES,// Congestion weight adjustments of single roads
+    COUNT_COUNT_READINGS,    // Vehicle count readings applied in batches
+    METRIC_COUNTERS
+};
+
+enum MetricTimer {
+    TIME_ROUTE,              // shortestPathById
+    TIME_NAME_LOOKUP,        // findIntersection
+    TIME_REROUTE,            // rerouteTraffic, including its route query
+    TIME_SIGNAL_UPDATE,      // adjustGreenLightDuration
+    TIME_CONGESTION_UPDATE,  // adjustRoadWeightForCongestion
+    TIME_COUNT_BATCH,        // applyVehicleCounts
+    TIME_EMERGENCY_DISPATCH, // dispatchEmergencyById, including its route query
+    TIME_SIGNAL_PLAN,        // optimizeSignals over the whole network
+    TIME_ASSIGNMENT,         // assignTraffic, solving and applying the equilibrium
+    METRIC_TIMERS
+};
+
+// Prometheus names and help text, in enum order
+const char* const COUNTER_NAMES[METRIC_COUNTERS][2] = {
+    { "traffic_route_queries_total", "Point-to-point route queries" },
+    { "traffic_nodes_settled_total", "Intersections settled (or hierarchy nodes scanned) by route queries" },
+    { "traffic_roads_scanned_total", "Roads looked at from settled intersections" },
+    { "traffic_heap_pushes_total", "Priority queue inserts and decrease-keys" },
+    { "traffic_name_lookups_total", "Intersection name lookups" },
+    { "traffic_reroutes_total", "Reroutes requested" },
+    { "traffic_signal_updates_total", "Green times recomputed" },
+    { "traffic_congestion_updates_total", "Congestion weight adjustments of single roads" },
+    { "traffic_count_readings_total", "Vehicle count readings applied in batches" }
+};
+const char* const TIMER_NAMES[METRIC_TIMERS][2] = {
+    { "traffic_route_seconds", "Latency of point-to-point route queries" },
+    { "traffic_name_lookup_seconds", "Latency of intersection name lookups" },
+    { "traffic_reroute_seconds", "Latency of reroutes, including the route query" },
+    { "traffic_signal_update_seconds", "Latency of single green time adjustments" },
+    { "traffic_congestion_update_seconds", "Latency of single congestion weight adjustments" },
+    { "traffic_count_batch_seconds", "Latency of vehicle count batches" },
+    { "traffic_emergency_dispatch_seconds", "Latency of emergency corridor dispatches, including the route query" },
+    { "traffic_signal_plan_seconds", "Latency of network-wide signal optimization cycles" },
+    { "traffic_assignment_seconds", "Latency of user-equilibrium traffic assignments" }
+};
+
+// HDR-style log-linear buckets over nanoseconds: exact below 16 ns, then each power of
+// two split into 16 buckets, so any value is within 1/16 of its bucket's lower bound
+struct LatencyBuckets {
+    static const int SUB_BUCKETS = 16;
+    static const int COUNT = 38 * SUB_BUCKETS; // Up to 2^41 ns (about 36 minutes)
+
+    static int index(unsigned long long nanoseconds) {
+        if (nanoseconds < SUB_BUCKETS) {
+            return (int)nanoseconds;
+        }
+        int exponent = 63;
+        while (!(nanoseconds >> exponent)) {
+            exponent--;
+        }
+        int bucket = (exponent - 3) * SUB_BUCKETS + (int)((nanoseconds >> (exponent - 4)) & (SUB_BUCKETS - 1));
+        return min(bucket, COUNT - 1);
+    }
+
+    // Middle of a bucket's range
+    static double value(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        int exponent = bucket / SUB_BUCKETS + 3;
+        double width = (double)(1ULL << (exponent - 4));
+        return (SUB_BUCKETS + bucket % SUB_BUCKETS) * width + width / 2;
+    }
+};
+
+struct MetricsSnapshot {
+    unsigned long long counters[METRIC_COUNTERS];
+    unsigned long long buckets[METRIC_TIMERS][LatencyBuckets::COUNT];
+    unsigned long long samples[METRIC_TIMERS];
+    unsigned long long totalNanoseconds[METRIC_TIMERS];
+
+    MetricsSnapshot() { memset((void*)this, 0, sizeof(*this)); }
+
+    // Latency (ns) below which 'fraction' of a timer's samples fall; 0 without samples
+    double quantile(MetricTimer timer, double fraction) const {
+        if (samples[timer] == 0) {
+            return 0;
+        }
+        unsigned long long rank = (unsigned long long)ceil(fraction * samples[timer]);
+        unsigned long long seen = 0;
+        for (int bucket = 0; bucket < LatencyBuckets::COUNT; ++bucket) {
+            seen += buckets[timer][bucket];
+            if (seen >= rank && seen > 0) {
+                return LatencyBuckets::value(bucket);
+            }
+        }
+        return LatencyBuckets::value(LatencyBuckets::COUNT - 1);
+    }
+};
+
+// One per process (shards are per thread): see metrics below
+class Metrics {
+public:
+    Metrics() {}
+    ~Metrics() {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            delete shards[i];
+        }
+    }
+
+    void add(MetricCounter counter, unsigned long long amount = 1) {
+#if TRAFFIC_METRICS
+        bump(localShard()->counters[counter], amount);
+#else
+        (void)counter;
+        (void)amount;
+#endif
+    }
+
+    void record(MetricTimer timer, unsigned long long nanoseconds) {
+#if TRAFFIC_METRICS
+        Shard* shard = localShard();
+        bump(shard->buckets[timer][LatencyBuckets::index(nanoseconds)], 1);
+        bump(shard->samples[timer], 1);
+        bump(shard->totalNanoseconds[timer], nanoseconds);
+#else
+        (void)timer;
+        (void)nanoseconds;
+#endif
+    }
+
+    // Totals over all threads, including threads that have exited
+    void snapshot(MetricsSnapshot& result) {
+        lock_guard<mutex> lock(shardsMutex);
+        result = retired;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            addShard(*shards[i], result);
+        }
+    }
+
+    static bool compiledIn() { return TRAFFIC_METRICS != 0; }
+
+private:
+    struct Shard {
+        atomic<unsigned long long> counters[METRIC_COUNTERS];
+        atomic<unsigned long long> buckets[METRIC_TIMERS][LatencyBuckets::COUNT];
+        atomic<unsigned long long> samples[METRIC_TIMERS];
+        atomic<unsigned long long> totalNanoseconds[METRIC_TIMERS];
+
+        Shard() {
+            for (int c = 0; c < METRIC_COUNTERS; ++c) {
+                counters[c].store(0, memory_order_relaxed);
+            }
+            for (int t = 0; t < METRIC_TIMERS; ++t) {
+                for (int b = 0; b < LatencyBuckets::COUNT; ++b) {
+                    buckets[t][b].store(0, memory_order_relaxed);
+                }
+                samples[t].store(0, memory_order_relaxed);
+                totalNanoseconds[t].store(0, memory_order_relaxed);
+            }
+        }
+    };
+
+    // Folds the calling thread's shard into 'retired' when the thread exits
+    struct ShardHandle {
+        Metrics* owner;
+        Shard* shard;
+
+        ShardHandle() : owner(nullptr), shard(nullptr) {}
+        ~ShardHandle() {
+            if (shard != nullptr) {
+                owner->retire(shard);
+            }
+        }
+    };
+
+    mutex shardsMutex; // Taken when a thread first records, when it exits and by snapshot
+    vector<Shard*> shards;
+    MetricsSnapshot retired;
+
+    // Only the owning thread writes a shard, so a relaxed load and store is enough
+    static void bump(atomic<unsigned long long>& value, unsigned long long amount) {
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    static void addShard(const Shard& shard, MetricsSnapshot& result) {
+        for (int c = 0; c < METRIC_COUNTERS; ++c) {
+            result.counters[c] += shard.counters[c].load(memory_order_relaxed);
+        }
+        for (int t = 0; t < METRIC_TIMERS; ++t) {
+            for (int b = 0; b < LatencyBuckets::COUNT; ++b) {
+                result.buckets[t][b] += shard.buckets[t][b].load(memory_order_relaxed);
+            }
+            result.samples[t] += shard.samples[t].load(memory_order_relaxed);
+            result.totalNanoseconds[t] += shard.totalNanoseconds[t].load(memory_order_relaxed);
+        }
+    }
+
+    Shard* localShard() {
+        static thread_local ShardHandle handle;
+        if (handle.shard == nullptr) {
+            Shard* shard = new Shard();
+            lock_guard<mutex> lock(shardsMutex);
+            shards.push_back(shard);
+            handle.owner = this;
+            handle.shard = shard;
+        }
+        return handle.shard;
+    }
+
+    void retire(Shard* shard) {
+        lock_guard<mutex> lock(shardsMutex);
+        addShard(*shard, retired);
+        shards.erase(find(shards.begin(), shards.end(), shard));
+        delete shard;
+    }
+
+    Metrics(const Metrics&);            // Not copyable
+    Metrics& operator=(const Metrics&);
+};
+
+Metrics metrics;
+
+// Records the lifetime of a scope in a latency histogram
+class ScopedTimer {
+public:
+#if TRAFFIC_METRICS
+    explicit ScopedTimer(MetricTimer timer) : timer(timer), started(chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        metrics.record(timer, (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - started).count());
+    }
+
+private:
+    MetricTimer timer;
+    chrono::steady_clock::time_point started;
+#else
+    explicit ScopedTimer(MetricTimer) {}
+#endif
+};
+
+// Print the current totals: counters, then samples and p50/p90/p99 per timer
+void printMetrics(ostream& out) {
+    if (!Metrics::compiledIn()) {
+        out << "Metrics are compiled out of this build (TRAFFIC_METRICS=0).\n";
+        return;
+    }
+    MetricsSnapshot snapshot;
+    metrics.snapshot(snapshot);
+    char line[160];
+    for (int c = 0; c < METRIC_COUNTERS; ++c) {
+        snprintf(line, sizeof(line), "%-36s %16llu", COUNTER_NAMES[c][0], snapshot.counters[c]);
+        out << line << '\n';
+    }
+    snprintf(line, sizeof(line), "%-36s %12s %12s %12s %12s", "latency (us)", "samples", "p50", "p90", "p99");
+    out << line << '\n';
+    for (int t = 0; t < METRIC_TIMERS; ++t) {
+        MetricTimer timer = (MetricTimer)t;
+        snprintf(line, sizeof(line), "%-36s %12llu %12.3f %12.3f %12.3f", TIMER_NAMES[t][0], snapshot.samples[t],
+            snapshot.quantile(timer, 0.5) / 1000.0, snapshot.quantile(timer, 0.9) / 1000.0,
+            snapshot.quantile(timer, 0.99) / 1000.0);
+        out << line << '\n';
+    }
+}
+
+// Write the current totals in the Prometheus text format (timers as summaries in seconds).
+// The file is written next to its final name and renamed, so a scraper never sees half of it.
+bool writePrometheusMetrics(const string& filename) {
+    MetricsSnapshot snapshot;
+    metrics.snapshot(snapshot);
+    string partial = filename + ".tmp";
+    {
+        ofstream out(partial.c_str());
+        if (!out) {
+            return false;
+        }
+        out.precision(9);
+        for (int c = 0; c < METRIC_COUNTERS; ++c) {
+            out << "# HELP " << COUNTER_NAMES[c][0] << ' ' << COUNTER_NAMES[c][1] << '\n'
+                << "# TYPE " << COUNTER_NAMES[c][0] << " counter\n"
+                << COUNTER_NAMES[c][0] << ' ' << snapshot.counters[c] << '\n';
+        }
+        const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+        for (int t = 0; t < METRIC_TIMERS; ++t) {
+            const char* name = TIMER_NAMES[t][0];
+            out << "# HELP " << name << ' ' << TIMER_NAMES[t][1] << '\n'
+                << "# TYPE " << name << " summary\n";
+            for (int q = 0; q < 4; ++q) {
+                out << name << "{quantile=\"" << quantiles[q] << "\"} "
+                    << snapshot.quantile((MetricTimer)t, quantiles[q]) / 1e9 << '\n';
+            }
+            out << name << "_sum " << snapshot.totalNanoseconds[t] / 1e9 << '\n'
+                << name << "_count " << snapshot.samples[t] << '\n';
+        }
+        if (!out) {
+            return false;
+        }
+    }
+    return rename(partial.c_str(), filename.c_str()) == 0;
+}
+
+// One route request of a batch
+struct RouteQuery {
+    int start; // Start intersection
+    int end;   // End intersection
+};
+
+// Answer to one RouteQuery; the path is stored in RouteBatch::paths
+struct RouteResult {
+    int distance;   // INF if the end cannot be reached
+    int pathOffset; // First intersection of the path in RouteBatch::paths
+    int pathLength; // Number of intersections on the path (0 if unreachable)
+};
+
+// Results of a batch, in the same order as the queries
+struct RouteBatch {
+    vector<RouteResult> routes;
+    vector<int> paths; // All paths back to back, each listed from start to end
+};
+
+// A single route with the time at which it reaches each of its intersections
+struct Route {
+    int start;
+    int end;
+    int distance;              // INF if the end cannot be reached
+    vector<int> intersections; // From start to end (empty if unreachable)
+    vector<int> arrival;       // Seconds after departure at which each intersection is reached
+
+    Route() : start(-1), end(-1), distance(INF) {}
+    bool found() const { return distance != INF; }
+};
+
+
+
+// Customizable Contraction Hierarchy (CCH) over the road network.
+// Preprocessing is split in two so weight changes stay cheap:
+//  - build(): metric-independent. Intersections are ordered by a minimum-degree
+//    elimination of the undirected road graph and contracted, adding a shortcut between
+//    every pair of higher neighbours of an eliminated node. Nodes are renumbered by
+//    rank, so the hierarchy's arcs run from lower to higher rank in a CSR layout.
+//  - customize(): applies the current weights and closures. Each hierarchy arc (x, y)
+//    takes the best of its own road and every lower triangle x - z - y with z below
+//    both; arcs are processed by increasing lower endpoint so their triangles are final.
+// After a few roads change, updateRoads() re-derives only the arcs whose triangles
+// can see the change instead of customizing the whole hierarchy again.
+// Queries walk the elimination tree upward from both ends (a bidirectional upward
+// search that needs no priority queue) and unpack shortcuts into road paths.
+class ContractionHierarchy {
+public:
+    ContractionHierarchy() : nodeCount(0), scanned(0) {}
+
+    bool empty() const { return nodeCount == 0; }
+    int shortcutCount() const { return (int)upHead.size(); }
+    int lastScannedCount() const { return scanned; } // Nodes scanned by the last query
+
+    // Order and contract the current road topology (weights are not used)
+    void build(const RoadNetwork& roads) {
+        nodeCount = roads.nodeCount();
+        computeOrder(roads);
+        buildDownwardIndex();
+
+        int arcs = (int)upHead.size();
+        inputUp.assign(arcs, INF);
+        inputDown.assign(arcs, INF);
+        upWeight.assign(arcs, INF);
+        downWeight.assign(arcs, INF);
+        upVia.assign(arcs, -1);
+        downVia.assign(arcs, -1);
+
+        forwardDist.assign(nodeCount, INF);
+        backwardDist.assign(nodeCount, INF);
+        forwardArc.assign(nodeCount, -1);
+        backwardArc.assign(nodeCount, -1);
+    }
+
+    // Apply the current weights and closures to every hierarchy arc
+    void customize(const RoadNetwork& roads) {
+        int arcs = (int)upHead.size();
+        for (int arc = 0; arc < arcs; ++arc) {
+            loadInput(roads, arc);
+        }
+        // Arcs are stored by increasing lower endpoint, which is exactly the order in
+        // which their lower triangles become final
+        for (int arc = 0; arc < arcs; ++arc) {
+            recompute(arc);
+        }
+    }
+
+    // Re-customize after the roads between the given intersection pairs changed weight
+    // or closure. Only arcs whose value actually moves are followed upward.
+    void updateRoads(const RoadNetwork& roads, const vector<pair<int, int> >& changedRoads) {
+        // Min-heap of arcs keyed by the rank of their lower endpoint
+        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > pending;
+        vector<unsigned char> queued(upHead.size(), 0);
+
+        for (size_t i = 0; i < changedRoads.size(); ++i) {
+            int x = rank[changedRoads[i].first];
+            int y = rank[changedRoads[i].second];
+            int arc = x < y ? findUpArc(x, y) : findUpArc(y, x);
+            if (arc == -1) {
+                continue;
+            }
+            loadInput(roads, arc);
+            if (!queued[arc]) {
+                queued[arc] = 1;
+                pending.push(make_pair(arcTail[arc], arc));
+            }
+        }
+
+        while (!pending.empty()) {
+            int arc = pending.top().second;
+            pending.pop();
+            queued[arc] = 0;
+            if (!recompute(arc)) {
+                continue;
+            }
+            // Arc (x, y) is the lower side of the triangles x - y - w for the other
+            // upper neighbours w of x; those arcs (y, w) or (w, y) may now change
+            int x = arcTail[arc];
+            int y = upHead[arc];
+            for (int other = upBegin[x]; other < upBegin[x + 1]; ++other) {
+                int w = upHead[other];
+                if (w == y) continue;
+                int affected = y < w ? findUpArc(y, w) : findUpArc(w, y);
+                if (!queued[affected]) {
+                    queued[affected] = 1;
+                    pending.push(make_pair(arcTail[affected], affected));
+                }
+            }
+        }
+    }
+
+    // Length of the shortest route from start to end; 'path' receives the intersections
+    // along it when given. Uses the most recent customization.
+    int query(int start, int end, vector<int>* path) {
+        int s = rank[start];
+        int t = rank[end];
+
+        // Upward sweeps along the elimination tree from both ends
+        forwardDist[s] = 0;
+        for (int node = s; node != -1; node = parent[node]) {
+            forwardChain.push_back(node);
+            int distance = forwardDist[node];
+            if (distance == INF) continue;
+            for (int arc = upBegin[node]; arc < upBegin[node + 1]; ++arc) {
+                int candidate = distance + upWeight[arc];
+                if (upWeight[arc] != INF && candidate < forwardDist[upHead[arc]]) {
+                    forwardDist[upHead[arc]] = candidate;
+                    forwardArc[upHead[arc]] = arc;
+                }
+            }
+        }
+        backwardDist[t] = 0;
+        int best = INF;
+        int meeting = -1;
+        for (int node = t; node != -1; node = parent[node]) {
+            backwardChain.push_back(node);
+            int distance = backwardDist[node];
+            if (distance == INF) continue;
+            if (forwardDist[node] != INF && forwardDist[node] + distance < best) {
+                best = forwardDist[node] + distance;
+                meeting = node;
+            }
+            for (int arc = upBegin[node]; arc < upBegin[node + 1]; ++arc) {
+                int candidate = distance + downWeight[arc];
+                if (downWeight[arc] != INF && candidate < backwardDist[upHead[arc]]) {
+                    backwardDist[upHead[arc]] = candidate;
+                    backwardArc[upHead[arc]] = arc;
+                }
+            }
+        }
+
+        if (path != nullptr) {
+            path->clear();
+            if (meeting != -1) {
+                unpackRoute(s, meeting, t, *path);
+            }
+        }
+
+        // Reset only what the sweeps touched
+        for (size_t i = 0; i < forwardChain.size(); ++i) {
+            forwardDist[forwardChain[i]] = INF;
+            forwardArc[forwardChain[i]] = -1;
+        }
+        for (size_t i = 0; i < backwardChain.size(); ++i) {
+            backwardDist[backwardChain[i]] = INF;
+            backwardArc[backwardChain[i]] = -1;
+        }
+        scanned = (int)(forwardChain.size() + backwardChain.size());
+        forwardChain.clear();
+        backwardChain.clear();
+        return best;
+    }
+
+private:
+    int nodeCount;
+    int scanned;
+    vector<int> rank;         // Rank of each intersection
+    vector<int> order;        // Intersection at each rank
+    vector<int> parent;       // Elimination tree parent (by rank), -1 for roots
+
+    // Upward arcs in rank space: arcs of x are upBegin[x] .. upBegin[x + 1], heads sorted
+    vector<int> upBegin;
+    vector<int> upHead;
+    vector<int> arcTail;      // Lower endpoint of each arc
+
+    // Downward index: for each node, its lower neighbours (sorted) and the connecting arc
+    vector<int> downBegin;
+    vector<int> downTail;
+    vector<int> downArc;
+
+    // Metric: 'up' is the cost from the lower to the higher endpoint, 'down' the reverse
+    vector<int> inputUp, inputDown;   // Direct road weights (INF if none or closed)
+    vector<int> upWeight, downWeight; // Customized weights
+    vector<int> upVia, downVia;       // Middle node of the best triangle, -1 for a direct road
+
+    // Query scratch
+    vector<int> forwardDist, backwardDist;
+    vector<int> forwardArc, backwardArc;
+    vector<int> forwardChain, backwardChain;
+
+    // Minimum-degree elimination of the undirected road graph
+    void computeOrder(const RoadNetwork& roads) {
+        vector<vector<int> > neighbours(nodeCount);
+        for (int u = 0; u < nodeCount; ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int v = roads.targets[arc];
+                if (v != u) {
+                    neighbours[u].push_back(v);
+                    neighbours[v].push_back(u);
+                }
+            }
+        }
+        for (int u = 0; u < nodeCount; ++u) {
+            sort(neighbours[u].begin(), neighbours[u].end());
+            neighbours[u].erase(unique(neighbours[u].begin(), neighbours[u].end()), neighbours[u].end());
+        }
+
+        rank.assign(nodeCount, -1);
+        order.assign(nodeCount, -1);
+        vector<vector<int> > upper(nodeCount); // Higher neighbours at elimination time
+        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > byDegree;
+        for (int u = 0; u < nodeCount; ++u) {
+            byDegree.push(make_pair((int)neighbours[u].size(), u));
+        }
+
+        vector<int> merged;
+        int next = 0;
+        while (!byDegree.empty()) {
+            int degree = byDegree.top().first;
+            int x = byDegree.top().second;
+            byDegree.pop();
+            if (rank[x] != -1 || degree != (int)neighbours[x].size()) {
+                continue; // Already eliminated, or an outdated degree
+            }
+            rank[x] = next;
+            order[next] = x;
+            next++;
+
+            // The remaining neighbours of x become a clique
+            vector<int>& clique = neighbours[x];
+            for (size_t i = 0; i < clique.size(); ++i) {
+                int v = clique[i];
+                merged.clear();
+                const vector<int>& current = neighbours[v];
+                size_t a = 0, b = 0;
+                while (a < current.size() || b < clique.size()) {
+                    int candidate;
+                    if (b == clique.size() || (a < current.size() && current[a] < clique[b])) {
+                        candidate = current[a++];
+                    }
+                    else if (a == current.size() || clique[b] < current[a]) {
+                        candidate = clique[b++];
+                    }
+                    else {
+                        candidate = current[a++];
+                        b++;
+                    }
+                    if (candidate != v && candidate != x) {
+                        merged.push_back(candidate);
+                    }
+                }
+                neighbours[v].swap(merged);
+                byDegree.push(make_pair((int)neighbours[v].size(), v));
+            }
+            upper[x].swap(clique);
+            vector<int>().swap(neighbours[x]);
+        }
+
+        // Build the upward CSR in rank space
+        upBegin.assign(nodeCount + 1, 0);
+        for (int r = 0; r < nodeCount; ++r) {
+            upBegin[r + 1] = upBegin[r] + (int)upper[order[r]].size();
+        }
+        upHead.assign(upBegin[nodeCount], 0);
+        arcTail.assign(upBegin[nodeCount], 0);
+        parent.assign(nodeCount, -1);
+        for (int r = 0; r < nodeCount; ++r) {
+            const vector<int>& heads = upper[order[r]];
+            int first = upBegin[r];
+            for (size_t i = 0; i < heads.size(); ++i) {
+                upHead[first + i] = rank[heads[i]];
+                arcTail[first + i] = r;
+            }
+            sort(upHead.begin() + first, upHead.begin() + upBegin[r + 1]);
+            if (!heads.empty()) {
+                parent[r] = upHead[first]; // Lowest higher neighbour
+            }
+        }
+    }
+
+    void buildDownwardIndex() {
+        int arcs = (int)upHead.size();
+        downBegin.assign(nodeCount + 1, 0);
+        for (int arc = 0; arc < arcs; ++arc) {
+            downBegin[upHead[arc] + 1]++;
+        }
+        for (int r = 0; r < nodeCount; ++r) {
+            downBegin[r + 1] += downBegin[r];
+        }
+        downTail.assign(arcs, 0);
+        downArc.assign(arcs, 0);
+        vector<int> fill(downBegin.begin(), downBegin.end() - 1);
+        // Arcs are visited by increasing tail, so every down list comes out sorted
+        for (int arc = 0; arc < arcs; ++arc) {
+            int slot = fill[upHead[arc]]++;
+            downTail[slot] = arcTail[arc];
+            downArc[slot] = arc;
+        }
+    }
+
+    // Arc from lower rank x to higher rank y, or -1
+    int findUpArc(int x, int y) const {
+        const int* first = upHead.data() + upBegin[x];
+        const int* last = upHead.data() + upBegin[x + 1];
+        const int* found = lower_bound(first, last, y);
+        return found != last && *found == y ? (int)(found - upHead.data()) : -1;
+    }
+
+    // Read the direct road weights (both directions) of one hierarchy arc
+    void loadInput(const RoadNetwork& roads, int arc) {
+        int lower = order[arcTail[arc]];
+        int higher = order[upHead[arc]];
+        int road = roads.findArc(lower, higher);
+        inputUp[arc] = road == -1 || roads.closed[road] ? INF : roads.weights[road];
+        road = roads.findArc(higher, lower);
+        inputDown[arc] = road == -1 || roads.closed[road] ? INF : roads.weights[road];
+    }
+
+    // Re-derive one arc from its road and its lower triangles; returns true if it changed
+    bool recompute(int arc) {
+        int x = arcTail[arc];
+        int y = upHead[arc];
+        int bestUp = inputUp[arc], viaUp = -1;
+        int bestDown = inputDown[arc], viaDown = -1;
+
+        // Common lower neighbours z of x and y, found by merging their sorted down lists
+        int i = downBegin[x], iEnd = downBegin[x + 1];
+        int j = downBegin[y], jEnd = downBegin[y + 1];
+        while (i < iEnd && j < jEnd) {
+            if (downTail[i] < downTail[j]) { i++; continue; }
+            if (downTail[j] < downTail[i]) { j++; continue; }
+            int zx = downArc[i]; // Arc z - x
+            int zy = downArc[j]; // Arc z - y
+            // x -> z -> y and y -> z -> x
+            if (downWeight[zx] != INF && upWeight[zy] != INF && downWeight[zx] + upWeight[zy] < bestUp) {
+                bestUp = downWeight[zx] + upWeight[zy];
+                viaUp = downTail[i];
+            }
+            if (downWeight[zy] != INF && upWeight[zx] != INF && downWeight[zy] + upWeight[zx] < bestDown) {
+                bestDown = downWeight[zy] + upWeight[zx];
+                viaDown = downTail[i];
+            }
+            i++;
+            j++;
+        }
+
+        bool changed = bestUp != upWeight[arc] || bestDown != downWeight[arc];
+        upWeight[arc] = bestUp;
+        downWeight[arc] = bestDown;
+        upVia[arc] = viaUp;
+        downVia[arc] = viaDown;
+        return changed;
+    }
+
+    // Expand the hierarchy route s -> meeting -> t into intersections
+    void unpackRoute(int s, int meeting, int t, vector<int>& path) {
+        // Arcs from s up to the meeting node, collected backwards
+        vector<int> upArcs;
+        for (int node = meeting; node != s; node = arcTail[forwardArc[node]]) {
+            upArcs.push_back(forwardArc[node]);
+        }
+        path.push_back(order[s]);
+        for (int k = (int)upArcs.size() - 1; k >= 0; --k) {
+            unpackArc(upArcs[k], true, path);
+        }
+        for (int node = meeting; node != t; node = arcTail[backwardArc[node]]) {
+            unpackArc(backwardArc[node], false, path);
+        }
+    }
+
+    // Append the intersections of one arc (excluding its first one); 'upward' means it is
+    // travelled from its lower to its higher endpoint
+    void unpackArc(int arc, bool upward, vector<int>& path) {
+        vector<pair<int, bool> > stack;
+        stack.push_back(make_pair(arc, upward));
+        while (!stack.empty()) {
+            int current = stack.back().first;
+            bool up = stack.back().second;
+            stack.pop_back();
+            int via = up ? upVia[current] : downVia[current];
+            if (via == -1) {
+                path.push_back(order[up ? upHead[current] : arcTail[current]]);
+                continue;
+            }
+            int x = arcTail[current];
+            int y = upHead[current];
+            int zx = findUpArc(via, x);
+            int zy = findUpArc(via, y);
+            // Up: x -> z (down along z-x) then z -> y (up along z-y); down is the mirror
+            if (up) {
+                stack.push_back(make_pair(zy, true));
+                stack.push_back(make_pair(zx, false));
+            }
+            else {
+                stack.push_back(make_pair(zx, true));
+                stack.push_back(make_pair(zy, false));
+            }
+        }
+    }
+};
+
+// Algorithm used for point-to-point route queries
+enum RoutingAlgorithm {
+    ROUTE_DIJKSTRA,          // Plain Dijkstra on the road network
+    ROUTE_CONTRACTION,       // Customizable Contraction Hierarchy
+    ROUTE_ASTAR,             // A* guided by a RouteHeuristic
+    ROUTE_BIDIRECTIONAL_ASTAR // A* from both ends with averaged potentials
+};
+
+// Full search towards 'target' over the reversed roads: afterwards ws.dist[v] is the
+// length of the shortest open route from v to target. Every road must have its opposite
+// arc in the network (as addRoadById guarantees); the opposite's weight is what counts.
+void runReverseDijkstra(const RoadNetwork& roads, int target, SearchWorkspace& ws) {
+    ws.prepare(roads.nodeCount());
+    ws.reach(target, 0, -1);
+    ws.daryHeap.pushOrDecrease(target, 0);
+    while (!ws.daryHeap.empty()) {
+        int u = ws.daryHeap.pop();
+        ws.settled[u] = 1;
+        ws.settledCount++;
+        int du = ws.dist[u];
+        for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+            int v = roads.targets[arc];
+            if (ws.settled[v]) continue;
+            int inbound = roads.findArc(v, u);
+            if (inbound == -1 || roads.closed[inbound]) continue;
+            int candidate = du + roads.weights[inbound];
+            if (candidate < ws.dist[v]) {
+                ws.reach(v, candidate, u);
+                ws.daryHeap.pushOrDecrease(v, candidate);
+            }
+        }
+    }
+}
+
+// Lower bounds on the travel time between two intersections, used to point A* at its
+// goal. When every intersection has coordinates the bound is the straight-line distance
+// times the smallest time per unit of distance on any road. Otherwise it comes from
+// landmarks (ALT): exact distances to and from a few far-apart intersections give a
+// bound through the triangle inequality. Both kinds stay valid when a road gets slower
+// or closes; a faster or reopened road, or a new road, needs a rebuild.
+class RouteHeuristic {
+public:
+    enum Kind {
+        NO_BOUND,    // Not built; every bound is 0
+        COORDINATES, // Straight-line distance / fastest speed
+        LANDMARKS    // ALT landmarks
+    };
+
+    static const int DEFAULT_LANDMARKS = 8;
+
+    RouteHeuristic() : kind(NO_BOUND), secondsPerUnit(0), landmarkCount(0) {}
+
+    Kind getKind() const { return kind; }
+    int getLandmarkCount() const { return landmarkCount; }
+
+    // Use straight-line distances. Returns false (and leaves the heuristic unchanged) if
+    // an intersection has no coordinates or a road of zero weight makes every bound zero.
+    bool buildFromCoordinates(const RoadNetwork& roads, const Column<Intersection>& intersections) {
+        int nodes = roads.nodeCount();
+        double fastest = -1; // Smallest weight per unit of distance over all roads
+        for (int u = 0; u < nodes; ++u) {
+            if (!intersections[u].hasCoordinates) {
+                return false;
+            }
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                double length = straightLine(intersections[u], intersections[roads.targets[arc]]);
+                if (length == 0) {
+                    continue;
+                }
+                double perUnit = roads.weights[arc] / length;
+                if (fastest < 0 || perUnit < fastest) {
+                    fastest = perUnit;
+                }
+            }
+        }
+        if (fastest <= 0) {
+            return false;
+        }
+
+        kind = COORDINATES;
+        secondsPerUnit = fastest * (1 - 1e-9); // Keep rounding error on the safe side
+        x.resize(nodes);
+        y.resize(nodes);
+        for (int u = 0; u < nodes; ++u) {
+            x[u] = intersections[u].x;
+            y[u] = intersections[u].y;
+        }
+        landmarkCount = 0;
+        fromLandmark.clear();
+        toLandmark.clear();
+        return true;
+    }
+
+    // Pick up to 'count' landmarks by farthest-point selection over open roads and store
+    // the distances from and to each of them. Roads must come in both directions (as
+    // addRoadById makes them), so the reverse searches can walk the rows backwards.
+    void buildLandmarks(const RoadNetwork& roads, int count, WorkerPool& workers) {
+        int nodes = roads.nodeCount();
+        kind = LANDMARKS;
+        x.clear();
+        y.clear();
+        landmarkCount = min(count, nodes);
+        fromLandmark.assign((size_t)nodes * landmarkCount, INF);
+        toLandmark.assign((size_t)nodes * landmarkCount, INF);
+        if (landmarkCount == 0) {
+            return;
+        }
+
+        // Each landmark is the intersection farthest from all landmarks chosen so far,
+        // starting from the one farthest from intersection 0
+        vector<int> landmarks;
+        vector<int> nearest(nodes, INF);
+        SearchWorkspace ws;
+        runDijkstra(roads, 0, -1, DARY_HEAP, ws);
+        int next = farthest(ws.dist, 0);
+        for (int l = 0; l < landmarkCount; ++l) {
+            landmarks.push_back(next);
+            runDijkstra(roads, next, -1, DARY_HEAP, ws);
+            for (int v = 0; v < nodes; ++v) {
+                fromLandmark[(size_t)v * landmarkCount + l] = ws.dist[v];
+                nearest[v] = min(nearest[v], ws.dist[v]);
+            }
+            next = farthest(nearest, next);
+        }
+
+        // Distances to the landmarks are independent searches on the reversed roads
+        vector<SearchWorkspace> spaces(workers.size());
+        workers.parallelFor(landmarkCount, [&](int worker, int l) {
+            SearchWorkspace& reverseWs = spaces[worker];
+            runReverseDijkstra(roads, landmarks[l], reverseWs);
+            for (int v = 0; v < nodes; ++v) {
+                toLandmark[(size_t)v * landmarkCount + l] = reverseWs.dist[v];
+            }
+        });
+    }
+
+    // Lower bound on the travel time from a to b
+    int lowerBound(int a, int b) const {
+        if (kind == COORDINATES) {
+            double dx = x[a] - x[b];
+            double dy = y[a] - y[b];
+            double bound = sqrt(dx * dx + dy * dy) * secondsPerUnit;
+            return bound < INF ? (int)bound : INF;
+        }
+        if (kind == LANDMARKS) {
+            const int* fromA = fromLandmark.data() + (size_t)a * landmarkCount;
+            const int* fromB = fromLandmark.data() + (size_t)b * landmarkCount;
+            const int* toA = toLandmark.data() + (size_t)a * landmarkCount;
+            const int* toB = toLandmark.data() + (size_t)b * landmarkCount;
+            int best = 0;
+            for (int l = 0; l < landmarkCount; ++l) {
+                // d(a, b) >= d(L, b) - d(L, a) and d(a, b) >= d(a, L) - d(b, L)
+                if (fromA[l] != INF && fromB[l] != INF && fromB[l] - fromA[l] > best) {
+                    best = fromB[l] - fromA[l];
+                }
+                if (toA[l] != INF && toB[l] != INF && toA[l] - toB[l] > best) {
+                    best = toA[l] - toB[l];
+                }
+            }
+            return best;
+        }
+        return 0;
+    }
+
+private:
+    Kind kind;
+    double secondsPerUnit;     // Lowest weight per unit of straight-line distance
+    vector<float> x, y;        // Coordinates copied from the intersections
+    int landmarkCount;
+    vector<int> fromLandmark;  // d(landmark, v) at [v * landmarkCount + l]
+    vector<int> toLandmark;    // d(v, landmark) at [v * landmarkCount + l]
+
+    static double straightLine(const Intersection& a, const Intersection& b) {
+        double dx = (double)a.x - b.x;
+        double dy = (double)a.y - b.y;
+        return sqrt(dx * dx + dy * dy);
+    }
+
+    // Reachable node with the largest entry in 'dist', or 'fallback' if none is reachable
+    static int farthest(const vector<int>& dist, int fallback) {
+        int best = fallback;
+        for (int v = 0; v < (int)dist.size(); ++v) {
+            if (dist[v] != INF && (dist[best] == INF || dist[v] > dist[best])) {
+                best = v;
+            }
+        }
+        return best;
+    }
+};
+
+// A* from source to target: Dijkstra ordered by distance plus a lower bound on the rest
+// of the route. The bounds are consistent, so every node is still settled at most once.
+// Returns the distance (INF if unreachable); ws.prev holds the route back from target.
+int runAStar(const RoadNetwork& roads, int source, int target, const RouteHeuristic& heuristic, SearchWorkspace& ws) {
+    ws.prepare(roads.nodeCount());
+    ws.reach(source, 0, -1);
+    ws.daryHeap.pushOrDecrease(source, heuristic.lowerBound(source, target));
+
+    const int* targets = roads.targets.data();
+    const int* weights = roads.weights.data();
+    const unsigned char* closed = roads.closed.data();
+    while (!ws.daryHeap.empty()) {
+        int u = ws.daryHeap.pop();
+        ws.settled[u] = 1;
+        ws.settledCount++;
+        if (u == target) break;
+        METRICS_ONLY(ws.scannedRoads += roads.degree(u));
+
+        int du = ws.dist[u];
+        int end = roads.rowEnd(u);
+        for (int arc = roads.rowBegin(u); arc < end; ++arc) {
+            int v = targets[arc];
+            if (closed[arc] || ws.settled[v]) continue;
+            int candidate = du + weights[arc];
+            if (candidate < ws.dist[v]) {
+                ws.reach(v, candidate, u);
+                ws.daryHeap.pushOrDecrease(v, candidate + heuristic.lowerBound(v, target));
+            }
+        }
+    }
+    return ws.dist[target];
+}
+
+// Bidirectional A* with the average potential p(v) = (h(v, target) - h(source, v)) / 2,
+// which gives both directions the same reduced road weights. Keys are kept doubled so
+// the halving never rounds. The search stops once the two smallest keys add up to twice
+// the best route seen. Returns the distance and sets 'meeting' to a node on the route
+// (-1 if unreachable): forward.prev leads back to source, backward.prev on to target.
+int runBidirectionalAStar(const RoadNetwork& roads, int source, int target, const RouteHeuristic& heuristic,
+    SearchWorkspace& forward, SearchWorkspace& backward, int& meeting) {
+    forward.prepare(roads.nodeCount());
+    backward.prepare(roads.nodeCount());
+    meeting = -1;
+    if (source == target) {
+        forward.reach(source, 0, -1);
+        meeting = source;
+        return 0;
+    }
+
+    // Twice the forward potential of v; the backward potential is its negation
+    auto potential = [&](int v) { return heuristic.lowerBound(v, target) - heuristic.lowerBound(source, v); };
+    forward.reach(source, 0, -1);
+    forward.daryHeap.pushOrDecrease(source, potential(source));
+    backward.reach(target, 0, -1);
+    backward.daryHeap.pushOrDecrease(target, -potential(target));
+
+    long long best = INF;
+    while (!forward.daryHeap.empty() && !backward.daryHeap.empty()) {
+        if ((long long)forward.daryHeap.topKey() + backward.daryHeap.topKey() >= 2 * best) {
+            break;
+        }
+
+        bool forwardStep = forward.daryHeap.topKey() <= backward.daryHeap.topKey();
+        SearchWorkspace& ws = forwardStep ? forward : backward;
+        SearchWorkspace& other = forwardStep ? backward : forward;
+        int u = ws.daryHeap.pop();
+        ws.settled[u] = 1;
+        ws.settledCount++;
+        METRICS_ONLY(ws.scannedRoads += roads.degree(u));
+
+        int du = ws.dist[u];
+        for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+            int v = roads.targets[arc];
+            int road = forwardStep ? arc : roads.findArc(v, u); // The backward side walks roads v -> u
+            if (road == -1 || roads.closed[road] || ws.settled[v]) continue;
+            int candidate = du + roads.weights[road];
+            if (candidate >= ws.dist[v]) continue;
+            ws.reach(v, candidate, u);
+            int key = 2 * candidate + (forwardStep ? potential(v) : -potential(v));
+            ws.daryHeap.pushOrDecrease(v, key);
+            if (other.dist[v] != INF && (long long)candidate + other.dist[v] < best) {
+                best = (long long)candidate + other.dist[v];
+                meeting = v;
+            }
+        }
+    }
+    return meeting == -1 ? INF : (int)best;
+}
+
+// Earliest arrival at 'target' when leaving 'source' at 'departure' (seconds after
+// midnight of the first day). Roads take roadTravelTime at the moment they are entered,
+// and waitAt(from, at, time) is the signal delay for a vehicle reaching 'at' from 'from'
+// at 'time' (never charged at the source). Both are FIFO, so the search stays label
+// setting. The wait depends on the approach, so labels belong to roads instead of
+// intersections: ws.dist[arc] is the arrival time at the end of 'arc' and ws.prev[arc] the
+// road taken before it (-1 for roads leaving the source). Bounds that hold at every hour
+// of the day make this A*; a NO_BOUND heuristic gives plain Dijkstra. Returns the arrival
+// time (INF if unreachable) and sets lastArc to the road that reaches the target (-1 if
+// there is none or source == target).
+template <typename SignalWait>
+int runTimeDependentSearch(const RoadNetwork& roads, const TravelTimeProfiles& profiles, int source, int target,
+    int departure, const RouteHeuristic& bounds, SignalWait waitAt, SearchWorkspace& ws, int& lastArc) {
+    ws.prepare((int)roads.targets.size());
+    lastArc = -1;
+    if (source == target) {
+        return departure;
+    }
+
+    // Queue the roads leaving 'at' for a vehicle that can move on at 'time'
+    auto enterRoads = [&](int at, int time, int previous) {
+        METRICS_ONLY(ws.scannedRoads += roads.degree(at));
+        for (int arc = roads.rowBegin(at); arc < roads.rowEnd(at); ++arc) {
+            if (roads.closed[arc] || ws.settled[arc]) continue;
+            int bound = bounds.lowerBound(roads.targets[arc], target);
+            if (bound >= INF) continue; // The target cannot be reached from there
+            int arrival = time + roadTravelTime(roads, profiles, arc, time);
+            if (arrival < ws.dist[arc]) {
+                ws.reach(arc, arrival, previous);
+                ws.daryHeap.pushOrDecrease(arc, arrival + bound);
+            }
+        }
+    };
+
+    enterRoads(source, departure, -1);
+    while (!ws.daryHeap.empty()) {
+        int arc = ws.daryHeap.pop();
+        ws.settled[arc] = 1;
+        ws.settledCount++;
+        int at = roads.targets[arc];
+        if (at == target) {
+            lastArc = arc;
+            return ws.dist[arc];
+        }
+        int from = ws.prev[arc] == -1 ? source : roads.targets[ws.prev[arc]];
+        int time = ws.dist[arc];
+        enterRoads(at, time + waitAt(from, at, time), arc);
+    }
+    return INF;
+}
+
+// Alternative routes towards one target at a time, by the penalty method: after each
+// route is found the roads on it (and their opposite directions) get slower in a private
+// copy of the weights and the search runs again, so the next route avoids them where
+// the detour is cheap. A new route is kept if its real cost is within maxStretch of the
+// shortest and no kept route covers more than MAX_SHARED of its cost; otherwise the
+// penalties keep piling up until k routes are kept or MAX_SEARCHES searches ran.
+// A reverse shortest-path tree grown once from the target serves every search of every
+// start routed to it: the shortest route is read straight off it, and penalties only add
+// weight, so its distances stay lower bounds for the A* searches that follow (the tree
+// stops growing once the starts are settled; beyond it its radius is the bound).
+// Roads must come in both directions, as addRoadById makes them.
+class AlternativeRoutes {
+public:
+    static constexpr double MAX_SHARED = 0.7;   // Largest cost fraction a route may share with a kept one
+    static constexpr double PENALTY = 0.4;      // Weight added per penalty, relative to the road's weight
+    static const int MAX_SEARCHES = 8;          // Penalized searches per start
+
+    AlternativeRoutes() : target(-1), radius(0), stretch(1) {}
+
+    // Grow the reverse tree from 'newTarget' until starts[0..count) are all settled; the
+    // routes found for them afterwards stay within maxStretch times their shortest
+    void prepareTarget(const RoadNetwork& roads, int newTarget, const int* starts, int count, double maxStretch) {
+        target = newTarget;
+        stretch = maxStretch;
+        SearchWorkspace& ws = toTarget;
+        ws.prepare(roads.nodeCount());
+        ws.targetMark.resize(roads.nodeCount(), 0);
+        int remaining = 0;
+        for (int i = 0; i < count; ++i) {
+            if (!ws.targetMark[starts[i]]) {
+                ws.targetMark[starts[i]] = 1;
+                remaining++;
+            }
+        }
+
+        long long limit = INF;
+        radius = INF; // Stays INF if the whole reachable part is settled
+        ws.reach(target, 0, -1);
+        ws.daryHeap.pushOrDecrease(target, 0);
+        while (!ws.daryHeap.empty()) {
+            if (ws.daryHeap.topKey() > limit) {
+                radius = ws.daryHeap.topKey(); // No unsettled intersection is closer than this
+                break;
+            }
+            int u = ws.daryHeap.pop();
+            ws.settled[u] = 1;
+            ws.settledCount++;
+            int du = ws.dist[u];
+            if (ws.targetMark[u] && --remaining == 0) {
+                limit = du;
+            }
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int v = roads.targets[arc];
+                if (ws.settled[v]) continue;
+                int inbound = roads.findArc(v, u);
+                if (inbound == -1 || roads.closed[inbound]) continue;
+                int candidate = du + roads.weights[inbound];
+                if (candidate < ws.dist[v]) {
+                    ws.reach(v, candidate, u);
+                    ws.daryHeap.pushOrDecrease(v, candidate);
+                }
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            ws.targetMark[starts[i]] = 0;
+        }
+        penalty.resize(roads.targets.size(), 0); // find leaves every entry cleared
+        onRoute.resize(roads.targets.size(), 0);
+    }
+
+    // Up to k routes from 'start' to the prepared target, cheapest first. Their paths are
+    // appended to 'paths' and described in 'routes' (replacing its contents); returns how
+    // many were found.
+    int find(const RoadNetwork& roads, int start, int k, vector<RouteResult>& routes, vector<int>& paths) {
+        routes.clear();
+        if (k <= 0 || toTarget.dist[start] == INF || (radius != INF && !toTarget.settled[start])) {
+            return 0;
+        }
+
+        // The shortest route is the tree route
+        RouteResult shortest = { toTarget.dist[start], (int)paths.size(), 0 };
+        for (int node = start; node != -1; node = toTarget.prev[node]) {
+            paths.push_back(node);
+        }
+        shortest.pathLength = (int)paths.size() - shortest.pathOffset;
+        routes.push_back(shortest);
+        long long costLimit = (long long)(shortest.distance * stretch);
+
+        candidate.assign(paths.begin() + shortest.pathOffset, paths.end());
+        for (int search = 0; search < MAX_SEARCHES && (int)routes.size() < k; ++search) {
+            penalize(roads, candidate);
+            int cost = penalizedRoute(roads, start);
+            if (cost == INF) {
+                break;
+            }
+            if (cost <= costLimit && !overlapsKept(roads, routes, paths, cost)) {
+                RouteResult route = { cost, (int)paths.size(), (int)candidate.size() };
+                paths.insert(paths.end(), candidate.begin(), candidate.end());
+                routes.push_back(route);
+            }
+        }
+
+        // Keep the routes in order of cost and leave the scratch arrays clean
+        sort(routes.begin(), routes.end(), [](const RouteResult& a, const RouteResult& b) {
+            return a.distance < b.distance;
+        });
+        for (size_t i = 0; i < penalizedArcs.size(); ++i) {
+            penalty[penalizedArcs[i]] = 0;
+        }
+        penalizedArcs.clear();
+        return (int)routes.size();
+    }
+
+private:
+    int target;
+    int radius;                // Distance up to which the tree is complete (INF if it is complete everywhere)
+    double stretch;
+    SearchWorkspace toTarget;  // dist = distance to the target, prev = next intersection towards it
+    SearchWorkspace searchSpace;
+    vector<int> penalty;       // Weight added to each road slot by the penalties so far
+    vector<int> penalizedArcs; // Slots with a penalty, to reset them
+    vector<unsigned char> onRoute; // Marks the roads of one kept route while overlaps are measured
+    vector<int> candidate;     // Route found by the last search, start first
+
+    // Lower bound on the distance from v to the target: exact inside the tree, the
+    // tree's radius outside it
+    int bound(int v) const {
+        return toTarget.settled[v] ? toTarget.dist[v] : radius;
+    }
+
+    // Make the roads of a route, in both directions, slower for the following searches
+    void penalize(const RoadNetwork& roads, const vector<int>& route) {
+        for (size_t i = 0; i + 1 < route.size(); ++i) {
+            int arcs[2] = { roads.findArc(route[i], route[i + 1]), roads.findArc(route[i + 1], route[i]) };
+            for (int j = 0; j < 2; ++j) {
+                if (arcs[j] == -1) continue;
+                if (penalty[arcs[j]] == 0) {
+                    penalizedArcs.push_back(arcs[j]);
+                }
+                penalty[arcs[j]] += max(1, (int)(roads.weights[arcs[j]] * PENALTY));
+            }
+        }
+    }
+
+    // A* with penalized weights from 'start'; stores the route in 'candidate' and returns
+    // its real (unpenalized) cost
+    int penalizedRoute(const RoadNetwork& roads, int start) {
+        SearchWorkspace& ws = searchSpace;
+        ws.prepare(roads.nodeCount());
+        ws.reach(start, 0, -1);
+        ws.daryHeap.pushOrDecrease(start, bound(start));
+        while (!ws.daryHeap.empty()) {
+            int u = ws.daryHeap.pop();
+            ws.settled[u] = 1;
+            ws.settledCount++;
+            if (u == target) {
+                break;
+            }
+            int du = ws.dist[u];
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int v = roads.targets[arc];
+                if (roads.closed[arc] || ws.settled[v]) continue;
+                int h = bound(v);
+                if (h == INF) continue;
+                int distance = du + roads.weights[arc] + penalty[arc];
+                if (distance < ws.dist[v]) {
+                    ws.reach(v, distance, u);
+                    ws.daryHeap.pushOrDecrease(v, distance + h);
+                }
+            }
+        }
+        if (!ws.settled[target]) {
+            return INF;
+        }
+        candidate.clear();
+        for (int node = target; node != -1; node = ws.prev[node]) {
+            candidate.push_back(node);
+        }
+        reverse(candidate.begin(), candidate.end());
+        int cost = 0;
+        for (size_t i = 0; i + 1 < candidate.size(); ++i) {
+            cost += roads.weights[roads.findArc(candidate[i], candidate[i + 1])];
+        }
+        return cost;
+    }
+
+    // True if a kept route covers more than MAX_SHARED of the candidate's cost
+    bool overlapsKept(const RoadNetwork& roads, const vector<RouteResult>& routes, const vector<int>& paths, int cost) {
+        for (size_t r = 0; r < routes.size(); ++r) {
+            const int* path = paths.data() + routes[r].pathOffset;
+            for (int i = 0; i + 1 < routes[r].pathLength; ++i) {
+                onRoute[roads.findArc(path[i], path[i + 1])] = 1;
+            }
+            long long shared = 0;
+            for (size_t i = 0; i + 1 < candidate.size(); ++i) {
+                int arc = roads.findArc(candidate[i], candidate[i + 1]);
+                if (onRoute[arc]) {
+                    shared += roads.weights[arc];
+                }
+            }
+            for (int i = 0; i + 1 < routes[r].pathLength; ++i) {
+                onRoute[roads.findArc(path[i], path[i + 1])] = 0;
+            }
+            if (shared > MAX_SHARED * cost) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Static traffic assignment to user equilibrium: the state in which no trip could get
+// to its destination faster by switching routes, given the congestion all trips cause
+// together. A road's travel time follows the BPR volume-delay function
+// t0 * (1 + 0.15 * (v / c)^4) of its free-flow time t0 (the base weight), its flow v and
+// its capacity c. Frank-Wolfe: every iteration sends each trip down its shortest route
+// under the current travel times (an all-or-nothing assignment) and moves the flows
+// towards it - blended with the previous targets, see chooseTarget - by the step that
+// most lowers the Beckmann objective, found by bisection on its derivative. It stops
+// once the relative gap - the share of the total travel time the trips would save if
+// all of them took their current shortest routes - is below the target. Each iteration grows one shortest-path tree per origin, in parallel on the
+// worker pool, and every worker adds its trips into a flow array of its own.
+class TrafficAssignment {
+public:
+    static constexpr double BPR_ALPHA = 0.15;
+    static const int COST_SCALE = 100;     // Searches run in hundredths of a second
+    static const int MAX_COST = 1000000;   // Largest search cost of one road, so route costs stay below INF
+    static const int LINE_SEARCH_STEPS = 24;
+    static constexpr double CONJUGATE_MARGIN = 0.01; // Keeps some of each new shortest-route assignment
+
+    TrafficAssignment() : lastStep(1), gapReached(1), unroutableTrips(0), travelTimeTotal(0) {}
+
+    // Group the trips by origin and destination; trips that end where they start, or at
+    // an invalid intersection, need no road and are left out
+    void setDemand(int nodeCount, const vector<RouteQuery>& trips) {
+        vector<pair<int, int> > sorted;
+        sorted.reserve(trips.size());
+        for (size_t i = 0; i < trips.size(); ++i) {
+            const RouteQuery& trip = trips[i];
+            if (trip.start >= 0 && trip.start < nodeCount && trip.end >= 0 && trip.end < nodeCount
+                && trip.start != trip.end) {
+                sorted.push_back(make_pair(trip.start, trip.end));
+            }
+        }
+        sort(sorted.begin(), sorted.end());
+        origins.clear();
+        destinationBegin.clear();
+        destinations.clear();
+        demand.clear();
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            if (i == 0 || sorted[i].first != sorted[i - 1].first) {
+                origins.push_back(sorted[i].first);
+                destinationBegin.push_back((int)destinations.size());
+            }
+            if (i > 0 && sorted[i] == sorted[i - 1]) {
+                demand.back() += 1;
+                continue;
+            }
+            destinations.push_back(sorted[i].second);
+            demand.push_back(1);
+        }
+        destinationBegin.push_back((int)destinations.size());
+    }
+
+    // Assign the demand to the open roads, with 'vehiclesPerSecond' vehicles of capacity
+    // per second of free-flow time on every road. Returns the number of Frank-Wolfe
+    // steps taken (at most maxSteps); the relative gap is measured after the last.
+    int solve(const RoadNetwork& roads, double vehiclesPerSecond, WorkerPool& workers, int maxSteps, double targetGap) {
+        int slots = (int)roads.targets.size();
+        freeFlow.resize(slots);
+        capacity.resize(slots);
+        for (int arc = 0; arc < slots; ++arc) {
+            freeFlow[arc] = roads.baseWeights[arc];
+            capacity[arc] = max(1, roads.baseWeights[arc]) * vehiclesPerSecond;
+        }
+        flow.assign(slots, 0);
+        target.assign(slots, 0);
+        shortestRoutes.assign(slots, 0);
+        olderTarget.assign(slots, 0);
+        lastStep = 1;
+        times.resize(slots);
+        costs.resize(slots);
+        if ((int)spaces.size() < workers.size()) {
+            spaces.resize(workers.size());
+        }
+        for (int worker = 0; worker < workers.size(); ++worker) {
+            spaces[worker].prepare(roads.nodeCount(), slots);
+        }
+
+        // Free-flow times for the first assignment
+        for (int arc = 0; arc < slots; ++arc) {
+            times[arc] = freeFlow[arc];
+        }
+        allOrNothing(roads, workers, flow);
+        unroutableTrips = 0;
+        for (int worker = 0; worker < workers.size(); ++worker) {
+            unroutableTrips += spaces[worker].unroutable;
+        }
+
+        int steps = 0;
+        while (true) {
+            double current = 0;
+            for (int arc = 0; arc < slots; ++arc) {
+                times[arc] = travelTime(arc, flow[arc]);
+                current += flow[arc] * times[arc];
+            }
+            travelTimeTotal = current;
+            allOrNothing(roads, workers, shortestRoutes);
+            double shortest = 0;
+            for (int arc = 0; arc < slots; ++arc) {
+                shortest += shortestRoutes[arc] * times[arc];
+            }
+            gapReached = current > 0 ? max(0.0, (current - shortest) / current) : 0;
+            if (gapReached <= targetGap || steps >= maxSteps) {
+                break;
+            }
+            chooseTarget(slots, steps);
+            lastStep = lineSearch(slots);
+            for (int arc = 0; arc < slots; ++arc) {
+                flow[arc] += lastStep * (target[arc] - flow[arc]);
+            }
+            steps++;
+        }
+        return steps;
+    }
+
+    double relativeGap() const { return gapReached; }
+    double unroutable() const { return unroutableTrips; }  // Trips whose destination cannot be reached
+    double totalTravelTime() const { return travelTimeTotal; } // Vehicle-seconds spent on the roads
+
+    // Vehicles on a road slot, and its travel time with them, after solve
+    double roadFlow(int arc) const { return flow[arc]; }
+    double roadTime(int arc) const { return times[arc]; }
+
+private:
+    // Per-worker scratch for the shortest-path trees
+    struct Workspace {
+        vector<int> dist;
+        vector<int> prev;                 // Tree parent of each node
+        vector<int> via;                  // Road slot from the parent
+        vector<unsigned char> settled;
+        vector<unsigned char> targetMark; // Destinations of the origin being grown
+        vector<int> touched;              // Nodes reached, to reset them
+        vector<int> order;                // Nodes in the order they were settled
+        vector<double> load;              // Trips passing through each node
+        vector<double> flow;              // This worker's share of the assignment
+        RadixHeap heap;                   // Costs are whole numbers, so a radix heap fits
+        double unroutable;
+
+        void prepare(int nodeCount, int slots) {
+            dist.assign(nodeCount, INF);
+            prev.assign(nodeCount, -1);
+            via.assign(nodeCount, -1);
+            settled.assign(nodeCount, 0);
+            targetMark.assign(nodeCount, 0);
+            load.assign(nodeCount, 0);
+            flow.assign(slots, 0);
+            heap.clear();
+            touched.clear();
+            order.clear();
+        }
+    };
+
+    vector<int> origins;          // Distinct origins
+    vector<int> destinationBegin; // Destinations of origins[i]: destinationBegin[i] up to destinationBegin[i + 1]
+    vector<int> destinations;
+    vector<double> demand;        // Trips to each destination
+    vector<double> freeFlow, capacity;
+    vector<double> flow;          // Current assignment per road slot
+    vector<double> shortestRoutes; // All-or-nothing assignment of the iteration
+    vector<double> target;        // Assignment the step moves towards
+    vector<double> olderTarget;   // The one of the step before
+    double lastStep;              // Length of the last step, 1 reaching the target
+    vector<double> times;         // Travel times at the current flows
+    vector<int> costs;            // The same, as search costs
+    vector<Workspace> spaces;
+    double gapReached;
+    double unroutableTrips;
+    double travelTimeTotal;
+
+    double travelTime(int arc, double vehicles) const {
+        double ratio = vehicles / capacity[arc];
+        ratio *= ratio;
+        return freeFlow[arc] * (1 + BPR_ALPHA * ratio * ratio);
+    }
+
+    // Travel time gained per extra vehicle
+    double travelTimeSlope(int arc, double vehicles) const {
+        double ratio = vehicles / capacity[arc];
+        return freeFlow[arc] * BPR_ALPHA * 4 * ratio * ratio * ratio / capacity[arc];
+    }
+
+    // Pick the point the next step heads for. Plain Frank-Wolfe heads straight for the
+    // all-or-nothing assignment and zigzags ever more slowly near the equilibrium. The
+    // bi-conjugate variant (Mitradjieva and Lindberg) mixes in the two previous targets so
+    // that the new direction is conjugate to the last two under the Hessian of the
+    // objective, which is diagonal: each road's travel time slope. It falls back to the
+    // conjugate variant (one previous target) when there is no usable history, and to
+    // plain Frank-Wolfe on the first step.
+    void chooseTarget(int slots, int steps) {
+        double shortestWeight = 1, lastWeight = 0, olderWeight = 0;
+        bool biconjugate = false;
+        if (steps >= 2 && lastStep < 1) {
+            double muNumerator = 0, muDenominator = 0, nuNumerator = 0, nuDenominator = 0;
+            for (int arc = 0; arc < slots; ++arc) {
+                double slope = travelTimeSlope(arc, flow[arc]);
+                double towardsShortest = shortestRoutes[arc] - flow[arc];
+                double towardsLast = target[arc] - flow[arc];
+                double towardsBoth = lastStep * target[arc] + (1 - lastStep) * olderTarget[arc] - flow[arc];
+                muNumerator -= towardsBoth * slope * towardsShortest;
+                muDenominator += towardsBoth * slope * (olderTarget[arc] - target[arc]);
+                nuNumerator -= towardsLast * slope * towardsShortest;
+                nuDenominator += towardsLast * slope * towardsLast;
+            }
+            if (muDenominator != 0 && nuDenominator != 0) {
+                double mu = max(0.0, muNumerator / muDenominator);
+                double nu = max(0.0, nuNumerator / nuDenominator + mu * lastStep / (1 - lastStep));
+                shortestWeight = 1 / (1 + mu + nu);
+                lastWeight = nu * shortestWeight;
+                olderWeight = mu * shortestWeight;
+                biconjugate = true;
+            }
+        }
+        if (!biconjugate && steps >= 1) {
+            double numerator = 0, denominator = 0;
+            for (int arc = 0; arc < slots; ++arc) {
+                double towardsLast = (target[arc] - flow[arc]) * travelTimeSlope(arc, flow[arc]);
+                numerator += towardsLast * (shortestRoutes[arc] - flow[arc]);
+                denominator += towardsLast * (shortestRoutes[arc] - target[arc]);
+            }
+            if (denominator != 0) {
+                lastWeight = min(max(numerator / denominator, 0.0), 1 - CONJUGATE_MARGIN);
+                shortestWeight = 1 - lastWeight;
+            }
+        }
+        for (int arc = 0; arc < slots; ++arc) {
+            double next = shortestWeight * shortestRoutes[arc] + lastWeight * target[arc] + olderWeight * olderTarget[arc];
+            olderTarget[arc] = target[arc];
+            target[arc] = next;
+        }
+    }
+
+    // Send every trip down its shortest route under 'times'; the flows go to 'result'
+    void allOrNothing(const RoadNetwork& roads, WorkerPool& workers, vector<double>& result) {
+        int slots = (int)costs.size();
+        for (int arc = 0; arc < slots; ++arc) {
+            costs[arc] = (int)min((double)MAX_COST, floor(times[arc] * COST_SCALE + 0.5));
+        }
+        for (int worker = 0; worker < workers.size(); ++worker) {
+            fill(spaces[worker].flow.begin(), spaces[worker].flow.end(), 0.0);
+            spaces[worker].unroutable = 0;
+        }
+        workers.parallelFor((int)origins.size(), [&](int worker, int origin) {
+            loadOrigin(roads, origin, spaces[worker]);
+        });
+        for (int arc = 0; arc < slots; ++arc) {
+            double total = 0;
+            for (int worker = 0; worker < workers.size(); ++worker) {
+                total += spaces[worker].flow[arc];
+            }
+            result[arc] = total;
+        }
+    }
+
+    // Grow the tree of origins[index] until its destinations are settled, then walk it
+    // from the leaves up, passing on the trips bound for each node and the ones beyond it
+    void loadOrigin(const RoadNetwork& roads, int index, Workspace& ws) {
+        int source = origins[index];
+        int first = destinationBegin[index];
+        int last = destinationBegin[index + 1];
+        int remaining = last - first; // Destinations of one origin are distinct
+        for (int i = first; i < last; ++i) {
+            ws.targetMark[destinations[i]] = 1;
+        }
+        ws.dist[source] = 0;
+        ws.touched.push_back(source);
+        ws.heap.push(0, source);
+        while (!ws.heap.empty()) {
+            int key;
+            int u = ws.heap.pop(key);
+            if (ws.settled[u] || key > ws.dist[u]) continue; // Outdated entry
+            ws.settled[u] = 1;
+            ws.order.push_back(u);
+            if (ws.targetMark[u] && --remaining == 0) {
+                break;
+            }
+            int du = ws.dist[u];
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int v = roads.targets[arc];
+                if (roads.closed[arc] || ws.settled[v]) continue;
+                int candidate = du + costs[arc];
+                if (candidate < ws.dist[v]) {
+                    if (ws.dist[v] == INF) {
+                        ws.touched.push_back(v);
+                    }
+                    ws.dist[v] = candidate;
+                    ws.prev[v] = u;
+                    ws.via[v] = arc;
+                    ws.heap.push(candidate, v);
+                }
+            }
+        }
+
+        for (int i = first; i < last; ++i) {
+            int destination = destinations[i];
+            ws.targetMark[destination] = 0;
+            if (ws.settled[destination]) {
+                ws.load[destination] += demand[i];
+            }
+            else {
+                ws.unroutable += demand[i];
+            }
+        }
+        for (size_t i = ws.order.size() - 1; i > 0; --i) {
+            int node = ws.order[i];
+            if (ws.load[node] > 0) {
+                ws.flow[ws.via[node]] += ws.load[node];
+                ws.load[ws.prev[node]] += ws.load[node];
+                ws.load[node] = 0;
+            }
+        }
+        ws.load[source] = 0;
+        for (size_t i = 0; i < ws.touched.size(); ++i) {
+            int node = ws.touched[i];
+            ws.dist[node] = INF;
+            ws.prev[node] = -1;
+            ws.via[node] = -1;
+            ws.settled[node] = 0;
+        }
+        ws.touched.clear();
+        ws.order.clear();
+        ws.heap.clear();
+    }
+
+    // Step from 'flow' towards 'target' that minimizes the Beckmann objective: the root of
+    // its derivative, the sum over roads of (target - flow) times the travel time at the
+    // blended flow, which grows with the step
+    double lineSearch(int slots) const {
+        auto slope = [&](double step) {
+            double sum = 0;
+            for (int arc = 0; arc < slots; ++arc) {
+                double change = target[arc] - flow[arc];
+                if (change != 0) {
+                    sum += change * travelTime(arc, flow[arc] + step * change);
+                }
+            }
+            return sum;
+        };
+        if (slope(1) <= 0) {
+            return 1;
+        }
+        double low = 0, high = 1;
+        for (int i = 0; i < LINE_SEARCH_STEPS; ++i) {
+            double middle = (low + high) / 2;
+            if (slope(middle) <= 0) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return (low + high) / 2;
+    }
+};
+
+// Shortest-path trees kept up to date for a set of registered "active" sources (vehicle
+// origins, hospitals, ...). A weight or closure change repairs each tree in place, in
+// the style of Ramalingam and Reps: when a tree road gets slower the subtree below it is
+// cut off and re-attached from its unaffected neighbours, when a road gets faster the
+// improvement is pushed outwards; both finish with a Dijkstra limited to the nodes whose
+// distance actually changes. Topology changes (new intersections or roads) need rebuild().
+// Roads must come in both directions, as addRoadById makes them.
+class DynamicShortestPaths {
+public:
+    static const size_t MEMORY_LIMIT = (size_t)1 << 30; // Bytes of tree arrays allowed in total
+
+    DynamicShortestPaths() : nodes(0), repaired(0) {}
+
+    int sourceCount() const { return (int)trees.size(); }
+    int sourceAt(int slot) const { return trees[slot].source; }
+    size_t memoryUsage() const { return trees.size() * (size_t)nodes * 2 * sizeof(int); }
+    int lastRepairedCount() const { return repaired; } // Nodes whose distance the last update recomputed
+
+    // Tree slot of an intersection, or -1 if it is not an active source
+    int slotOf(int node) const {
+        return node >= 0 && node < (int)slotOfNode.size() ? slotOfNode[node] : -1;
+    }
+
+    // Register a source and grow its tree; returns false if it is already registered
+    // or the trees would exceed MEMORY_LIMIT
+    bool addSource(const RoadNetwork& roads, int source) {
+        if (slotOf(source) != -1) {
+            return false;
+        }
+        if (nodes != roads.nodeCount()) {
+            nodes = roads.nodeCount();
+            slotOfNode.resize(nodes, -1);
+        }
+        if ((trees.size() + 1) * (size_t)nodes * 2 * sizeof(int) > MEMORY_LIMIT) {
+            return false;
+        }
+        trees.push_back(Tree());
+        trees.back().source = source;
+        slotOfNode[source] = (int)trees.size() - 1;
+        if (scratch.empty()) {
+            scratch.resize(1);
+        }
+        grow(roads, trees.back(), scratch[0]);
+        return true;
+    }
+
+    bool removeSource(int source) {
+        int slot = slotOf(source);
+        if (slot == -1) {
+            return false;
+        }
+        slotOfNode[source] = -1;
+        if (slot != (int)trees.size() - 1) {
+            trees[slot].source = trees.back().source;
+            trees[slot].dist.swap(trees.back().dist);
+            trees[slot].parent.swap(trees.back().parent);
+            slotOfNode[trees[slot].source] = slot;
+        }
+        trees.pop_back();
+        return true;
+    }
+
+    void clear() {
+        trees.clear();
+        slotOfNode.clear();
+        pending.clear();
+        nodes = 0;
+    }
+
+    // Record that the road between from and to changed weight or closure (either direction)
+    void roadChanged(int fromIndex, int toIndex) {
+        if (!trees.empty()) {
+            pending.push_back(make_pair(fromIndex, toIndex));
+        }
+    }
+
+    // Regrow every tree from scratch, e.g. after intersections or roads were added
+    void rebuild(const RoadNetwork& roads, WorkerPool& workers) {
+        nodes = roads.nodeCount();
+        slotOfNode.resize(nodes, -1);
+        pending.clear();
+        prepareScratch(workers.size());
+        workers.parallelFor((int)trees.size(), [&](int worker, int slot) {
+            grow(roads, trees[slot], scratch[worker]);
+        });
+        repaired = (int)trees.size() * nodes;
+    }
+
+    // Repair every tree for the roads changed since the last update, in parallel over trees
+    void update(const RoadNetwork& roads, WorkerPool& workers) {
+        repaired = 0;
+        if (pending.empty() || trees.empty()) {
+            pending.clear();
+            return;
+        }
+        prepareScratch(workers.size());
+        atomic<int> total(0);
+        workers.parallelFor((int)trees.size(), [&](int worker, int slot) {
+            total += repair(roads, trees[slot], scratch[worker]);
+        });
+        repaired = total.load();
+        pending.clear();
+    }
+
+    int distance(int slot, int target) const { return trees[slot].dist[target]; }
+    const int* distances(int slot) const { return trees[slot].dist.data(); }
+    const int* parents(int slot) const { return trees[slot].parent.data(); }
+
+    // Intersections from the source of 'slot' to target, source first (empty if unreachable)
+    void path(int slot, int target, vector<int>& route) const {
+        route.clear();
+        if (trees[slot].dist[target] == INF) {
+            return;
+        }
+        for (int node = target; node != -1; node = trees[slot].parent[node]) {
+            route.push_back(node);
+        }
+        reverse(route.begin(), route.end());
+    }
+
+private:
+    struct Tree {
+        int source;
+        vector<int> dist;
+        vector<int> parent; // Previous intersection on the shortest route, -1 at the source
+    };
+    struct Scratch {
+        SearchWorkspace ws;
+        IndexedDaryHeap heap;
+        vector<unsigned char> affected;
+        vector<int> cut; // Nodes whose tree route used a road that got slower
+    };
+
+    int nodes;
+    vector<Tree> trees;
+    vector<int> slotOfNode;
+    vector<pair<int, int> > pending;
+    vector<Scratch> scratch; // One per worker
+    int repaired;
+
+    void prepareScratch(int workerCount) {
+        if ((int)scratch.size() < workerCount) {
+            scratch.resize(workerCount);
+        }
+        for (size_t i = 0; i < scratch.size(); ++i) {
+            if ((int)scratch[i].affected.size() != nodes) {
+                scratch[i].affected.assign(nodes, 0);
+                scratch[i].heap.resize(nodes);
+            }
+        }
+    }
+
+    static int weightOf(const RoadNetwork& roads, int fromIndex, int toIndex) {
+        int arc = roads.findArc(fromIndex, toIndex);
+        return arc == -1 || roads.closed[arc] ? INF : roads.weights[arc];
+    }
+
+    void grow(const RoadNetwork& roads, Tree& tree, Scratch& space) {
+        runDijkstra(roads, tree.source, -1, DARY_HEAP, space.ws);
+        tree.dist.assign(space.ws.dist.begin(), space.ws.dist.end());
+        tree.parent.assign(space.ws.prev.begin(), space.ws.prev.end());
+    }
+
+    // Fix one tree for the pending changes; returns the number of nodes whose distance changed
+    int repair(const RoadNetwork& roads, Tree& tree, Scratch& space) {
+        int* dist = tree.dist.data();
+        int* parent = tree.parent.data();
+        vector<int>& cut = space.cut;
+        vector<unsigned char>& affected = space.affected;
+        IndexedDaryHeap& heap = space.heap;
+        cut.clear();
+
+        // 1. Cut off the subtrees hanging from tree roads that got slower or closed
+        for (size_t i = 0; i < pending.size(); ++i) {
+            for (int direction = 0; direction < 2; ++direction) {
+                int u = direction == 0 ? pending[i].first : pending[i].second;
+                int v = direction == 0 ? pending[i].second : pending[i].first;
+                if (parent[v] != u || affected[v]) continue;
+                int weight = weightOf(roads, u, v);
+                if (weight != INF && dist[u] + weight <= dist[v]) continue;
+
+                size_t first = cut.size();
+                affected[v] = 1;
+                cut.push_back(v);
+                for (size_t k = first; k < cut.size(); ++k) {
+                    int x = cut[k];
+                    for (int arc = roads.rowBegin(x); arc < roads.rowEnd(x); ++arc) {
+                        int y = roads.targets[arc];
+                        if (!affected[y] && parent[y] == x) {
+                            affected[y] = 1;
+                            cut.push_back(y);
+                        }
+                    }
+                }
+            }
+        }
+
+        // 2. Re-attach every cut node to its best unaffected neighbour
+        for (size_t k = 0; k < cut.size(); ++k) {
+            dist[cut[k]] = INF;
+            parent[cut[k]] = -1;
+        }
+        for (size_t k = 0; k < cut.size(); ++k) {
+            int y = cut[k];
+            for (int arc = roads.rowBegin(y); arc < roads.rowEnd(y); ++arc) {
+                int z = roads.targets[arc];
+                if (affected[z] || dist[z] == INF) continue;
+                int weight = weightOf(roads, z, y);
+                if (weight != INF && dist[z] + weight < dist[y]) {
+                    dist[y] = dist[z] + weight;
+                    parent[y] = z;
+                }
+            }
+            if (dist[y] != INF) {
+                heap.pushOrDecrease(y, dist[y]);
+            }
+        }
+
+        // 3. Roads that got faster may offer shortcuts out of the unaffected part
+        for (size_t i = 0; i < pending.size(); ++i) {
+            for (int direction = 0; direction < 2; ++direction) {
+                int u = direction == 0 ? pending[i].first : pending[i].second;
+                int v = direction == 0 ? pending[i].second : pending[i].first;
+                if (affected[u] || dist[u] == INF) continue;
+                int weight = weightOf(roads, u, v);
+                if (weight != INF && dist[u] + weight < dist[v]) {
+                    if (!affected[v]) {
+                        affected[v] = 1; // From here on only used to count and reset
+                        cut.push_back(v);
+                    }
+                    dist[v] = dist[u] + weight;
+                    parent[v] = u;
+                    heap.pushOrDecrease(v, dist[v]);
+                }
+            }
+        }
+
+        // 4. Dijkstra over the nodes whose distance changes; every other label is already
+        // the length of a real route, so each popped node is final
+        while (!heap.empty()) {
+            int u = heap.pop();
+            int du = dist[u];
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (roads.closed[arc]) continue;
+                int v = roads.targets[arc];
+                int candidate = du + roads.weights[arc];
+                if (candidate < dist[v]) {
+                    if (!affected[v]) {
+                        affected[v] = 1;
+                        cut.push_back(v);
+                    }
+                    dist[v] = candidate;
+                    parent[v] = u;
+                    heap.pushOrDecrease(v, candidate);
+                }
+            }
+        }
+        int changed = (int)cut.size();
+        for (size_t k = 0; k < cut.size(); ++k) {
+            affected[cut[k]] = 0;
+        }
+        return changed;
+    }
+};
+
+// Multilevel graph partitioner in the style of METIS. The road graph is coarsened by
+// heavy-edge matching until it is small, split into regions by greedy graph growing,
+// then projected back one level at a time; at every level a refinement pass moves
+// boundary intersections to the neighbouring region they are best connected to, as
+// long as the balance allows.
+class GraphPartitioner {
+public:
+    // Region (0 .. parts-1) of each intersection. Regions hold at most 'imbalance' times
+    // the average number of intersections, with as few roads between them as possible.
+    static vector<int> partition(const RoadNetwork& roads, int parts, double imbalance = 1.03) {
+        int nodes = roads.nodeCount();
+        vector<int> region(nodes, 0);
+        if (parts <= 1 || nodes == 0) {
+            return region;
+        }
+
+        // Level 0 is the road graph itself, one unit of weight per intersection and road
+        vector<Level> levels(1);
+        Level& base = levels[0];
+        base.begin.assign(nodes + 1, 0);
+        base.nodeWeight.assign(nodes, 1);
+        for (int u = 0; u < nodes; ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (roads.targets[arc] != u) {
+                    base.adjacent.push_back(roads.targets[arc]);
+                    base.edgeWeight.push_back(1);
+                }
+            }
+            base.begin[u + 1] = (int)base.adjacent.size();
+        }
+
+        // Coarsen until the graph is small or stops shrinking
+        mt19937 random(12345);
+        int smallEnough = max(parts * 20, 200);
+        int heaviest = max(1, (int)(nodes / (double)parts / 4)); // Keep coarse nodes movable
+        while (levels.back().size() > smallEnough) {
+            Level coarse;
+            coarsen(levels.back(), coarse, heaviest, random);
+            if (coarse.size() > levels.back().size() * 0.95) {
+                break;
+            }
+            levels.push_back(Level());
+            levels.back().swap(coarse);
+        }
+
+        // Split the coarsest graph, then refine on the way back up
+        vector<int> part = growRegions(levels.back(), parts);
+        for (int level = (int)levels.size() - 1; ; --level) {
+            refine(levels[level], part, parts, imbalance);
+            if (level == 0) {
+                break;
+            }
+            const vector<int>& coarseOf = levels[level - 1].coarseOf;
+            vector<int> finer(levels[level - 1].size());
+            for (int u = 0; u < (int)finer.size(); ++u) {
+                finer[u] = part[coarseOf[u]];
+            }
+            part.swap(finer);
+        }
+        return part;
+    }
+
+    // Number of arcs whose two ends lie in different regions
+    static long long cutSize(const RoadNetwork& roads, const vector<int>& region) {
+        long long cut = 0;
+        for (int u = 0; u < roads.nodeCount(); ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (region[roads.targets[arc]] != region[u]) {
+                    cut++;
+                }
+            }
+        }
+        return cut;
+    }
+
+private:
+    // One graph of the hierarchy in adjacency-array form
+    struct Level {
+        vector<int> begin;      // Neighbours of u are adjacent[begin[u] .. begin[u + 1])
+        vector<int> adjacent;
+        vector<int> edgeWeight; // Roads merged into each edge
+        vector<int> nodeWeight; // Intersections merged into each node
+        vector<int> coarseOf;   // Node of the next coarser level each node was merged into
+
+        int size() const { return (int)nodeWeight.size(); }
+        void swap(Level& other) {
+            begin.swap(other.begin);
+            adjacent.swap(other.adjacent);
+            edgeWeight.swap(other.edgeWeight);
+            nodeWeight.swap(other.nodeWeight);
+            coarseOf.swap(other.coarseOf);
+        }
+    };
+
+    // Merge every node with the unmatched neighbour it shares the heaviest edge with
+    static void coarsen(Level& fine, Level& coarse, int heaviest, mt19937& random) {
+        int n = fine.size();
+        vector<int> order(n);
+        for (int u = 0; u < n; ++u) {
+            order[u] = u;
+        }
+        shuffle(order.begin(), order.end(), random);
+
+        vector<int> match(n, -1);
+        for (int i = 0; i < n; ++i) {
+            int u = order[i];
+            if (match[u] != -1) continue;
+            int best = u;
+            int bestWeight = 0;
+            for (int e = fine.begin[u]; e < fine.begin[u + 1]; ++e) {
+                int v = fine.adjacent[e];
+                if (match[v] == -1 && v != u && fine.edgeWeight[e] > bestWeight
+                    && fine.nodeWeight[u] + fine.nodeWeight[v] <= heaviest) {
+                    best = v;
+                    bestWeight = fine.edgeWeight[e];
+                }
+            }
+            match[u] = best;
+            match[best] = u;
+        }
+
+        // Number the merged nodes and add up their weights
+        fine.coarseOf.assign(n, -1);
+        vector<int> members; // Pairs of fine nodes per coarse node
+        for (int u = 0; u < n; ++u) {
+            if (fine.coarseOf[u] != -1) continue;
+            int id = (int)coarse.nodeWeight.size();
+            fine.coarseOf[u] = id;
+            fine.coarseOf[match[u]] = id;
+            coarse.nodeWeight.push_back(fine.nodeWeight[u] + (match[u] != u ? fine.nodeWeight[match[u]] : 0));
+            members.push_back(u);
+            members.push_back(match[u]);
+        }
+
+        // Merge the adjacency of each pair, adding up parallel edges
+        int cn = coarse.size();
+        vector<int> slot(cn, -1);
+        coarse.begin.assign(cn + 1, 0);
+        for (int c = 0; c < cn; ++c) {
+            int rowStart = (int)coarse.adjacent.size();
+            for (int m = 0; m < 2; ++m) {
+                int u = members[2 * c + m];
+                if (m == 1 && u == members[2 * c]) break;
+                for (int e = fine.begin[u]; e < fine.begin[u + 1]; ++e) {
+                    int target = fine.coarseOf[fine.adjacent[e]];
+                    if (target == c) continue;
+                    if (slot[target] == -1) {
+                        slot[target] = (int)coarse.adjacent.size();
+                        coarse.adjacent.push_back(target);
+                        coarse.edgeWeight.push_back(0);
+                    }
+                    coarse.edgeWeight[slot[target]] += fine.edgeWeight[e];
+                }
+            }
+            for (int e = rowStart; e < (int)coarse.adjacent.size(); ++e) {
+                slot[coarse.adjacent[e]] = -1;
+            }
+            coarse.begin[c + 1] = (int)coarse.adjacent.size();
+        }
+    }
+
+    // Initial split: grow each region breadth-first from the first unassigned node until
+    // it holds its share of the weight; the last region takes the rest
+    static vector<int> growRegions(const Level& graph, int parts) {
+        int n = graph.size();
+        long long total = 0;
+        for (int u = 0; u < n; ++u) {
+            total += graph.nodeWeight[u];
+        }
+        vector<int> part(n, -1);
+        vector<int> frontier;
+        int nextSeed = 0;
+        for (int p = 0; p < parts - 1; ++p) {
+            long long target = total * (p + 1) / parts - total * p / parts;
+            long long weight = 0;
+            frontier.clear();
+            size_t head = 0;
+            while (weight < target) {
+                if (head == frontier.size()) {
+                    while (nextSeed < n && part[nextSeed] != -1) nextSeed++;
+                    if (nextSeed == n) break;
+                    frontier.push_back(nextSeed);
+                }
+                int u = frontier[head++];
+                if (part[u] != -1) continue;
+                part[u] = p;
+                weight += graph.nodeWeight[u];
+                for (int e = graph.begin[u]; e < graph.begin[u + 1]; ++e) {
+                    if (part[graph.adjacent[e]] == -1) {
+                        frontier.push_back(graph.adjacent[e]);
+                    }
+                }
+            }
+        }
+        for (int u = 0; u < n; ++u) {
+            if (part[u] == -1) {
+                part[u] = parts - 1;
+            }
+        }
+        return part;
+    }
+
+    // Greedy boundary refinement: move a node to the neighbouring region it has the most
+    // edge weight to if that lowers the cut (or fixes an overweight region) and the target
+    // stays within the balance limit
+    static void refine(const Level& graph, vector<int>& part, int parts, double imbalance) {
+        int n = graph.size();
+        vector<long long> weight(parts, 0);
+        long long total = 0;
+        for (int u = 0; u < n; ++u) {
+            weight[part[u]] += graph.nodeWeight[u];
+            total += graph.nodeWeight[u];
+        }
+        long long limit = (long long)(imbalance * total / parts) + 1;
+
+        vector<int> connection(parts, 0);
+        vector<int> touched;
+        for (int pass = 0; pass < 8; ++pass) {
+            int moved = 0;
+            for (int u = 0; u < n; ++u) {
+                int from = part[u];
+                touched.clear();
+                for (int e = graph.begin[u]; e < graph.begin[u + 1]; ++e) {
+                    int p = part[graph.adjacent[e]];
+                    if (connection[p] == 0) touched.push_back(p);
+                    connection[p] += graph.edgeWeight[e];
+                }
+                int best = -1;
+                for (size_t i = 0; i < touched.size(); ++i) {
+                    int p = touched[i];
+                    if (p != from && weight[p] + graph.nodeWeight[u] <= limit
+                        && (best == -1 || connection[p] > connection[best])) {
+                        best = p;
+                    }
+                }
+                if (best != -1) {
+                    int gain = connection[best] - connection[from];
+                    bool balances = weight[best] + graph.nodeWeight[u] < weight[from];
+                    if (gain > 0 || (gain == 0 && balances) || (weight[from] > limit && balances)) {
+                        part[u] = best;
+                        weight[from] -= graph.nodeWeight[u];
+                        weight[best] += graph.nodeWeight[u];
+                        moved++;
+                    }
+                }
+                for (size_t i = 0; i < touched.size(); ++i) {
+                    connection[touched[i]] = 0;
+                }
+            }
+            if (moved == 0) {
+                break;
+            }
+        }
+    }
+};
+
+// Event queue of the traffic simulation. Times are whole seconds; the next SLOTS seconds
+// map onto a ring of buckets, so scheduling and taking an event are O(1). Events further
+// out wait in a heap and drop into the ring as it turns. Events of the same second come
+// out in the order they were scheduled.
+class TimingWheel {
+public:
+    struct Event {
+        int time;
+        int subject; // Vehicle or intersection index
+        int kind;
+    };
+
+    static const int SLOTS = 4096; // Power of two
+
+    TimingWheel() : now(0), cursor(0), inRing(0) { buckets.resize(SLOTS); }
+
+    int currentTime() const { return now; }
+    bool empty() const { return inRing == 0 && far.empty(); }
+    size_t size() const { return inRing + far.size(); }
+
+    void clear() {
+        for (int i = 0; i < SLOTS; ++i) {
+            buckets[i].clear();
+        }
+        far = priority_queue<Event, vector<Event>, Later>();
+        now = 0;
+        cursor = 0;
+        inRing = 0;
+    }
+
+    // Add an event; times in the past are moved to the current second
+    void schedule(int time, int subject, int kind) {
+        Event event = { time < now ? now : time, subject, kind };
+        if (event.time - now < SLOTS) {
+            buckets[event.time & (SLOTS - 1)].push_back(event);
+            inRing++;
+        }
+        else {
+            far.push(event);
+        }
+    }
+
+    // Take the earliest event; returns false when none are left
+    bool next(Event& event) {
+        while (true) {
+            vector<Event>& bucket = buckets[now & (SLOTS - 1)];
+            if (cursor < bucket.size()) {
+                event = bucket[cursor++];
+                inRing--;
+                return true;
+            }
+            bucket.clear();
+            cursor = 0;
+            if (inRing == 0) {
+                if (far.empty()) {
+                    return false;
+                }
+                now = far.top().time; // Skip the empty seconds in between
+            }
+            else {
+                now++;
+            }
+            while (!far.empty() && far.top().time - now < SLOTS) {
+                buckets[far.top().time & (SLOTS - 1)].push_back(far.top());
+                inRing++;
+                far.pop();
+            }
+        }
+    }
+
+    // Take the earliest event if it is due before 'limit'; otherwise move the clock up to
+    // 'limit' and return false. Used to process one time window at a time.
+    bool nextBefore(int limit, Event& event) {
+        while (now < limit) {
+            vector<Event>& bucket = buckets[now & (SLOTS - 1)];
+            if (cursor < bucket.size()) {
+                event = bucket[cursor++];
+                inRing--;
+                return true;
+            }
+            bucket.clear();
+            cursor = 0;
+            if (inRing == 0) {
+                now = far.empty() || far.top().time > limit ? limit : far.top().time;
+            }
+            else {
+                now++;
+            }
+            while (!far.empty() && far.top().time - now < SLOTS) {
+                buckets[far.top().time & (SLOTS - 1)].push_back(far.top());
+                inRing++;
+                far.pop();
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const { return a.time > b.time; }
+    };
+
+    int now;
+    size_t cursor;   // Next event in the current bucket
+    size_t inRing;   // Events in the buckets
+    vector<vector<Event> > buckets;
+    priority_queue<Event, vector<Event>, Later> far;
+};
+
+// Outcome of one simulation run
+struct SimulationReport {
+    long long events;   // Events processed
+    int endTime;        // Simulated second the run stopped at
+    int arrived;        // Vehicles that reached their destination
+    int stranded;       // Vehicles without a usable route
+    int enRoute;        // Vehicles still travelling at the time limit
+    int reroutes;       // Routes recomputed because of congestion or closures
+    int signalChanges;  // Green times retimed by the adaptive signal control
+    long long totalTravelTime; // Seconds from departure to arrival, summed over arrived vehicles
+    double planningSeconds; // Wall-clock time spent planning the initial routes
+    double seconds;     // Wall-clock time of the event loop
+    int regions;        // Regions simulated in parallel
+    long long boundaryRoads;  // Roads between two regions
+    double partitionSeconds;  // Wall-clock time spent partitioning
+
+    SimulationReport() : events(0), endTime(0), arrived(0), stranded(0), enRoute(0), reroutes(0),
+        signalChanges(0), totalTravelTime(0), planningSeconds(0), seconds(0), regions(1), boundaryRoads(0),
+        partitionSeconds(0) {}
+};
+
+
+
+// Memory mapping of a whole file. The CSV loaders parse straight out of a read-only
+// mapping, so no line or field is ever copied into a std::string. Snapshots use a
+// copy-on-write mapping instead: pages can be modified in place, the file never changes.
+class MappedFile {
+public:
+    MappedFile() : bytes(nullptr), length(0)
+#ifdef _WIN32
+        , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#endif
+    {}
+    ~MappedFile() { close(); }
+
+    bool open(const string& filename, bool copyOnWrite = false) {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+        if (length == 0) {
+            return true; // Empty files have nothing to map
+        }
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            close();
+            return false;
+        }
+        bytes = (char*)MapViewOfFile(mappingHandle, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        if (bytes == nullptr) {
+            close();
+            return false;
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+            void* mapping = mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(mapping, length, copyOnWrite ? MADV_WILLNEED : MADV_SEQUENTIAL);
+            bytes = (char*)mapping;
+        }
+        ::close(fd); // The mapping keeps the file contents alive
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes != nullptr) UnmapViewOfFile(bytes);
+        if (mappingHandle != NULL) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (bytes != nullptr) munmap((void*)bytes, length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return bytes; }
+    char* mutableData() { return bytes; } // Only writable for copy-on-write mappings
+
+    void swap(MappedFile& other) {
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#endif
+    }
+    size_t size() const { return length; }
+
+private:
+    char* bytes;
+    size_t length;
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+#endif
+
+    MappedFile(const MappedFile&);            // Not copyable
+    MappedFile& operator=(const MappedFile&);
+};
+
+// Splits a CSV buffer into records of string_view fields that point into the buffer.
+// Fields are trimmed of spaces, tabs and surrounding quotes; blank lines are skipped.
+class CsvReader {
+public:
+    static const int MAX_FIELDS = 8;
+
+    CsvReader(const char* begin, size_t size) : start(begin), cursor(begin), end(begin + size), fields(0), line(0) {}
+
+    // Move to the next record; returns false at the end of the input
+    bool next() {
+        while (cursor < end) {
+            const char* lineEnd = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            const char* lineStart = cursor;
+            cursor = lineEnd < end ? lineEnd + 1 : end;
+            line++;
+
+            split(lineStart, lineEnd);
+            if (fields > 1 || (fields == 1 && !field[0].empty())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Start again from the first record
+    void rewind() {
+        cursor = start;
+        line = 0;
+        fields = 0;
+    }
+
+    int fieldCount() const { return fields; }
+    string_view operator[](int index) const { return index < fields ? field[index] : string_view(); }
+    int lineNumber() const { return line; }
+
+    // Number of lines in a buffer, used to size containers before a bulk load
+    static size_t countLines(const char* begin, size_t size) {
+        size_t lines = 0;
+        const char* cursor = begin;
+        const char* end = begin + size;
+        while (cursor < end) {
+            const char* newline = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+            lines++;
+            if (newline == nullptr) {
+                break;
+            }
+            cursor = newline + 1;
+        }
+        return lines;
+    }
+
+private:
+    const char* start;
+    const char* cursor;
+    const char* end;
+    string_view field[MAX_FIELDS];
+    int fields;
+    int line;
+
+    void split(const char* begin, const char* finish) {
+        fields = 0;
+        const char* fieldStart = begin;
+        for (const char* p = begin; ; ++p) {
+            if (p == finish || *p == ',') {
+                if (fields < MAX_FIELDS) {
+                    field[fields++] = trim(fieldStart, p);
+                }
+                if (p == finish) {
+                    break;
+                }
+                fieldStart = p + 1;
+            }
+        }
+    }
+
+    static string_view trim(const char* begin, const char* finish) {
+        while (begin < finish && (*begin == ' ' || *begin == '\t' || *begin == '"')) begin++;
+        while (finish > begin && (finish[-1] == ' ' || finish[-1] == '\t' || finish[-1] == '\r' || finish[-1] == '"')) finish--;
+        return string_view(begin, (size_t)(finish - begin));
+    }
+};
+
+// Parse a whole field as a decimal integer
+bool parseInt(string_view text, int& value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+    }
+    if (i == text.size()) {
+        return false;
+    }
+    long long result = 0;
+    for (; i < text.size(); ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        result = result * 10 + (text[i] - '0');
+        if (result > 2147483647LL) {
+            return false;
+        }
+    }
+    value = (int)(negative ? -result : result);
+    return true;
+}
+
+// Parse a whole field as a decimal number (used for coordinates)
+bool parseDouble(string_view text, double& value) {
+    if (!text.empty() && text[0] == '+') {
+        text.remove_prefix(1);
+    }
+    if (text.empty()) {
+        return false;
+    }
+    from_chars_result result = from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == errc() && result.ptr == text.data() + text.size() && isfinite(value);
+}
+
+// Parse a time of day written as H:MM or H:MM:SS into seconds after midnight; hours
+// past 23 stand for the following days
+bool parseClockTime(string_view text, int& seconds) {
+    int parts[3] = { 0, 0, 0 };
+    int count = 0;
+    while (count < 3) {
+        size_t colon = text.find(':');
+        if (!parseInt(text.substr(0, colon), parts[count]) || parts[count] < 0) {
+            return false;
+        }
+        count++;
+        if (colon == string_view::npos) {
+            break;
+        }
+        text.remove_prefix(colon + 1);
+    }
+    if (count < 2 || parts[1] >= 60 || parts[2] >= 60 || parts[0] > 500000) {
+        return false;
+    }
+    seconds = parts[0] * 3600 + parts[1] * 60 + parts[2];
+    return true;
+}
+
+// Seconds after midnight as HH:MM:SS, followed by +N on the Nth following day
+string formatClockTime(int seconds) {
+    int days = seconds / 86400;
+    seconds %= 86400;
+    char text[32];
+    snprintf(text, sizeof(text), "%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return days > 0 ? string(text) + "+" + to_string(days) : string(text);
+}
+
+// Case-insensitive comparison against a lowercase word
+bool equalsIgnoreCase(string_view text, const char* lowercase) {
+    size_t length = strlen(lowercase);
+    if (text.size() != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (tolower((unsigned char)text[i]) != lowercase[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Emergency priority given either as a number or as High / Medium / Low (higher is more urgent)
+int parseEmergencyPriority(string_view text) {
+    int value;
+    if (parseInt(text, value)) return value;
+    if (equalsIgnoreCase(text, "high") || equalsIgnoreCase(text, "critical")) return 3;
+    if (equalsIgnoreCase(text, "medium")) return 2;
+    if (equalsIgnoreCase(text, "low")) return 1;
+    return -1;
+}
+
+// Outcome of loading one data file
+struct LoadReport {
+    int records;  // Rows applied to the graph
+    int skipped;  // Rows that were malformed, duplicated or referenced unknown intersections
+
+    LoadReport() : records(0), skipped(0) {}
+};
+
+// One reading of a congestion feed: vehicles now on the road from -> to
+struct RoadCount {
+    int from;
+    int to;
+    int count;
+};
+
+// Outcome of applyVehicleCounts
+struct CountUpdateReport {
+    int applied;        // Readings stored
+    int skipped;        // Readings with invalid indices, a negative count or no such road
+    int weightsChanged; // Roads whose congestion-adjusted weight changed
+    int signalsChanged; // Intersections whose green time changed
+
+    CountUpdateReport() : applied(0), skipped(0), weightsChanged(0), signalsChanged(0) {}
+};
+
+// Outcome of one optimizeSignals control cycle
+struct SignalPlanReport {
+    int signals;    // Signalized intersections planned (three or more roads, no emergency override)
+    int changed;    // Of those, intersections whose green time or split changed
+    double seconds; // Wall-clock time of the cycle
+
+    SignalPlanReport() : signals(0), changed(0), seconds(0) {}
+};
+
+// Outcome of assignTraffic
+struct AssignmentReport {
+    int trips;              // Trips given, including any that need no road
+    int unroutable;         // Trips with no open route to their destination
+    int steps;              // Frank-Wolfe steps taken
+    double relativeGap;     // Share of the travel time the trips could still save by switching routes
+    double travelTime;      // Vehicle-seconds spent on the roads at the final flows
+    int countsChanged;      // Roads whose vehicle count changed
+    int weightsChanged;     // Roads whose weight changed
+    int signalsChanged;     // Intersections whose green time changed
+    double seconds;         // Wall-clock time, solving and applying
+
+    AssignmentReport() : trips(0), unroutable(0), steps(0), relativeGap(0), travelTime(0), countsChanged(0),
+        weightsChanged(0), signalsChanged(0), seconds(0) {}
+};
+
+// Outcome of rerouteAroundClosure
+struct RerouteReport {
+    int affected;            // Vehicles whose route used the closed road
+    int stranded;            // Of those, vehicles left without a route
+    vector<int> routeUsers;  // Rerouted vehicles sent down the 1st, 2nd, ... alternative of their trip
+    int spreadPeak;          // Most rerouted vehicles on one road with the spread
+    int shortestPeak;        // The same if every vehicle took its new shortest route
+    double seconds;          // Wall-clock time of the alternative route search
+
+    RerouteReport() : affected(0), stranded(0), spreadPeak(0), shortestPeak(0), seconds(0) {}
+};
+
+// Green light override scheduled at one intersection of an emergency corridor
+struct OverrideEvent {
+    int time;         // Corridor clock second at which it takes effect
+    int intersection;
+    bool on;          // Override starts (true) or ends (false)
+
+    // Ordering of the event queue: earliest first, and a start before an end of the same
+    // second so back-to-back windows never let the signal drop out in between
+    bool operator<(const OverrideEvent& other) const {
+        if (time != other.time) {
+            return time > other.time;
+        }
+        return !on && other.on;
+    }
+};
+
+// Outcome of dispatching one emergency vehicle (see dispatchEmergencyById)
+struct Corridor {
+    int vehicle;          // Interned vehicle ID, -1 for an unnamed dispatch
+    int priority;
+    Route route;          // Arrival times include the time held for other corridors
+    int departure;        // Corridor clock second at which the vehicle leaves
+    int held;             // Seconds held back at intersections reserved by other corridors
+    double microseconds;  // Dispatch latency: route query plus scheduling
+
+    Corridor() : vehicle(-1), priority(0), departure(0), held(0), microseconds(0) {}
+};
+
+// Immutable copy of the roads that concurrent route queries read (see publishRoads)
+struct RoadVersion {
+    RoadNetwork roads;
+    RouteHeuristic bounds; // Coordinate bounds when every intersection has coordinates
+    unsigned number;       // 1 for the first published version, then counting up
+};
+
+
+
+// Graph Class
+class TrafficGraph {
+private:
+    Column<Intersection> intersections;
+    NameTable names;   // Interned intersection names; the ID of a name is the intersection index
+    RoadNetwork roads; // Roads with their weights, vehicle counts and closure status
+    HeapKind heapKind; // Priority queue used by the shortest path engine
+    SearchWorkspace workspace; // Scratch arrays reused by interactive route queries
+    vector<Vehicle> vehicles;                   // Vehicles loaded from vehicles.csv
+    vector<EmergencyVehicle> emergencyVehicles; // Vehicles loaded from emergency_vehicles.csv
+    NameTable vehicleNames;                     // Interned vehicle IDs
+    MappedFile snapshotFile; // Loaded snapshot; the graph's arrays may point into it
+    unique_ptr<WorkerPool> workers;        // Threads for batch work
+    RoutingAlgorithm routingAlgorithm;     // Algorithm behind point-to-point queries
+    ContractionHierarchy hierarchy;        // Built on demand when the hierarchy is selected
+    unsigned topologyVersion;              // Bumped whenever intersections or roads are added or removed
+    unsigned hierarchyTopology;            // topologyVersion the hierarchy was built for
+    bool hierarchyBuilt;
+    vector<pair<int, int> > pendingRoadChanges; // Roads re-weighted since the last customization
+    RoutingAlgorithm emergencyAlgorithm;   // Algorithm behind emergencyVehicleRouting
+    RouteHeuristic heuristic;              // Lower bounds for the A* modes, built on demand
+    unsigned heuristicTopology;            // topologyVersion the heuristic was built for
+    bool heuristicBuilt;
+    SearchWorkspace backwardWorkspace;     // Second side of bidirectional searches
+    int lastSettled;                       // Nodes settled (or scanned) by the last route query
+    DynamicShortestPaths activeTrees;      // Shortest-path trees of the registered active sources
+    unsigned treesTopology;                // topologyVersion the trees were grown for
+    Versioned<RoadVersion> publishedRoads; // What routeConcurrently reads
+    unsigned publishedCount;               // Versions published so far
+    TravelTimeProfiles profiles;           // Time-of-day travel times shared by the roads
+    RouteHeuristic timeBounds;             // Lower bounds over the whole day for time-dependent A*
+    unsigned timeBoundsTopology;           // topologyVersion the time bounds were built for
+    bool timeBoundsBuilt;
+    SearchWorkspace timeWorkspace;         // Scratch of time-dependent searches (indexed by road)
+    SpatialIndex spatial;                  // Nearest intersection and road lookups, built on demand
+    unsigned spatialTopology;              // topologyVersion the spatial index was built for
+    bool spatialBuilt;
+
+    // Emergency corridors. Overrides are scheduled on their own clock (seconds since the
+    // first dispatch) as start/end events; each intersection keeps the windows promised to
+    // corridors as a linked list sorted by start, so a later dispatch can find a free slot.
+    struct CorridorWindow {
+        int begin; // First second of the override
+        int end;   // First second after it
+        int next;  // Next window at the same intersection, -1 at the end
+    };
+    int corridorClock;
+    priority_queue<OverrideEvent> overrideEvents;
+    vector<CorridorWindow> corridorWindows; // Pool of windows; unused entries are chained from freeWindow
+    int freeWindow;
+    vector<int> windowHead;                 // Per intersection: first window, -1 if none
+    vector<int> activeOverrides;            // Per intersection: corridors holding its green right now
+
+    static const int CORRIDOR_LEAD = 10;  // Seconds the green is held before the vehicle arrives
+    static const int CORRIDOR_CLEAR = 5;  // Seconds it is held after the vehicle arrives
+
+    // Remember a weight or closure change so the hierarchy can be re-customized lazily.
+    // A road that got faster (or reopened) can break the A* lower bounds.
+    void roadWeightChanged(int fromIndex, int toIndex, bool faster) {
+        if (hierarchyBuilt && hierarchyTopology == topologyVersion) {
+            pendingRoadChanges.push_back(make_pair(fromIndex, toIndex));
+        }
+        if (faster) {
+            heuristicBuilt = false;
+            timeBoundsBuilt = false;
+        }
+        activeTrees.roadChanged(fromIndex, toIndex);
+    }
+
+    // Bring the active-source trees up to date: regrow them after topology changes,
+    // otherwise repair them for the roads changed since the last query
+    void prepareActiveTrees() {
+        if (activeTrees.sourceCount() == 0) {
+            return;
+        }
+        if (treesTopology != topologyVersion) {
+            activeTrees.rebuild(roads, *workers);
+            treesTopology = topologyVersion;
+        }
+        else {
+            activeTrees.update(roads, *workers);
+        }
+    }
+
+    // Rebuild the spatial index if intersections moved or roads were added or removed
+    void prepareSpatialIndex() {
+        if (spatialBuilt && spatialTopology == topologyVersion) {
+            return;
+        }
+        spatial.build(roads, intersections);
+        spatialBuilt = true;
+        spatialTopology = topologyVersion;
+    }
+
+    // Rebuild the A* lower bounds if roads were added or got faster since the last build:
+    // coordinates when every intersection has them, landmarks otherwise
+    void prepareHeuristic() {
+        if (heuristicBuilt && heuristicTopology == topologyVersion) {
+            return;
+        }
+        if (!heuristic.buildFromCoordinates(roads, intersections)) {
+            heuristic.buildLandmarks(roads, RouteHeuristic::DEFAULT_LANDMARKS, *workers);
+        }
+        heuristicBuilt = true;
+        heuristicTopology = topologyVersion;
+    }
+
+    // Bounds for time-dependent A*, built like the ones above on the smallest travel time
+    // each road takes at any hour. Without profiles those are the plain A* bounds.
+    const RouteHeuristic& prepareTimeBounds() {
+        if (profiles.count() == 0) {
+            prepareHeuristic();
+            return heuristic;
+        }
+        if (timeBoundsBuilt && timeBoundsTopology == topologyVersion) {
+            return timeBounds;
+        }
+        RoadNetwork fastest = roads;
+        for (int u = 0; u < fastest.nodeCount(); ++u) {
+            for (int arc = fastest.rowBegin(u); arc < fastest.rowEnd(u); ++arc) {
+                int profile = fastest.profiles[arc];
+                if (profile != -1) {
+                    fastest.weights[arc] = profiles.minimum(profile) + max(0, roads.weights[arc] - roads.baseWeights[arc]);
+                }
+            }
+        }
+        if (!timeBounds.buildFromCoordinates(fastest, intersections)) {
+            timeBounds.buildLandmarks(fastest, RouteHeuristic::DEFAULT_LANDMARKS, *workers);
+        }
+        timeBoundsBuilt = true;
+        timeBoundsTopology = topologyVersion;
+        return timeBounds;
+    }
+
+    // Prepare whatever the algorithm needs and describe it
+    void announceAlgorithm(RoutingAlgorithm algorithm, const char* purpose) {
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        if (algorithm == ROUTE_CONTRACTION) {
+            prepareHierarchy();
+        }
+        else if (algorithm == ROUTE_ASTAR || algorithm == ROUTE_BIDIRECTIONAL_ASTAR) {
+            prepareHeuristic();
+        }
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        cout << purpose << " with ";
+        if (algorithm == ROUTE_CONTRACTION) {
+            cout << "the contraction hierarchy (" << hierarchy.shortcutCount()
+                << " hierarchy arcs, prepared in " << milliseconds << " ms)." << '\n';
+        }
+        else if (algorithm == ROUTE_ASTAR || algorithm == ROUTE_BIDIRECTIONAL_ASTAR) {
+            cout << (algorithm == ROUTE_ASTAR ? "A*" : "bidirectional A*") << " (";
+            if (heuristic.getKind() == RouteHeuristic::COORDINATES) {
+                cout << "straight-line bounds";
+            }
+            else {
+                cout << heuristic.getLandmarkCount() << " landmarks";
+            }
+            cout << ", prepared in " << milliseconds << " ms)." << '\n';
+        }
+        else {
+            cout << "Dijkstra's algorithm." << '\n';
+        }
+    }
+
+    // Bring the hierarchy up to date: rebuild after topology changes, otherwise only
+    // re-customize the arcs that the pending road changes can affect
+    void prepareHierarchy() {
+        if (!hierarchyBuilt || hierarchyTopology != topologyVersion) {
+            hierarchy.build(roads);
+            hierarchy.customize(roads);
+            hierarchyBuilt = true;
+            hierarchyTopology = topologyVersion;
+        }
+        else if ((int)pendingRoadChanges.size() * 16 > hierarchy.shortcutCount()) {
+            hierarchy.customize(roads);
+        }
+        else if (!pendingRoadChanges.empty()) {
+            hierarchy.updateRoads(roads, pendingRoadChanges);
+        }
+        pendingRoadChanges.clear();
+    }
+    vector<SearchWorkspace> workerSpaces;  // One set of scratch arrays per worker
+    vector<AlternativeRoutes> workerAlternatives; // One alternative route engine per worker
+
+    // Concatenate paths that workers collected separately into result.paths, in query order
+    static void gatherPaths(const vector<vector<int> >& workerPaths, const vector<int>& pathWorker, RouteBatch& result) {
+        size_t total = 0;
+        for (size_t worker = 0; worker < workerPaths.size(); ++worker) {
+            total += workerPaths[worker].size();
+        }
+        result.paths.reserve(total);
+        for (size_t q = 0; q < result.routes.size(); ++q) {
+            RouteResult& route = result.routes[q];
+            if (route.pathLength == 0) {
+                continue;
+            }
+            const int* path = workerPaths[pathWorker[q]].data() + route.pathOffset;
+            route.pathOffset = (int)result.paths.size();
+            result.paths.insert(result.paths.end(), path, path + route.pathLength);
+        }
+    }
+
+    // Largest number of a batch's routes that share one road
+    int busiestRoadLoad(const RouteBatch& batch) const {
+        vector<int> load(roads.targets.size(), 0);
+        int peak = 0;
+        for (size_t q = 0; q < batch.routes.size(); ++q) {
+            const RouteResult& route = batch.routes[q];
+            const int* path = batch.paths.data() + route.pathOffset;
+            for (int step = 0; step + 1 < route.pathLength; ++step) {
+                int arc = roads.findArc(path[step], path[step + 1]);
+                peak = max(peak, ++load[arc]);
+            }
+        }
+        return peak;
+    }
+
+    // Green time the density model gives an intersection: 30 seconds plus one second per
+    // 10 vehicles on the roads leaving it
+    int densityGreenTime(int intersectionIndex) const {
+        int totalVehicleCount = 0;
+        for (int arc = roads.rowBegin(intersectionIndex); arc < roads.rowEnd(intersectionIndex); ++arc) {
+            totalVehicleCount += roads.vehicleCounts[arc];
+        }
+        return 30 + totalVehicleCount / 10;
+    }
+
+    // Seconds a vehicle arriving from 'fromIndex' waits at 'atIndex' at time 'now'. Signals
+    // run a cycle of trafficSignal seconds per approach (one per road in the row) and
+    // give the approaches their green in row order: equal parts, or parts in proportion
+    // to the roads' green shares once optimizeSignals has set them. Intersections with
+    // fewer than three roads and emergency overrides never stop.
+    int signalWait(int fromIndex, int atIndex, int now) const {
+        int degree = roads.degree(atIndex);
+        const Intersection& intersection = intersections[atIndex];
+        if (degree < 3 || intersection.emergencyOverride) {
+            return 0;
+        }
+        int approach = roads.findArc(atIndex, fromIndex);
+        if (approach == -1) {
+            return 0;
+        }
+        int green = intersection.trafficSignal > 0 ? intersection.trafficSignal : 1;
+        int cycle = degree * green;
+        int sharesBefore = 0;
+        int shareTotal = 0;
+        for (int arc = roads.rowBegin(atIndex); arc < roads.rowEnd(atIndex); ++arc) {
+            if (arc == approach) {
+                sharesBefore = shareTotal;
+            }
+            shareTotal += roads.greenShares[arc];
+        }
+        int start = (approach - roads.rowBegin(atIndex)) * green;
+        if (shareTotal > 0) {
+            start = (int)((long long)cycle * sharesBefore / shareTotal);
+            int end = (int)((long long)cycle * (sharesBefore + roads.greenShares[approach]) / shareTotal);
+            green = max(end - start, 1); // A very short cycle still serves every approach
+        }
+        int phase = now % cycle;
+        if (phase >= start && phase < start + green) {
+            return 0;
+        }
+        return (start - phase + cycle) % cycle;
+    }
+
+    static const int CONGESTION_VEHICLES = 10; // Vehicles per extra second of travel time
+
+    // Delay level of a simulated road: its extra travel time in quarters of the free-flow time
+    static int delayLevel(int weight, int freeFlow) {
+        return (weight - freeFlow) * 4 / max(freeFlow, 4);
+    }
+
+    // Plan a route for every vehicle before a simulation run. Travel times never drop below
+    // the free-flow weights during a run, so A* bounds built for them stay valid however
+    // congestion changes; they speed up this planning and every reroute.
+    void planVehicleRoutes(RouteBatch& batch) {
+        prepareHeuristic();
+        vector<RouteQuery> queries(vehicles.size());
+        for (size_t i = 0; i < vehicles.size(); ++i) {
+            queries[i].start = vehicles[i].origin;
+            queries[i].end = vehicles[i].destination;
+        }
+        routeBatch(queries, batch);
+    }
+
+    // Retime the signal at 'at' with the density model if its cycle ended since a vehicle
+    // last reached it (retimeAt holds the end of each cycle, -1 before the first visit).
+    // Returns true if the green time changed.
+    bool retimeSignal(int at, int now, vector<int>& retimeAt) {
+        if (retimeAt[at] == -1) {
+            retimeAt[at] = roads.degree(at) * max(intersections[at].trafficSignal, 1);
+        }
+        if (now < retimeAt[at]) {
+            return false;
+        }
+        bool changed = false;
+        int green = densityGreenTime(at);
+        if (!intersections[at].emergencyOverride && green != intersections[at].trafficSignal) {
+            intersections[at].trafficSignal = green;
+            changed = true;
+        }
+        retimeAt[at] = now + roads.degree(at) * max(intersections[at].trafficSignal, 1);
+        return changed;
+    }
+
+    // Scratch for applyVehicleCounts, one entry per updated road (structure of arrays)
+    vector<int> updateArcs, updateTails, updateBase, updateCounts, updateWeights;
+    vector<unsigned char> roadQueued;          // Per arc slot: already in updateArcs
+    vector<unsigned char> signalDirty;         // Per intersection: green time needs recomputing
+    vector<int> dirtyIntersections;
+
+    void markSignalDirty(int intersectionIndex) {
+        if (!signalDirty[intersectionIndex]) {
+            signalDirty[intersectionIndex] = 1;
+            dirtyIntersections.push_back(intersectionIndex);
+        }
+    }
+
+    // Recompute the green times of the marked intersections (same rule as
+    // adjustGreenLightDuration, without the messages); returns how many changed
+    int refreshDirtySignals() {
+        int changed = 0;
+        for (size_t i = 0; i < dirtyIntersections.size(); ++i) {
+            int node = dirtyIntersections[i];
+            signalDirty[node] = 0;
+            int green = intersections[node].emergencyOverride ? 10 : densityGreenTime(node);
+            if (intersections[node].trafficSignal != green) {
+                intersections[node].trafficSignal = green;
+                eventLog.add(LOG_DEBUG, LOG_SIGNAL_CHANGED, node, green);
+                changed++;
+            }
+        }
+        dirtyIntersections.clear();
+        return changed;
+    }
+
+    // Earliest start, not before 'begin', of a 'length' second window at 'at' that overlaps
+    // no window already promised there; windows that have run out are dropped on the way
+    int firstFreeWindow(int at, int begin, int length) {
+        int* link = &windowHead[at];
+        while (*link != -1) {
+            CorridorWindow& window = corridorWindows[*link];
+            if (window.end <= corridorClock) {
+                int expired = *link;
+                *link = window.next;
+                corridorWindows[expired].next = freeWindow;
+                freeWindow = expired;
+                continue;
+            }
+            if (window.begin >= begin + length) {
+                break; // Sorted by start: nothing further along can overlap
+            }
+            if (window.end > begin) {
+                begin = window.end;
+            }
+            link = &window.next;
+        }
+        return begin;
+    }
+
+    // Forget all emergency corridors (the intersections they overrode must be gone or reset)
+    void resetCorridors() {
+        corridorClock = 0;
+        priority_queue<OverrideEvent>().swap(overrideEvents);
+        vector<CorridorWindow>().swap(corridorWindows);
+        freeWindow = -1;
+        vector<int>().swap(windowHead);
+        vector<int>().swap(activeOverrides);
+    }
+
+    // Promise [begin, end) at 'at' to a corridor and queue its override events
+    void reserveWindow(int at, int begin, int end) {
+        int entry = freeWindow;
+        if (entry != -1) {
+            freeWindow = corridorWindows[entry].next;
+        }
+        else {
+            entry = (int)corridorWindows.size();
+            corridorWindows.push_back(CorridorWindow());
+        }
+        int* link = &windowHead[at];
+        while (*link != -1 && corridorWindows[*link].begin <= begin) {
+            link = &corridorWindows[*link].next;
+        }
+        corridorWindows[entry].begin = begin;
+        corridorWindows[entry].end = end;
+        corridorWindows[entry].next = *link;
+        *link = entry;
+        OverrideEvent start = { begin, at, true };
+        OverrideEvent finish = { end, at, false };
+        overrideEvents.push(start);
+        overrideEvents.push(finish);
+    }
+
+    static const int MAX_GREEN = 90;       // Longest average green the optimizer gives an approach
+    static const int MIN_SHARE = 10;       // Split share every approach keeps (an even split is 100 each)
+    static const int SIGNAL_BLOCK = 1024;  // Intersections per task of optimizeSignals
+
+    // Max-pressure plan for one signal. An approach's pressure is the queue on the road in
+    // less the average load of the roads leaving the intersection it would feed (turns
+    // are taken to be evenly spread); its share of the cycle grows with its part of the
+    // total pressure, and the cycle itself grows with the vehicles waiting on all
+    // approaches. Writes only the intersection and its own row, so signals can be planned
+    // in parallel. Returns -1 if the intersection has no signal to plan, else 1 if the
+    // plan changed and 0 if not.
+    int planSignal(int at) {
+        int degree = roads.degree(at);
+        if (degree < 3 || intersections[at].emergencyOverride) {
+            return -1;
+        }
+        int begin = roads.rowBegin(at);
+        int end = roads.rowEnd(at);
+        long long outbound = 0;
+        for (int arc = begin; arc < end; ++arc) {
+            outbound += roads.vehicleCounts[arc];
+        }
+        long long inbound = 0;
+        long long pressureTotal = 0;
+        auto pressure = [&](int arc, int& queued) {
+            int in = roads.findArc(roads.targets[arc], at);
+            queued = in == -1 ? 0 : roads.vehicleCounts[in];
+            long long downstream = (outbound - roads.vehicleCounts[arc]) / (degree - 1);
+            return max(queued - downstream, 0LL);
+        };
+        for (int arc = begin; arc < end; ++arc) {
+            int queued;
+            pressureTotal += pressure(arc, queued);
+            inbound += queued;
+        }
+
+        bool changed = false;
+        for (int arc = begin; arc < end; ++arc) {
+            int queued;
+            int share = pressureTotal == 0 ? 0
+                : MIN_SHARE + (int)((100 - MIN_SHARE) * degree * pressure(arc, queued) / pressureTotal);
+            if (roads.greenShares[arc] != share) {
+                roads.greenShares[arc] = share;
+                changed = true;
+            }
+        }
+        int green = (int)min<long long>(30 + inbound / 10, MAX_GREEN); // Same base and slope as densityGreenTime
+        if (intersections[at].trafficSignal != green) {
+            intersections[at].trafficSignal = green;
+            eventLog.add(LOG_DEBUG, LOG_SIGNAL_CHANGED, at, green);
+            changed = true;
+        }
+        return changed ? 1 : 0;
+    }
+
+    // A row that cannot be used; a bad first line is taken to be the header
+    static void countSkippedRow(const CsvReader& reader, LoadReport& report) {
+        if (reader.lineNumber() > 1) {
+            report.skipped++;
+        }
+    }
+
+
+public:
+    TrafficGraph() : heapKind(DARY_HEAP), workers(new WorkerPool()), routingAlgorithm(ROUTE_DIJKSTRA),
+        topologyVersion(0), hierarchyTopology(0), hierarchyBuilt(false), emergencyAlgorithm(ROUTE_BIDIRECTIONAL_ASTAR),
+        heuristicTopology(0), heuristicBuilt(false), lastSettled(0), treesTopology(0), publishedCount(0),
+        timeBoundsTopology(0), timeBoundsBuilt(false), spatialTopology(0), spatialBuilt(false), corridorClock(0), freeWindow(-1) {}
+
+    // Number of threads used for batch work (0 = one per hardware thread)
+    void setWorkerCount(int threadCount) {
+        workers.reset(new WorkerPool(threadCount));
+    }
+    int getWorkerCount() const { return workers->size(); }
+
+    int intersectionCount() const { return (int)intersections.size(); }
+    int roadCount() const { return roads.arcCount(); } // Directed roads
+
+    // Roads leaving an intersection, and where the i-th of them leads
+    int roadsFrom(int index) const { return roads.degree(index); }
+    int roadTarget(int index, int i) const { return roads.targets[roads.rowBegin(index) + i]; }
+
+    // Select the priority queue used by dijkstra and everything built on it
+    void setHeapKind(HeapKind kind) {
+        heapKind = kind;
+        cout << "Shortest path engine set to "
+            << (kind == DARY_HEAP ? "indexed 4-ary heap" : "radix heap") << "." << '\n';
+    }
+    HeapKind getHeapKind() const { return heapKind; }
+
+    void monitorTraffic() {
+        cout << "\nReal-Time Traffic Monitoring:\n";
+        for (int i = 0; i < intersectionCount(); ++i) {
+            cout << "Intersection: " << names.name(i) << "\n";
+            for (int arc = roads.rowBegin(i); arc < roads.rowEnd(i); ++arc) {
+                cout << "  Road to " << names.name(roads.targets[arc])
+                    << " - Vehicle Count: " << roads.vehicleCounts[arc]
+                    << " - Weight: " << roads.weights[arc] << "\n";
+            }
+            cout << "-----------------------------------\n";
+        }
+    }
+
+
+    // Load all five data files into the graph (roads first, so the other files can
+    // refer to their intersections) and print a summary for each. Returns the names of
+    // the files that could not be opened.
+    vector<string> loadAllData() {
+        const char* filenames[] = {
+            "road_network.csv",
+            "traffic_signal_timings.csv",
+            "accidents_or_closures.csv",
+            "vehicles.csv",
+            "emergency_vehicles.csv"
+        };
+
+        vector<string> missing;
+        for (int i = 0; i < 5; ++i) {
+            LoadReport report;
+            chrono::steady_clock::time_point started = chrono::steady_clock::now();
+            bool loaded = false;
+            switch (i) {
+            case 0: loaded = loadRoadNetwork(filenames[i], report); break;
+            case 1: loaded = loadSignalTimings(filenames[i], report); break;
+            case 2: loaded = loadClosures(filenames[i], report); break;
+            case 3: loaded = loadVehicles(filenames[i], report); break;
+            case 4: loaded = loadEmergencyVehicles(filenames[i], report); break;
+            }
+            double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+            if (!loaded) {
+                cout << "Error: Unable to open file " << filenames[i] << "\n";
+                missing.push_back(filenames[i]);
+                continue;
+            }
+            eventLog.add(LOG_INFO, LOG_DATA_LOADED, i, report.records, report.skipped);
+            cout << "Loaded " << report.records << " records from " << filenames[i]
+                << " in " << milliseconds << " ms";
+            if (report.skipped > 0) {
+                cout << " (" << report.skipped << " rows skipped)";
+            }
+            cout << "\n";
+        }
+        cout << "Network: " << intersectionCount() << " intersections, " << roads.arcCount() / 2
+            << " roads, " << vehicles.size() << " vehicles, " << emergencyVehicles.size()
+            << " emergency vehicles.\n";
+        cout << "-------------------------------------\n";
+        return missing;
+    }
+
+    // road_network.csv: Intersection1,Intersection2,TravelTime[,X1,Y1,X2,Y2]
+    // The optional columns give the map coordinates of both intersections.
+    // Two passes over the mapped file: the first interns the names and counts roads per
+    // intersection so every row can be sized exactly, the second fills the rows in place.
+    bool loadRoadNetwork(const string& filename, LoadReport& report) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        size_t lines = CsvReader::countLines(file.data(), file.size());
+        intersections.reserve(intersections.size() + lines * 2);
+        roads.reserveNodes(intersectionCount() + (int)lines * 2);
+        names.reserve(names.size() + (int)lines * 2, file.size());
+
+        // Pass 1: intern intersections and count the roads each one gains
+        vector<int> extraDegree;
+        extraDegree.reserve(intersectionCount() + lines * 2);
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            int weight;
+            if (reader.fieldCount() < 3 || !parseInt(reader[2], weight) || weight < 0) {
+                continue;
+            }
+            int fromIndex = internIntersection(reader[0]);
+            int toIndex = internIntersection(reader[1]);
+            extraDegree.resize(intersectionCount(), 0);
+            extraDegree[fromIndex]++;
+            extraDegree[toIndex]++;
+        }
+        roads.reserveRows(extraDegree);
+
+        // Pass 2: add the roads; rows already have room, so nothing moves
+        reader.rewind();
+        while (reader.next()) {
+            int weight;
+            if (reader.fieldCount() < 3 || !parseInt(reader[2], weight) || weight < 0) {
+                countSkippedRow(reader, report); // The first line is usually the header
+                continue;
+            }
+            int fromIndex = names.find(reader[0]);
+            int toIndex = names.find(reader[1]);
+            double x1, y1, x2, y2;
+            if (reader.fieldCount() >= 7 && parseDouble(reader[3], x1) && parseDouble(reader[4], y1)
+                && parseDouble(reader[5], x2) && parseDouble(reader[6], y2)) {
+                setIntersectionCoordinates(fromIndex, x1, y1);
+                setIntersectionCoordinates(toIndex, x2, y2);
+            }
+            if (addRoadById(fromIndex, toIndex, weight)) {
+                report.records++;
+            }
+            else {
+                report.skipped++; // Duplicate road
+            }
+        }
+        return true;
+    }
+
+    // traffic_signal_timings.csv: Intersection,GreenTime
+    bool loadSignalTimings(const string& filename, LoadReport& report) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            int index = findIntersection(reader[0]);
+            int greenTime;
+            if (reader.fieldCount() < 2 || index == -1 || !parseInt(reader[1], greenTime) || greenTime <= 0) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            intersections[index].trafficSignal = greenTime;
+            report.records++;
+        }
+        return true;
+    }
+
+    // accidents_or_closures.csv: Intersection1,Intersection2,Status
+    // Every listed road is closed unless its status says it is open again.
+    bool loadClosures(const string& filename, LoadReport& report) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            string_view status = reader[2];
+            bool reopened = equalsIgnoreCase(status, "open") || equalsIgnoreCase(status, "reopened")
+                || equalsIgnoreCase(status, "clear") || equalsIgnoreCase(status, "cleared");
+            if (reader.fieldCount() < 2
+                || !setRoadClosed(findIntersection(reader[0]), findIntersection(reader[1]), !reopened)) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            report.records++;
+        }
+        return true;
+    }
+
+    // vehicles.csv: VehicleID,StartIntersection,EndIntersection
+    bool loadVehicles(const string& filename, LoadReport& report) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        vehicles.reserve(vehicles.size() + CsvReader::countLines(file.data(), file.size()));
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            int origin = findIntersection(reader[1]);
+            int destination = findIntersection(reader[2]);
+            if (reader.fieldCount() < 3 || origin == -1 || destination == -1) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            Vehicle vehicle;
+            vehicle.id = vehicleNames.intern(reader[0]);
+            vehicle.origin = origin;
+            vehicle.destination = destination;
+            vehicles.push_back(vehicle);
+            report.records++;
+        }
+        return true;
+    }
+
+    // emergency_vehicles.csv: VehicleID,StartIntersection,EndIntersection,Priority
+    bool loadEmergencyVehicles(const string& filename, LoadReport& report) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        emergencyVehicles.reserve(emergencyVehicles.size() + CsvReader::countLines(file.data(), file.size()));
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            int origin = findIntersection(reader[1]);
+            int destination = findIntersection(reader[2]);
+            int priority = parseEmergencyPriority(reader[3]);
+            if (reader.fieldCount() < 4 || origin == -1 || destination == -1 || priority < 0) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            EmergencyVehicle vehicle;
+            vehicle.id = vehicleNames.intern(reader[0]);
+            vehicle.origin = origin;
+            vehicle.destination = destination;
+            vehicle.priority = priority;
+            emergencyVehicles.push_back(vehicle);
+            report.records++;
+        }
+        return true;
+    }
+
+    // Write the whole road network (intersections, names, rows, weights, vehicle counts,
+    // closures and signal timings) as a binary snapshot
+    bool saveSnapshot(const string& filename) const {
+        SnapshotWriter writer;
+        writer.add(intersections);
+        names.saveSections(writer);
+        roads.saveSections(writer);
+        profiles.saveSections(writer);
+        return writer.write(filename);
+    }
+
+    // Replace the graph with a snapshot. The file is mapped copy-on-write and the arrays
+    // are used in place, so loading costs page faults rather than parsing. Vehicle lists
+    // are not part of a snapshot and are cleared, since they refer to the old intersections.
+    bool loadSnapshot(const string& filename) {
+        MappedFile file;
+        if (!file.open(filename, true)) {
+            return false;
+        }
+        SnapshotReader reader(file.mutableData(), file.size());
+        Column<Intersection> loadedIntersections;
+        NameTable loadedNames;
+        RoadNetwork loadedRoads;
+        TravelTimeProfiles loadedProfiles;
+        if (!reader.open() || !reader.next(loadedIntersections) || !loadedNames.loadSections(reader)
+            || !loadedRoads.loadSections(reader) || !loadedProfiles.loadSections(reader) || !reader.finished()
+            || (int)loadedIntersections.size() != loadedRoads.nodeCount()
+            || loadedNames.size() != loadedRoads.nodeCount()) {
+            return false;
+        }
+        for (size_t arc = 0; arc < loadedRoads.profiles.size(); ++arc) {
+            if (loadedRoads.profiles[arc] < -1 || loadedRoads.profiles[arc] >= loadedProfiles.count()) {
+                return false;
+            }
+        }
+
+        intersections.swap(loadedIntersections);
+        names.swap(loadedNames);
+        topologyVersion++;
+        roads.swap(loadedRoads);
+        profiles.swap(loadedProfiles);
+        timeBoundsBuilt = false;
+        snapshotFile.swap(file); // The previous mapping is released when 'file' goes out of scope
+        vehicles.clear();
+        emergencyVehicles.clear();
+        vehicleNames.clear();
+        activeTrees.clear();
+        resetCorridors();
+        if (publishedCount > 0) {
+            publishRoads(); // Indices now name other intersections
+        }
+        return true;
+    }
+
+    // Answer many route queries at once. Queries are grouped by start intersection so each
+    // shortest-path tree is grown only once (and only until all of its ends are settled),
+    // and the groups are spread over the worker pool, each worker with its own scratch
+    // arrays. Starts with a single end use A* when its bounds are already built.
+    // The graph must not change while a batch is running.
+    void routeBatch(const vector<RouteQuery>& queries, RouteBatch& result, bool withPaths = true) {
+        int queryCount = (int)queries.size();
+        RouteResult unreachable = { INF, 0, 0 };
+        result.routes.assign(queryCount, unreachable);
+        result.paths.clear();
+
+        // Order the valid queries by start intersection and cut them into groups
+        vector<int> order;
+        order.reserve(queryCount);
+        for (int q = 0; q < queryCount; ++q) {
+            if (isValidIndex(queries[q].start) && isValidIndex(queries[q].end)) {
+                order.push_back(q);
+            }
+        }
+        sort(order.begin(), order.end(), [&](int a, int b) { return queries[a].start < queries[b].start; });
+        vector<int> groupBegin;
+        for (int i = 0; i < (int)order.size(); ++i) {
+            if (i == 0 || queries[order[i]].start != queries[order[i - 1]].start) {
+                groupBegin.push_back(i);
+            }
+        }
+        groupBegin.push_back((int)order.size());
+
+        prepareActiveTrees();
+        bool useHeuristic = heuristicBuilt && heuristicTopology == topologyVersion;
+        int workerCount = workers->size();
+        if ((int)workerSpaces.size() < workerCount) {
+            workerSpaces.resize(workerCount);
+        }
+        vector<vector<int> > workerPaths(workerCount); // Paths are first collected per worker
+        vector<int> pathWorker(queryCount, 0);
+
+        workers->parallelFor((int)groupBegin.size() - 1, [&](int worker, int group) {
+            SearchWorkspace& ws = workerSpaces[worker];
+            int first = groupBegin[group];
+            int last = groupBegin[group + 1];
+
+            // Active sources already have their whole tree; other starts grow one
+            int slot = activeTrees.slotOf(queries[order[first]].start);
+            const int* dist;
+            const int* prev;
+            if (slot != -1) {
+                dist = activeTrees.distances(slot);
+                prev = activeTrees.parents(slot);
+            }
+            else if (useHeuristic && last - first == 1) {
+                // A single destination: A* with the bounds already built is far cheaper
+                runAStar(roads, queries[order[first]].start, queries[order[first]].end, heuristic, ws);
+                dist = ws.dist.data();
+                prev = ws.prev.data();
+            }
+            else {
+                vector<int>& ends = ws.scratch;
+                ends.clear();
+                for (int i = first; i < last; ++i) {
+                    ends.push_back(queries[order[i]].end);
+                }
+                runDijkstraToTargets(roads, queries[order[first]].start, ends.data(), (int)ends.size(), heapKind, ws);
+                dist = ws.dist.data();
+                prev = ws.prev.data();
+            }
+
+            vector<int>& paths = workerPaths[worker];
+            for (int i = first; i < last; ++i) {
+                int q = order[i];
+                RouteResult& route = result.routes[q];
+                route.distance = dist[queries[q].end];
+                if (!withPaths || route.distance == INF) {
+                    continue;
+                }
+                route.pathOffset = (int)paths.size();
+                for (int node = queries[q].end; node != -1; node = prev[node]) {
+                    paths.push_back(node);
+                }
+                reverse(paths.begin() + route.pathOffset, paths.end());
+                route.pathLength = (int)paths.size() - route.pathOffset;
+                pathWorker[q] = worker;
+            }
+        });
+
+        if (withPaths) {
+            gatherPaths(workerPaths, pathWorker, result);
+        }
+    }
+
+    // Route every vehicle loaded from vehicles.csv in one batch and report the throughput
+    void routeAllVehicles() {
+        if (vehicles.empty()) {
+            cout << "No vehicles loaded." << '\n';
+            return;
+        }
+        vector<RouteQuery> queries(vehicles.size());
+        for (size_t i = 0; i < vehicles.size(); ++i) {
+            queries[i].start = vehicles[i].origin;
+            queries[i].end = vehicles[i].destination;
+        }
+
+        RouteBatch batch;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        routeBatch(queries, batch);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        int unreachable = 0;
+        for (size_t i = 0; i < batch.routes.size(); ++i) {
+            if (batch.routes[i].distance == INF) {
+                unreachable++;
+            }
+        }
+        size_t shown = vehicles.size() < 10 ? vehicles.size() : 10;
+        for (size_t i = 0; i < shown; ++i) {
+            const RouteResult& route = batch.routes[i];
+            cout << vehicleNames.name(vehicles[i].id) << ": ";
+            if (route.distance == INF) {
+                cout << "no path\n";
+                continue;
+            }
+            cout << route.distance << " time units via";
+            for (int k = 0; k < route.pathLength; ++k) {
+                cout << " " << names.name(batch.paths[route.pathOffset + k]);
+            }
+            cout << "\n";
+        }
+        if (shown < vehicles.size()) {
+            cout << "... and " << vehicles.size() - shown << " more\n";
+        }
+        cout << "Routed " << vehicles.size() << " vehicles (" << unreachable << " unreachable) in "
+            << seconds * 1000.0 << " ms on " << workers->size() << " threads ("
+            << (seconds > 0 ? (long long)(vehicles.size() / seconds) : 0) << " queries/s)." << '\n';
+    }
+
+    static const int DEFAULT_ALTERNATIVES = 3;          // Routes a rerouted trip is spread over
+    static constexpr double DEFAULT_MAX_STRETCH = 1.5;  // Longest alternative relative to the shortest
+
+    // Share of a trip's vehicles each of its alternative routes gets: inversely
+    // proportional to the route's cost, so a route twice as long gets half as many
+    static void routeShares(const RouteResult* routes, int count, vector<double>& shares) {
+        shares.resize(count);
+        double total = 0;
+        for (int i = 0; i < count; ++i) {
+            shares[i] = 1.0 / (routes[i].distance + 1);
+            total += shares[i];
+        }
+        for (int i = 0; i < count; ++i) {
+            shares[i] /= total;
+        }
+    }
+
+    // Up to k loopless routes from startIndex to endIndex, cheapest first and none more than
+    // maxStretch times as long as the shortest; their paths go to result.paths. Returns
+    // how many were found.
+    int alternativeRoutesById(int startIndex, int endIndex, int k, double maxStretch, RouteBatch& result) {
+        result.routes.clear();
+        result.paths.clear();
+        if (!isValidIndex(startIndex) || !isValidIndex(endIndex)) {
+            return 0;
+        }
+        if (workerAlternatives.empty()) {
+            workerAlternatives.resize(1);
+        }
+        AlternativeRoutes& engine = workerAlternatives[0];
+        engine.prepareTarget(roads, endIndex, &startIndex, 1, maxStretch);
+        return engine.find(roads, startIndex, k, result.routes, result.paths);
+    }
+
+    // Route every query along one of its k best alternatives so that the vehicles of a
+    // trip spread over them by routeShares instead of all taking the same new shortest
+    // route. Query q picks the alternative that the point frac((q + 1) * golden ratio)
+    // falls into, which splits consecutive queries of one trip evenly by the shares.
+    // Queries are grouped by end intersection, so one reverse tree serves every query to
+    // that end, and the groups are spread over the worker pool. result.routes[q] is the
+    // chosen route and rank[q] its place among the alternatives (-1 if unreachable).
+    // The graph must not change while this runs.
+    void spreadRoutes(const vector<RouteQuery>& queries, int k, double maxStretch, RouteBatch& result, vector<int>& rank) {
+        int queryCount = (int)queries.size();
+        RouteResult unreachable = { INF, 0, 0 };
+        result.routes.assign(queryCount, unreachable);
+        result.paths.clear();
+        rank.assign(queryCount, -1);
+
+        // Order the valid queries by end intersection and cut them into groups
+        vector<int> order;
+        order.reserve(queryCount);
+        for (int q = 0; q < queryCount; ++q) {
+            if (isValidIndex(queries[q].start) && isValidIndex(queries[q].end)) {
+                order.push_back(q);
+            }
+        }
+        sort(order.begin(), order.end(), [&](int a, int b) { return queries[a].end < queries[b].end; });
+        vector<int> groupBegin;
+        for (int i = 0; i < (int)order.size(); ++i) {
+            if (i == 0 || queries[order[i]].end != queries[order[i - 1]].end) {
+                groupBegin.push_back(i);
+            }
+        }
+        groupBegin.push_back((int)order.size());
+
+        int workerCount = workers->size();
+        if ((int)workerAlternatives.size() < workerCount) {
+            workerAlternatives.resize(workerCount);
+        }
+        vector<vector<int> > workerPaths(workerCount);
+        vector<int> pathWorker(queryCount, 0);
+
+        workers->parallelFor((int)groupBegin.size() - 1, [&](int worker, int group) {
+            AlternativeRoutes& engine = workerAlternatives[worker];
+            int first = groupBegin[group];
+            int last = groupBegin[group + 1];
+            vector<int> starts;
+            for (int i = first; i < last; ++i) {
+                starts.push_back(queries[order[i]].start);
+            }
+            engine.prepareTarget(roads, queries[order[first]].end, starts.data(), (int)starts.size(), maxStretch);
+
+            vector<RouteResult> routes;
+            vector<int> found;
+            vector<double> shares;
+            vector<int>& paths = workerPaths[worker];
+            for (int i = first; i < last; ++i) {
+                int q = order[i];
+                found.clear();
+                int count = engine.find(roads, queries[q].start, k, routes, found);
+                if (count == 0) {
+                    continue;
+                }
+                routeShares(routes.data(), count, shares);
+                double point = fmod((q + 1) * 0.6180339887498949, 1.0);
+                int pick = 0;
+                for (double reached = shares[0]; pick + 1 < count && point >= reached; reached += shares[pick]) {
+                    pick++;
+                }
+                const RouteResult& chosen = routes[pick];
+                RouteResult& route = result.routes[q];
+                route.distance = chosen.distance;
+                route.pathOffset = (int)paths.size();
+                route.pathLength = chosen.pathLength;
+                paths.insert(paths.end(), found.begin() + chosen.pathOffset,
+                    found.begin() + chosen.pathOffset + chosen.pathLength);
+                pathWorker[q] = worker;
+                rank[q] = pick;
+            }
+        });
+        gatherPaths(workerPaths, pathWorker, result);
+    }
+
+    // Close the road between two intersections (both directions) and move the loaded
+    // vehicles whose shortest route used it onto alternatives with spreadRoutes. Returns
+    // false, leaving the road open, if there is no such road or k < 1; 'rerouted' receives the affected vehicles' new
+    // routes, in vehicle order.
+    bool rerouteAroundClosureById(int fromIndex, int toIndex, int k, double maxStretch, RerouteReport& report,
+        RouteBatch* rerouted = nullptr) {
+        report = RerouteReport();
+        if (k < 1 || !isValidIndex(fromIndex) || !isValidIndex(toIndex) || roads.findArc(fromIndex, toIndex) == -1) {
+            return false;
+        }
+
+        // Find the vehicles whose current route crosses the road in either direction
+        vector<RouteQuery> queries(vehicles.size());
+        for (size_t i = 0; i < vehicles.size(); ++i) {
+            queries[i].start = vehicles[i].origin;
+            queries[i].end = vehicles[i].destination;
+        }
+        RouteBatch before;
+        prepareHeuristic(); // Lets routeBatch use A* for starts with a single vehicle
+        routeBatch(queries, before);
+        vector<RouteQuery> affected;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const RouteResult& route = before.routes[i];
+            const int* path = before.paths.data() + route.pathOffset;
+            for (int step = 0; step + 1 < route.pathLength; ++step) {
+                if ((path[step] == fromIndex && path[step + 1] == toIndex)
+                    || (path[step] == toIndex && path[step + 1] == fromIndex)) {
+                    affected.push_back(queries[i]);
+                    break;
+                }
+            }
+        }
+        setRoadClosed(fromIndex, toIndex, true);
+        report.affected = (int)affected.size();
+
+        RouteBatch spread;
+        vector<int> rank;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        spreadRoutes(affected, k, maxStretch, spread, rank);
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        report.routeUsers.assign(max(k, 1), 0);
+        for (size_t i = 0; i < rank.size(); ++i) {
+            if (rank[i] == -1) {
+                report.stranded++;
+            }
+            else {
+                report.routeUsers[rank[i]]++;
+            }
+        }
+
+        // Compare the busiest road with what sending everyone down one route would give
+        RouteBatch shortest;
+        routeBatch(affected, shortest);
+        report.spreadPeak = busiestRoadLoad(spread);
+        report.shortestPeak = busiestRoadLoad(shortest);
+        if (rerouted) {
+            rerouted->routes.swap(spread.routes);
+            rerouted->paths.swap(spread.paths);
+        }
+        return true;
+    }
+
+    // Discrete-event simulation of the loaded vehicles. Departures are spread evenly over
+    // the first 'departureWindow' seconds and every vehicle follows its shortest route:
+    // entering a road raises its vehicle count, leaving lowers it, and crossing an
+    // intersection waits for the green of its approach. A road's travel time is its
+    // weight at the start of the run plus one second per 10 vehicles on it. A vehicle about
+    // to enter a road that closed, or whose delay grew by another quarter of its free-flow
+    // time since the route was planned, is rerouted from where it stands. Signals are retimed by the density model
+    // once per cycle; this happens lazily when a vehicle reaches one, so idle
+    // intersections cost nothing. The run ends when all vehicles have arrived or at
+    // 'timeLimit'.
+    SimulationReport simulateTraffic(int departureWindow, int timeLimit) {
+        enum { ENTER_ROAD, LEAVE_ROAD };
+
+        struct SimVehicle {
+            int routeOffset;  // Route in 'routes', start first
+            int routeLength;
+            int step;         // Index of the intersection the vehicle is at (or has just left)
+            int arc;          // Road being driven, -1 while waiting
+            int departure;
+            unsigned plannedAt; // Congestion epoch the route was planned in
+        };
+
+        SimulationReport report;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        int vehicleCount = (int)vehicles.size();
+
+        RouteBatch batch;
+        planVehicleRoutes(batch);
+        vector<int>& routes = batch.paths;
+        report.planningSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        started = chrono::steady_clock::now();
+
+        // Free-flow times are the base weights; the current weights already include the
+        // vehicles counted on each road, which the simulation adds back itself
+        vector<int> freeFlow(roads.baseWeights.begin(), roads.baseWeights.end());
+        vector<unsigned> congestedAt(roads.weights.size(), 0); // Epoch a road's delay level last rose
+        unsigned epoch = 0;
+
+        TimingWheel wheel;
+        vector<SimVehicle> fleet(vehicleCount);
+        int active = 0;
+        for (int i = 0; i < vehicleCount; ++i) {
+            const RouteResult& route = batch.routes[i];
+            SimVehicle& vehicle = fleet[i];
+            vehicle.routeOffset = route.pathOffset;
+            vehicle.routeLength = route.pathLength;
+            vehicle.step = 0;
+            vehicle.arc = -1;
+            vehicle.departure = vehicleCount > 0 ? (int)((long long)i * departureWindow / vehicleCount) : 0;
+            vehicle.plannedAt = 0;
+            if (route.distance == INF) {
+                report.stranded++;
+            }
+            else if (route.pathLength <= 1) {
+                report.arrived++; // Already at the destination
+            }
+            else {
+                wheel.schedule(vehicle.departure, i, ENTER_ROAD);
+                active++;
+            }
+        }
+        vector<int> retimeAt(intersectionCount(), -1); // End of each signal's current cycle
+
+        // Change a road's vehicle count and update its travel time to match
+        auto changeCount = [&](int from, int arc, int delta) {
+            roads.vehicleCounts[arc] += delta;
+            int weight = freeFlow[arc] + roads.vehicleCounts[arc] / CONGESTION_VEHICLES;
+            if (weight != roads.weights[arc]) {
+                bool faster = weight < roads.weights[arc];
+                if (delayLevel(weight, freeFlow[arc]) > delayLevel(roads.weights[arc], freeFlow[arc])) {
+                    congestedAt[arc] = ++epoch;
+                }
+                roads.weights[arc] = weight;
+                roadWeightChanged(from, roads.targets[arc], faster);
+            }
+        };
+
+        TimingWheel::Event event;
+        while (active > 0 && wheel.next(event)) {
+            if (event.time > timeLimit) {
+                break;
+            }
+            report.events++;
+            report.endTime = event.time;
+
+            SimVehicle& vehicle = fleet[event.subject];
+            if (event.kind == LEAVE_ROAD) {
+                int from = routes[vehicle.routeOffset + vehicle.step];
+                changeCount(from, vehicle.arc, -1);
+                vehicle.step++;
+                vehicle.arc = -1;
+                int at = routes[vehicle.routeOffset + vehicle.step];
+                if (vehicle.step == vehicle.routeLength - 1) {
+                    report.arrived++;
+                    report.totalTravelTime += event.time - vehicle.departure;
+                    active--;
+                    continue;
+                }
+                if (retimeSignal(at, event.time, retimeAt)) {
+                    report.signalChanges++;
+                }
+                wheel.schedule(event.time + signalWait(from, at, event.time), event.subject, ENTER_ROAD);
+                continue;
+            }
+
+            // ENTER_ROAD: replan first if the next road closed or got slower since planning
+            int at = routes[vehicle.routeOffset + vehicle.step];
+            int arc = roads.findArc(at, routes[vehicle.routeOffset + vehicle.step + 1]);
+            if (arc == -1 || roads.closed[arc] || congestedAt[arc] > vehicle.plannedAt) {
+                int destination = routes[vehicle.routeOffset + vehicle.routeLength - 1];
+                report.reroutes++;
+                eventLog.add(LOG_DEBUG, LOG_REROUTE, event.subject, at, destination, event.time);
+                if (runAStar(roads, at, destination, heuristic, workspace) == INF) {
+                    report.stranded++;
+                    active--;
+                    continue;
+                }
+                vehicle.routeOffset = (int)routes.size();
+                for (int node = destination; node != -1; node = workspace.prev[node]) {
+                    routes.push_back(node);
+                }
+                reverse(routes.begin() + vehicle.routeOffset, routes.end());
+                vehicle.routeLength = (int)routes.size() - vehicle.routeOffset;
+                vehicle.step = 0;
+                vehicle.plannedAt = epoch;
+                arc = roads.findArc(at, routes[vehicle.routeOffset + 1]);
+            }
+            vehicle.arc = arc;
+            changeCount(at, arc, 1);
+            wheel.schedule(event.time + roads.weights[arc], event.subject, LEAVE_ROAD);
+        }
+
+        // Vehicles still driving when the time limit hit leave the network with the run
+        for (int i = 0; i < vehicleCount; ++i) {
+            if (fleet[i].arc != -1) {
+                changeCount(routes[fleet[i].routeOffset + fleet[i].step], fleet[i].arc, -1);
+            }
+        }
+
+        report.enRoute = active;
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        eventLog.add(LOG_INFO, LOG_SIMULATION, report.arrived, report.stranded, report.enRoute, report.reroutes,
+            report.endTime);
+        return report;
+    }
+
+    // Partitioned form of simulateTraffic for large maps, same rules. GraphPartitioner
+    // splits the intersections into 'regionCount' regions (0 = one per hardware thread)
+    // and a thread runs each region: it owns the vehicles at its intersections, the
+    // counts and weights of the roads leaving them and their signals. A vehicle driving
+    // onto a road into another region is handed over through a lock-free SPSC queue,
+    // stamped with its arrival time. Regions advance in conservative time windows no
+    // longer than the quickest boundary road (which takes at least one second here), so a
+    // handoff always lands in a later window than the one it was sent in. Weight changes
+    // are applied at the barrier between windows, which keeps the map stable for reroutes
+    // and makes the outcome independent of thread timing.
+    SimulationReport simulateTrafficPartitioned(int departureWindow, int timeLimit, int regionCount) {
+        enum { ENTER_ROAD, LEAVE_ROAD, ARRIVE, RELEASE_ROAD };
+        const int LONGEST_WINDOW = 5; // Seconds; congestion is sampled at window ends
+
+        struct Handoff {
+            int time;
+            int vehicle;
+        };
+        struct SimVehicle {
+            vector<int> route; // Start first
+            int step;          // Index of the intersection the vehicle is at (or has just left)
+            int arc;           // Road being driven
+            int departure;
+            int plannedAt;     // Window the route was planned in
+        };
+        struct Region {
+            TimingWheel wheel;
+            SearchWorkspace ws;
+            vector<int> dirty;       // Owned roads whose vehicle count changed in this window
+            SimulationReport report;
+            int done;                // Vehicles that arrived or got stranded here
+            int publishedDone;       // 'done' as of the last barrier
+        };
+
+        SimulationReport total;
+        if (regionCount <= 0) {
+            regionCount = workers->size();
+        }
+        regionCount = max(1, min(regionCount, max(intersectionCount(), 1)));
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        RouteBatch batch;
+        planVehicleRoutes(batch);
+        total.planningSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        started = chrono::steady_clock::now();
+        vector<int> region = GraphPartitioner::partition(roads, regionCount);
+        total.partitionSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        total.regions = regionCount;
+        total.boundaryRoads = GraphPartitioner::cutSize(roads, region);
+
+        // Window length: the quickest road between two regions. Free-flow times are the base
+        // weights, as in simulateTraffic.
+        vector<int> freeFlow(roads.baseWeights.begin(), roads.baseWeights.end());
+        int lookahead = LONGEST_WINDOW;
+        for (int u = 0; u < intersectionCount(); ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (region[roads.targets[arc]] != region[u]) {
+                    lookahead = min(lookahead, max(freeFlow[arc], 1));
+                }
+            }
+        }
+
+        started = chrono::steady_clock::now();
+        vector<Region> regions(regionCount);
+        vector<unique_ptr<SpscQueue<Handoff> > > queues(regionCount * regionCount); // [from * count + to]
+        for (size_t i = 0; i < queues.size(); ++i) {
+            queues[i].reset(new SpscQueue<Handoff>());
+        }
+        vector<SimVehicle> fleet(vehicles.size());
+        int routable = 0;
+        for (size_t i = 0; i < vehicles.size(); ++i) {
+            const RouteResult& route = batch.routes[i];
+            SimVehicle& vehicle = fleet[i];
+            vehicle.route.assign(batch.paths.begin() + route.pathOffset,
+                batch.paths.begin() + route.pathOffset + route.pathLength);
+            vehicle.step = 0;
+            vehicle.arc = -1;
+            vehicle.departure = (int)((long long)i * departureWindow / (long long)vehicles.size());
+            vehicle.plannedAt = 0;
+            if (route.distance == INF) {
+                total.stranded++;
+            }
+            else if (route.pathLength <= 1) {
+                total.arrived++;
+            }
+            else {
+                regions[region[vehicle.route[0]]].wheel.schedule(vehicle.departure, (int)i, ENTER_ROAD);
+                routable++;
+            }
+        }
+        for (int r = 0; r < regionCount; ++r) {
+            regions[r].done = 0;
+            regions[r].publishedDone = 0;
+        }
+        vector<int> congestedAt(roads.weights.size(), 0); // Window after which a road's delay level rose
+        vector<unsigned char> isDirty(roads.weights.size(), 0);
+        vector<int> retimeAt(intersectionCount(), -1);
+        vector<int> weightBefore(roads.weights.begin(), roads.weights.end());
+        SpinBarrier barrier(regionCount);
+        long long lastWindow = (long long)timeLimit + 1;
+
+        auto runRegion = [&](int r) {
+            Region& me = regions[r];
+            SimulationReport& report = me.report;
+
+            auto countChange = [&](int arc, int delta) {
+                roads.vehicleCounts[arc] += delta;
+                if (!isDirty[arc]) {
+                    isDirty[arc] = 1;
+                    me.dirty.push_back(arc);
+                }
+            };
+            // The vehicle reached the intersection at its current step
+            auto arrive = [&](int index, int now) {
+                SimVehicle& vehicle = fleet[index];
+                int at = vehicle.route[vehicle.step];
+                if (vehicle.step == (int)vehicle.route.size() - 1) {
+                    report.arrived++;
+                    report.totalTravelTime += now - vehicle.departure;
+                    me.done++;
+                    return;
+                }
+                if (retimeSignal(at, now, retimeAt)) {
+                    report.signalChanges++;
+                }
+                me.wheel.schedule(now + signalWait(vehicle.route[vehicle.step - 1], at, now), index, ENTER_ROAD);
+            };
+
+            for (int window = 0; ; ++window) {
+                long long windowStart = (long long)window * lookahead;
+                int windowEnd = (int)min(windowStart + lookahead, lastWindow);
+                for (int from = 0; from < regionCount; ++from) {
+                    Handoff handoff;
+                    while (queues[from * regionCount + r]->pop(handoff)) {
+                        me.wheel.schedule(handoff.time, handoff.vehicle, ARRIVE);
+                    }
+                }
+
+                TimingWheel::Event event;
+                while (me.wheel.nextBefore(windowEnd, event)) {
+                    report.events++;
+                    report.endTime = event.time;
+                    if (event.kind == RELEASE_ROAD) {
+                        countChange(event.subject, -1); // The vehicle itself went to another region
+                        continue;
+                    }
+                    if (event.kind == ARRIVE) {
+                        arrive(event.subject, event.time);
+                        continue;
+                    }
+                    SimVehicle& vehicle = fleet[event.subject];
+                    if (event.kind == LEAVE_ROAD) {
+                        countChange(vehicle.arc, -1);
+                        vehicle.step++;
+                        arrive(event.subject, event.time);
+                        continue;
+                    }
+
+                    // ENTER_ROAD: replan first if the next road closed or got slower since planning
+                    int at = vehicle.route[vehicle.step];
+                    int arc = roads.findArc(at, vehicle.route[vehicle.step + 1]);
+                    if (arc == -1 || roads.closed[arc] || congestedAt[arc] > vehicle.plannedAt) {
+                        int destination = vehicle.route.back();
+                        report.reroutes++;
+                        eventLog.add(LOG_DEBUG, LOG_REROUTE, event.subject, at, destination, event.time);
+                        if (runAStar(roads, at, destination, heuristic, me.ws) == INF) {
+                            report.stranded++;
+                            me.done++;
+                            continue;
+                        }
+                        vehicle.route.clear();
+                        for (int node = destination; node != -1; node = me.ws.prev[node]) {
+                            vehicle.route.push_back(node);
+                        }
+                        reverse(vehicle.route.begin(), vehicle.route.end());
+                        vehicle.step = 0;
+                        vehicle.plannedAt = window;
+                        arc = roads.findArc(at, vehicle.route[1]);
+                    }
+                    vehicle.arc = arc;
+                    countChange(arc, 1);
+                    int to = roads.targets[arc];
+                    if (region[to] == r) {
+                        me.wheel.schedule(event.time + roads.weights[arc], event.subject, LEAVE_ROAD);
+                    }
+                    else {
+                        int arrival = event.time + max(roads.weights[arc], 1);
+                        me.wheel.schedule(arrival, arc, RELEASE_ROAD);
+                        vehicle.step++;
+                        Handoff handoff = { arrival, event.subject };
+                        queues[r * regionCount + region[to]]->push(handoff); // 'vehicle' is not ours any more
+                    }
+                }
+                barrier.wait();
+
+                // Apply this window's congestion to the roads this region owns
+                for (size_t i = 0; i < me.dirty.size(); ++i) {
+                    int arc = me.dirty[i];
+                    isDirty[arc] = 0;
+                    int weight = freeFlow[arc] + roads.vehicleCounts[arc] / CONGESTION_VEHICLES;
+                    if (delayLevel(weight, freeFlow[arc]) > delayLevel(roads.weights[arc], freeFlow[arc])) {
+                        congestedAt[arc] = window + 1;
+                    }
+                    roads.weights[arc] = weight;
+                }
+                me.dirty.clear();
+                me.publishedDone = me.done;
+                barrier.wait();
+
+                int done = 0;
+                for (int i = 0; i < regionCount; ++i) {
+                    done += regions[i].publishedDone;
+                }
+                if (done == routable || windowEnd >= lastWindow) {
+                    break;
+                }
+            }
+        };
+
+        vector<thread> threads;
+        for (int r = 1; r < regionCount; ++r) {
+            threads.push_back(thread(runRegion, r));
+        }
+        runRegion(0);
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+
+        int done = 0;
+        for (int r = 0; r < regionCount; ++r) {
+            const SimulationReport& report = regions[r].report;
+            total.events += report.events;
+            total.endTime = max(total.endTime, report.endTime);
+            total.arrived += report.arrived;
+            total.stranded += report.stranded;
+            total.reroutes += report.reroutes;
+            total.signalChanges += report.signalChanges;
+            total.totalTravelTime += report.totalTravelTime;
+            done += regions[r].done;
+        }
+        total.enRoute = routable - done;
+
+        // Vehicles still driving when the time limit hit leave the network with the run
+        for (int r = 0; r < regionCount; ++r) {
+            TimingWheel::Event event;
+            while (regions[r].wheel.next(event)) {
+                int arc = event.kind == LEAVE_ROAD ? fleet[event.subject].arc
+                    : event.kind == RELEASE_ROAD ? event.subject : -1;
+                if (arc != -1) {
+                    roads.vehicleCounts[arc]--;
+                    roads.weights[arc] = freeFlow[arc] + roads.vehicleCounts[arc] / CONGESTION_VEHICLES;
+                }
+            }
+        }
+        total.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        // Let the hierarchy and the active-source trees catch up with the new weights
+        for (int u = 0; u < intersectionCount(); ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (roads.weights[arc] != weightBefore[arc]) {
+                    roadWeightChanged(u, roads.targets[arc], roads.weights[arc] < weightBefore[arc]);
+                }
+            }
+        }
+        eventLog.add(LOG_INFO, LOG_SIMULATION, total.arrived, total.stranded, total.enRoute, total.reroutes,
+            total.endTime);
+        return total;
+    }
+
+    // Run the simulation (partitioned if 'regionCount' is not 1) and print its report
+    void runSimulation(int departureWindow, int timeLimit, int regionCount = 1) {
+        if (vehicles.empty()) {
+            cout << "No vehicles loaded." << '\n';
+            return;
+        }
+        SimulationReport report = regionCount == 1 ? simulateTraffic(departureWindow, timeLimit)
+            : simulateTrafficPartitioned(departureWindow, timeLimit, regionCount);
+        cout << "Planned " << vehicles.size() << " routes in " << report.planningSeconds * 1000.0 << " ms." << '\n';
+        if (report.regions > 1) {
+            cout << "Partitioned into " << report.regions << " regions in " << report.partitionSeconds * 1000.0
+                << " ms (" << report.boundaryRoads << " of " << roads.arcCount() << " roads cross a boundary)." << '\n';
+        }
+        cout << "Simulated " << report.endTime << " seconds in " << report.seconds * 1000.0 << " ms: "
+            << report.events << " events (" << (report.seconds > 0 ? (long long)(report.events / report.seconds) : 0)
+            << " events/s)." << '\n';
+        cout << "Arrived: " << report.arrived << ", still en route: " << report.enRoute
+            << ", stranded: " << report.stranded << ", reroutes: " << report.reroutes
+            << ", signal retimings: " << report.signalChanges << '\n';
+        if (report.arrived > 0) {
+            cout << "Average travel time: " << (double)report.totalTravelTime / report.arrived << " seconds." << '\n';
+        }
+    }
+
+    const vector<Vehicle>& getVehicles() const { return vehicles; }
+
+    // The trip of every loaded vehicle, in vehicles.csv order
+    void vehicleTrips(vector<RouteQuery>& trips) const {
+        trips.resize(vehicles.size());
+        for (size_t i = 0; i < vehicles.size(); ++i) {
+            trips[i].start = vehicles[i].origin;
+            trips[i].end = vehicles[i].destination;
+        }
+    }
+    const vector<EmergencyVehicle>& getEmergencyVehicles() const { return emergencyVehicles; }
+    string_view vehicleName(int id) const { return vehicleNames.name(id); }
+
+    void adjustGreenLightDuration(int intersectionIndex) {
+        int newDuration = updateGreenLightById(intersectionIndex);
+        if (intersections[intersectionIndex].emergencyOverride) {
+            cout << "Emergency override: Green light at " << names.name(intersectionIndex)
+                << " is fixed to " << newDuration << " seconds." << '\n';
+            return;
+        }
+        cout << "Adjusted green light duration at " << names.name(intersectionIndex)
+            << " to " << newDuration << " seconds due to traffic density." << '\n';
+    }
+
+    // Same as adjustGreenLightDuration without the message; returns the new green time
+    int updateGreenLightById(int intersectionIndex) {
+        ScopedTimer timer(TIME_SIGNAL_UPDATE);
+        metrics.add(COUNT_SIGNAL_UPDATES);
+        // An emergency override fixes the green at 10 seconds; otherwise it follows traffic density
+        int newDuration = intersections[intersectionIndex].emergencyOverride ? 10 : densityGreenTime(intersectionIndex);
+        intersections[intersectionIndex].trafficSignal = newDuration;
+        eventLog.add(LOG_DEBUG, LOG_SIGNAL_CHANGED, intersectionIndex, newDuration);
+        return newDuration;
+    }
+
+    // One control cycle of network-wide signal optimization: every signalized intersection
+    // gets a max-pressure plan (see planSignal) from the current vehicle counts. Unlike the
+    // per-intersection density rule, a plan looks at the queues coming in and at how
+    // loaded the neighbours it would feed are, splits the cycle unevenly between the
+    // approaches, and caps the cycle length. Blocks of intersections are planned in
+    // parallel on the worker pool. Signals under an emergency override are left alone,
+    // and the density rule takes over again wherever vehicle counts are updated.
+    SignalPlanReport optimizeSignals() {
+        ScopedTimer timer(TIME_SIGNAL_PLAN);
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        int blockCount = (intersectionCount() + SIGNAL_BLOCK - 1) / SIGNAL_BLOCK;
+        vector<SignalPlanReport> blocks(blockCount);
+        workers->parallelFor(blockCount, [&](int, int block) {
+            int last = min((block + 1) * SIGNAL_BLOCK, intersectionCount());
+            for (int at = block * SIGNAL_BLOCK; at < last; ++at) {
+                int outcome = planSignal(at);
+                if (outcome != -1) {
+                    blocks[block].signals++;
+                    blocks[block].changed += outcome;
+                }
+            }
+        });
+        SignalPlanReport report;
+        for (int block = 0; block < blockCount; ++block) {
+            report.signals += blocks[block].signals;
+            report.changed += blocks[block].changed;
+        }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        metrics.add(COUNT_SIGNAL_UPDATES, report.signals);
+        eventLog.add(LOG_INFO, LOG_SIGNAL_PLAN, report.signals, report.changed, (int)(report.seconds * 1e6));
+        return report;
+    }
+
+    // Method to run one signal optimization cycle and report it
+    void optimizeSignalTimings() {
+        SignalPlanReport report = optimizeSignals();
+        cout << "Optimized " << report.signals << " signalized intersections (max pressure): " << report.changed
+            << " plans changed in " << report.seconds * 1000 << " ms." << '\n';
+    }
+
+    static const int ASSIGNMENT_STEPS = 200;        // Frank-Wolfe steps assignTraffic takes at most
+    static constexpr double ASSIGNMENT_GAP = 1e-3;  // Relative gap at which assignTraffic stops
+
+    // Solve the static traffic assignment of 'trips' to user equilibrium (see
+    // TrafficAssignment) and make it the state of the network: every road's vehicle count
+    // becomes its equilibrium flow and its weight the BPR travel time at that flow, with
+    // a capacity of CONGESTION_VEHICLES vehicles per second of free-flow time (the count
+    // at which the linear congestion rule would double the road's time). Closed roads
+    // get no vehicles. Unlike adjustRoadWeightForCongestion, the result does not depend
+    // on the order in which roads are looked at. Signals are retimed for the new counts;
+    // later count updates go back to the linear rule for the roads they touch.
+    AssignmentReport assignTraffic(const vector<RouteQuery>& trips, int maxSteps = ASSIGNMENT_STEPS,
+        double targetGap = ASSIGNMENT_GAP) {
+        ScopedTimer timer(TIME_ASSIGNMENT);
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        AssignmentReport report;
+        report.trips = (int)trips.size();
+        for (size_t i = 0; i < trips.size(); ++i) {
+            if (!isValidIndex(trips[i].start) || !isValidIndex(trips[i].end)) {
+                report.unroutable++;
+            }
+        }
+        TrafficAssignment assignment;
+        assignment.setDemand(intersectionCount(), trips);
+        report.steps = assignment.solve(roads, CONGESTION_VEHICLES, *workers, maxSteps, targetGap);
+        report.unroutable += (int)assignment.unroutable();
+        report.relativeGap = assignment.relativeGap();
+        report.travelTime = assignment.totalTravelTime();
+
+        signalDirty.resize(intersectionCount(), 0);
+        for (int u = 0; u < intersectionCount(); ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                int count = roads.closed[arc] ? 0 : (int)lround(assignment.roadFlow(arc));
+                if (count != roads.vehicleCounts[arc]) {
+                    roads.vehicleCounts[arc] = count;
+                    markSignalDirty(u);
+                    report.countsChanged++;
+                }
+                int weight = (int)min((double)INF / 2, floor(assignment.roadTime(arc) + 0.5));
+                if (!roads.closed[arc] && weight != roads.weights[arc]) {
+                    bool faster = weight < roads.weights[arc];
+                    roads.weights[arc] = weight;
+                    roadWeightChanged(u, roads.targets[arc], faster);
+                    report.weightsChanged++;
+                }
+            }
+        }
+        metrics.add(COUNT_SIGNAL_UPDATES, dirtyIntersections.size());
+        report.signalsChanged = refreshDirtySignals();
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        eventLog.add(LOG_INFO, LOG_ASSIGNMENT, report.trips - report.unroutable, report.unroutable, report.steps,
+            (int)(report.relativeGap * 1e6), (int)(report.seconds * 1000));
+        return report;
+    }
+
+    // Method to assign the vehicles of vehicles.csv to user equilibrium and report it
+    void assignVehicleTraffic() {
+        if (vehicles.empty()) {
+            cout << "No vehicles loaded." << '\n';
+            return;
+        }
+        vector<RouteQuery> trips;
+        vehicleTrips(trips);
+        AssignmentReport report = assignTraffic(trips);
+        cout << "Assigned " << report.trips - report.unroutable << " vehicles to user equilibrium in " << report.steps
+            << " Frank-Wolfe steps (relative gap " << report.relativeGap * 100 << "%, " << report.seconds * 1000
+            << " ms)." << '\n';
+        if (report.unroutable > 0) {
+            cout << report.unroutable << " vehicles have no open route to their destination." << '\n';
+        }
+        cout << "Total travel time: " << report.travelTime << " vehicle-seconds. " << report.countsChanged
+            << " vehicle counts, " << report.weightsChanged << " road weights and " << report.signalsChanged
+            << " signal timings changed." << '\n';
+
+        // The busiest roads at equilibrium
+        vector<RoadCount> busiest;
+        for (int u = 0; u < intersectionCount(); ++u) {
+            for (int arc = roads.rowBegin(u); arc < roads.rowEnd(u); ++arc) {
+                if (roads.vehicleCounts[arc] > 0) {
+                    busiest.push_back(RoadCount{ u, roads.targets[arc], roads.vehicleCounts[arc] });
+                }
+            }
+        }
+        size_t shown = min(busiest.size(), (size_t)5);
+        partial_sort(busiest.begin(), busiest.begin() + shown, busiest.end(),
+            [](const RoadCount& a, const RoadCount& b) { return a.count > b.count; });
+        for (size_t i = 0; i < shown; ++i) {
+            int arc = roads.findArc(busiest[i].from, busiest[i].to);
+            cout << "  " << names.name(busiest[i].from) << " -> " << names.name(busiest[i].to) << ": "
+                << busiest[i].count << " vehicles, travel time " << roads.weights[arc] << " (free flow "
+                << roads.baseWeights[arc] << ")" << '\n';
+        }
+    }
+
+
+
+    // Public method to access the vehicle count for a specific road
+    int getVehicleCount(int fromIndex, int toIndex) {
+        if (fromIndex < 0 || fromIndex >= intersectionCount() || toIndex < 0 || toIndex >= intersectionCount()) {
+            return 0;
+        }
+        int arc = roads.findArc(fromIndex, toIndex);
+        return arc == -1 ? 0 : roads.vehicleCounts[arc];
+    }
+    void setVehicleCount(int fromIndex, int toIndex, int count)
+    {
+        // Ensure the indices are valid
+        if (fromIndex < 0 || fromIndex >= intersectionCount() || toIndex < 0 || toIndex >= intersectionCount()) {
+            cout << "Invalid intersection indices." << '\n';
+            return;
+        }
+
+        int forwardArc = roads.findArc(fromIndex, toIndex);
+        int reverseArc = roads.findArc(toIndex, fromIndex);
+        if (forwardArc == -1 && reverseArc == -1) {
+            cout << "Road not found: " << names.name(fromIndex)
+                << " to " << names.name(toIndex) << '\n';
+            return;
+        }
+
+        // Update the vehicle count for the road from 'fromIndex' to 'toIndex'
+        if (forwardArc != -1) {
+            roads.vehicleCounts[forwardArc] = count;
+        }
+
+        // If the roads are bidirectional, set the reverse road count as well
+        if (reverseArc != -1) {
+            roads.vehicleCounts[reverseArc] = count;
+        }
+
+        eventLog.add(LOG_DEBUG, LOG_VEHICLE_COUNT, fromIndex, toIndex, count);
+
+        // Output for debugging purposes
+        cout << "Vehicle count from " << names.name(fromIndex)
+            << " to " << names.name(toIndex)
+            << " set to " << count << '\n';
+
+        // Adjust the green light duration based on the vehicle counts
+        adjustGreenLightDuration(fromIndex);
+        adjustGreenLightDuration(toIndex);
+    }
+
+    // Method to apply a file of vehicle count readings (From,To,Count) as one batch;
+    // returns false if the file cannot be opened
+    bool applyVehicleCountFeed(const string& filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cout << "Error: Unable to open file " << filename << '\n';
+            return false;
+        }
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        vector<RoadCount> readings;
+        readings.reserve(CsvReader::countLines(file.data(), file.size()));
+        LoadReport parsed;
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            RoadCount reading;
+            reading.from = findIntersection(reader[0]);
+            reading.to = findIntersection(reader[1]);
+            if (reader.fieldCount() < 3 || !parseInt(reader[2], reading.count)) {
+                countSkippedRow(reader, parsed);
+                continue;
+            }
+            readings.push_back(reading);
+        }
+        CountUpdateReport report = applyVehicleCounts(readings);
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        cout << "Applied " << report.applied << " vehicle counts in " << milliseconds << " ms";
+        if (parsed.skipped + report.skipped > 0) {
+            cout << " (" << parsed.skipped + report.skipped << " rows skipped)";
+        }
+        cout << "." << '\n';
+        cout << report.weightsChanged << " road weights and " << report.signalsChanged
+            << " signal timings changed." << '\n';
+        return true;
+    }
+
+
+
+
+    int findIntersection(string_view name) const {
+        ScopedTimer timer(TIME_NAME_LOOKUP);
+        metrics.add(COUNT_NAME_LOOKUPS);
+        return names.find(name); // Intersection index, or -1 if not found
+    }
+
+    string_view intersectionName(int index) const {
+        return names.name(index);
+    }
+
+    // Map position of an intersection; false if it has no coordinates
+    bool intersectionPosition(int index, MapPoint& point) const {
+        if (!isValidIndex(index) || !intersections[index].hasCoordinates) {
+            return false;
+        }
+        point.x = intersections[index].x;
+        point.y = intersections[index].y;
+        return true;
+    }
+
+    void adjustRoadWeightForCongestion(int fromIndex, int toIndex) {
+        ScopedTimer timer(TIME_CONGESTION_UPDATE);
+        metrics.add(COUNT_CONGESTION_UPDATES);
+        int arc = roads.findArc(fromIndex, toIndex);
+        if (arc == -1) {
+            return;
+        }
+
+        // The congestion term replaces the previous one instead of piling up on it
+        int weight = roads.baseWeights[arc] + roads.vehicleCounts[arc] / CONGESTION_VEHICLES;
+
+        if (weight != roads.weights[arc]) {
+            bool faster = weight < roads.weights[arc];
+            roads.weights[arc] = weight;
+            roadWeightChanged(fromIndex, toIndex, faster);
+            eventLog.add(LOG_INFO, LOG_ROAD_WEIGHT, fromIndex, toIndex, roads.weights[arc]);
+            cout << (faster ? "Decreased" : "Increased") << " weight on road from " << names.name(fromIndex)
+                << " to " << names.name(toIndex) << " due to congestion."
+                << " New weight: " << roads.weights[arc] << '\n';
+        }
+    }
+
+
+    // Method to recalculate the route when rerouting is required
+    void rerouteTraffic(int fromIndex, int toIndex) {
+        ScopedTimer timer(TIME_REROUTE);
+        metrics.add(COUNT_REROUTES);
+        // Adjust the road weight based on congestion
+        adjustRoadWeightForCongestion(fromIndex, toIndex);
+
+        // Spread the traffic over the best routes instead of moving the jam to the next road
+        cout << "Recalculating routes due to traffic congestion...\n";
+        printAlternativeRoutes(fromIndex, toIndex, DEFAULT_ALTERNATIVES);
+    }
+
+
+    void addIntersection(const string& name) {
+        // Check if the intersection already exists
+        if (findIntersection(name) != -1) {
+            cout << "Intersection already exists: " << name << '\n';
+            return;
+        }
+        // Add the new intersection
+        internIntersection(name);
+        cout << "Intersection added: " << name << '\n';
+    }
+
+
+
+    // Method to add a road between two intersections
+    void addRoad(const string& from, const string& to, int weight) {
+        // Find the indices of the intersections
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+
+        // Check if one or both intersections do not exist
+        if (fromIndex == -1) {
+            cout << "Intersection not found: " << from << '\n';
+            return;
+        }
+        if (toIndex == -1) {
+            cout << "Intersection not found: " << to << '\n';
+            return;
+        }
+
+        if (weight < 0) {
+            cout << "Road weight must not be negative." << '\n';
+            return;
+        }
+
+        // Check for duplicate roads (optional)
+        if (roads.findArc(fromIndex, toIndex) != -1) {
+            cout << "Road already exists between " << from << " and " << to << '\n';
+            return;
+        }
+
+        addRoadById(fromIndex, toIndex, weight);
+
+        // Feedback to the user
+        cout << "Road added between " << from << " and " << to << " with weight " << weight << '\n';
+    }
+
+
+    // Method to update the weight (time) of an existing road
+    void updateRoadWeight(const string& from, const string& to, int newWeight) {
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+
+        if (fromIndex == -1 || toIndex == -1) {
+            cout << "One or both intersections not found: " << from << ", " << to << '\n';
+            return;
+        }
+
+        if (newWeight < 0) {
+            cout << "Road weight must not be negative." << '\n';
+            return;
+        }
+
+        if (!updateRoadWeightById(fromIndex, toIndex, newWeight)) {
+            cout << "Road not found: " << from << " to " << to << '\n';
+            return;
+        }
+        cout << "Updated road weight from " << from << " to " << to << " to " << newWeight << '\n';
+    }
+    // Method to display current traffic signal timers
+    void displaySignalTimers() {
+        cout << "\nCurrent Traffic Signal Timers:\n";
+        for (int i = 0; i < intersectionCount(); ++i) {
+            cout << names.name(i) << " - Green Light Duration: "
+                << intersections[i].trafficSignal << " seconds.\n";
+        }
+    }
+
+
+    // Method to calculate the shortest path using Dijkstra's Algorithm; prints the route and
+    // returns it (not found if an intersection is unknown or the end cannot be reached)
+    Route dijkstra(const string& startName, const string& endName) {
+        int startIndex = findIntersection(startName);
+        int endIndex = findIntersection(endName);
+
+        // If one or both intersections are not found
+        if (startIndex == -1 || endIndex == -1) {
+            cout << "Start or end intersection not found: " << startName << ", " << endName << '\n';
+            return Route();
+        }
+
+        return dijkstraById(startIndex, endIndex);
+    }
+
+    // Same as dijkstra, for callers that already hold intersection indices
+    Route dijkstraById(int startIndex, int endIndex) {
+        return dijkstraById(startIndex, endIndex, routingAlgorithm);
+    }
+
+    // Print the route found by a specific algorithm
+    Route dijkstraById(int startIndex, int endIndex, RoutingAlgorithm algorithm) {
+        string_view startName = names.name(startIndex);
+        string_view endName = names.name(endIndex);
+
+        // Show green light durations for the start and end intersections
+        cout << "Green light duration at " << startName << ": "
+            << intersections[startIndex].trafficSignal << " seconds." << '\n';
+        cout << "Green light duration at " << endName << ": "
+            << intersections[endIndex].trafficSignal << " seconds." << '\n';
+
+        Route route = findRoute(startIndex, endIndex, algorithm);
+        eventLog.add(LOG_INFO, LOG_ROUTE, startIndex, endIndex, route.distance, lastSettled, algorithm);
+
+        // If no path found to the destination, print the error message
+        if (!route.found()) {
+            cout << "No path found from " << startName << " to " << endName
+                << " (" << lastSettled << " intersections settled)" << '\n';
+            return route;
+        }
+
+        // Print the shortest path information
+        cout << "Shortest path from " << startName << " to " << endName << " is " << route.distance << " time units." << '\n';
+        cout << "Path: ";
+        printPath(route.intersections);
+        cout << "\nIntersections settled: " << lastSettled << " of " << intersectionCount() << '\n';
+        return route;
+    }
+
+    // Shortest route between two intersections with the arrival time at each of them,
+    // without any messages
+    Route findRoute(int startIndex, int endIndex, RoutingAlgorithm algorithm) {
+        Route route;
+        route.start = startIndex;
+        route.end = endIndex;
+        route.distance = shortestPathById(startIndex, endIndex, algorithm, &route.intersections);
+        if (!route.found()) {
+            route.intersections.clear();
+            return route;
+        }
+        route.arrival.resize(route.intersections.size());
+        route.arrival[0] = 0;
+        for (size_t i = 1; i < route.intersections.size(); ++i) {
+            int arc = roads.findArc(route.intersections[i - 1], route.intersections[i]);
+            route.arrival[i] = route.arrival[i - 1] + roads.weights[arc];
+        }
+        return route;
+    }
+
+
+    // Method to find the earliest arrival for a vehicle leaving at a given time of day
+    void timeDependentRoute(const string& startName, const string& endName, int departure) {
+        int startIndex = findIntersection(startName);
+        int endIndex = findIntersection(endName);
+        if (startIndex == -1 || endIndex == -1) {
+            cout << "Start or end intersection not found: " << startName << ", " << endName << '\n';
+            return;
+        }
+
+        vector<int> path;
+        int arrival = earliestArrivalById(startIndex, endIndex, departure, &path);
+        if (arrival == INF) {
+            cout << "No path found from " << startName << " to " << endName
+                << " (" << lastSettled << " roads settled)" << '\n';
+            return;
+        }
+
+        // Replay the route to tell the time spent at red lights from the time on the road
+        int time = departure;
+        int waiting = 0;
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            if (i > 0) {
+                int wait = signalWait(path[i - 1], path[i], time);
+                waiting += wait;
+                time += wait;
+            }
+            time += roadTravelTime(roads, profiles, roads.findArc(path[i], path[i + 1]), time);
+        }
+
+        cout << "Leaving " << startName << " at " << formatClockTime(departure) << ", arrive at " << endName
+            << " at " << formatClockTime(arrival) << " (" << arrival - departure << " seconds, "
+            << waiting << " of them waiting at signals)." << '\n';
+        cout << "Path: ";
+        printPath(path);
+        cout << "\nRoads settled: " << lastSettled << '\n';
+    }
+
+    // Method to load travel-time profiles from a CSV file with rows
+    // Intersection1,Intersection2,Time,TravelTime where Time is H:MM or H:MM:SS. The rows
+    // of one road follow each other; together they replace the road's previous profile.
+    // Returns false if the file cannot be opened.
+    bool loadTravelTimeProfiles(const string& filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cout << "Error: Unable to open file " << filename << '\n';
+            return false;
+        }
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        LoadReport report;
+        int rejected = 0;
+        int fromIndex = -1;
+        int toIndex = -1;
+        vector<pair<int, int> > points;
+
+        // Hand the collected breakpoints to the current road
+        auto finishRoad = [&]() {
+            if (points.empty()) {
+                return;
+            }
+            sort(points.begin(), points.end());
+            if (setRoadProfileById(fromIndex, toIndex, points)) {
+                report.records++;
+            }
+            else {
+                rejected++;
+            }
+            points.clear();
+        };
+
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            int from = findIntersection(reader[0]);
+            int to = findIntersection(reader[1]);
+            int time, travelTime;
+            if (reader.fieldCount() < 4 || from == -1 || to == -1 || !parseClockTime(reader[2], time)
+                || !parseInt(reader[3], travelTime)) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            if (from != fromIndex || to != toIndex) {
+                finishRoad();
+                fromIndex = from;
+                toIndex = to;
+            }
+            points.push_back(make_pair(time, travelTime));
+        }
+        finishRoad();
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        cout << "Loaded travel-time profiles for " << report.records << " roads in " << milliseconds << " ms ("
+            << profiles.count() << " distinct profiles, " << profiles.pointCount() << " breakpoints)." << '\n';
+        if (report.skipped > 0) {
+            cout << report.skipped << " rows skipped." << '\n';
+        }
+        if (rejected > 0) {
+            cout << rejected << " roads rejected: missing road, repeated time or a profile that falls"
+                << " faster than time passes." << '\n';
+        }
+        return true;
+    }
+
+
+    // Method to show the alternative routes between two intersections and the share of
+    // traffic each would get
+    void printAlternativeRoutes(int startIndex, int endIndex, int k) {
+        RouteBatch alternatives;
+        int count = alternativeRoutesById(startIndex, endIndex, k, DEFAULT_MAX_STRETCH, alternatives);
+        if (count == 0) {
+            cout << "No path found from " << names.name(startIndex) << " to " << names.name(endIndex) << '\n';
+            return;
+        }
+        vector<double> shares;
+        routeShares(alternatives.routes.data(), count, shares);
+        for (int i = 0; i < count; ++i) {
+            const RouteResult& route = alternatives.routes[i];
+            cout << "Route " << i + 1 << ": " << route.distance << " time units, "
+                << (int)(shares[i] * 100 + 0.5) << "% of traffic via";
+            for (int step = 0; step < route.pathLength; ++step) {
+                cout << " " << names.name(alternatives.paths[route.pathOffset + step]);
+            }
+            cout << '\n';
+        }
+    }
+
+    // Method to close a road and spread the vehicles that used it over alternative routes
+    void rerouteAroundClosure(const string& from, const string& to, int k) {
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+        if (fromIndex == -1 || toIndex == -1) {
+            cout << "One or both intersections not found: " << from << ", " << to << '\n';
+            return;
+        }
+
+        RerouteReport report;
+        if (!rerouteAroundClosureById(fromIndex, toIndex, k, DEFAULT_MAX_STRETCH, report)) {
+            cout << "Road not found: " << from << " to " << to << '\n';
+            return;
+        }
+        cout << "Road from " << from << " to " << to << " is now closed; " << report.affected << " of "
+            << vehicles.size() << " vehicles were routed over it." << '\n';
+        if (report.affected == 0) {
+            return;
+        }
+        cout << "Alternatives found in " << report.seconds * 1000.0 << " ms. Vehicles per route:";
+        for (size_t i = 0; i < report.routeUsers.size(); ++i) {
+            cout << " " << report.routeUsers[i];
+        }
+        if (report.stranded > 0) {
+            cout << " (" << report.stranded << " without a route)";
+        }
+        cout << '\n';
+        cout << "Busiest road carries " << report.spreadPeak << " rerouted vehicles (" << report.shortestPeak
+            << " if all took their new shortest route)." << '\n';
+    }
+
+    // Method to remove a road (both directions) from the network
+    void removeRoad(const string& from, const string& to) {
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+
+        if (fromIndex == -1 || toIndex == -1) {
+            cout << "One or both intersections not found: " << from << ", " << to << '\n';
+            return;
+        }
+
+        if (!removeRoadById(fromIndex, toIndex)) {
+            cout << "Road not found: " << from << " to " << to << '\n';
+            return;
+        }
+
+        cout << "Road between " << from << " and " << to << " removed." << '\n';
+    }
+
+    // Method to simulate road closure
+    void closeRoad(const string& from, const string& to) {
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+
+        if (fromIndex == -1 || toIndex == -1) {
+            cout << "One or both intersections not found: " << from << ", " << to << '\n';
+            return;
+        }
+
+        if (!setRoadClosed(fromIndex, toIndex, true)) {
+            cout << "Road not found: " << from << " to " << to << '\n';
+            return;
+        }
+
+        cout << "Road from " << from << " to " << to << " is now closed." << '\n';
+    }
+    void printPath(const vector<int>& path) {
+        for (size_t i = 0; i < path.size(); ++i) {
+            cout << names.name(path[i]) << " "; // Print each intersection's name, start first
+        }
+    }
+
+
+    // Method to simulate road reopening
+    void reopenRoad(const string& from, const string& to) {
+        int fromIndex = findIntersection(from);
+        int toIndex = findIntersection(to);
+
+        if (fromIndex == -1 || toIndex == -1) {
+            cout << "One or both intersections not found: " << from << ", " << to << '\n';
+            return;
+        }
+
+        if (!setRoadClosed(fromIndex, toIndex, false)) {
+            cout << "Road not found: " << from << " to " << to << '\n';
+            return;
+        }
+
+        cout << "Road from " << from << " to " << to << " is now reopened." << '\n';
+    }
+
+    // ID-based API. Intersections are addressed by the dense index that findIntersection
+    // returns, so bulk callers skip name handling entirely. These methods do not print.
+
+    // Index of an intersection, adding it if the name is new
+    int internIntersection(string_view name) {
+        int index = names.intern(name);
+        if (index == intersectionCount()) {
+            intersections.push_back(Intersection());
+            roads.addNode();
+            topologyVersion++;
+        }
+        return index;
+    }
+
+    // Add a bidirectional road; returns false for invalid indices, negative weights or duplicates
+    bool addRoadById(int fromIndex, int toIndex, int weight) {
+        if (!isValidIndex(fromIndex) || !isValidIndex(toIndex) || weight < 0) {
+            return false;
+        }
+        if (roads.findArc(fromIndex, toIndex) != -1) {
+            return false;
+        }
+
+        // Create the new road and the one in the opposite direction for bi-directional graph
+        roads.addArc(fromIndex, toIndex, weight);
+        if (roads.findArc(toIndex, fromIndex) == -1) {
+            roads.addArc(toIndex, fromIndex, weight);
+        }
+        topologyVersion++;
+        eventLog.add(LOG_DEBUG, LOG_ROAD_ADDED, fromIndex, toIndex, weight);
+        return true;
+    }
+
+    // Remove the road between two intersections in both directions; returns false if
+    // there is no road from -> to
+    bool removeRoadById(int fromIndex, int toIndex) {
+        if (!isValidIndex(fromIndex) || !isValidIndex(toIndex)) {
+            return false;
+        }
+        if (!roads.removeArc(fromIndex, toIndex)) {
+            return false;
+        }
+        roads.removeArc(toIndex, fromIndex);
+        topologyVersion++;
+        eventLog.add(LOG_INFO, LOG_ROAD_REMOVED, fromIndex, toIndex);
+        return true;
+    }
+
+    // Drop every intersection, road and vehicle and hand their memory back (including a
+    // mapped snapshot), so a long-running process can load another city without growing
+    void clearNetwork() {
+        Column<Intersection>().swap(intersections);
+        NameTable().swap(names);
+        roads.release();
+        vector<Vehicle>().swap(vehicles);
+        vector<EmergencyVehicle>().swap(emergencyVehicles);
+        NameTable().swap(vehicleNames);
+        snapshotFile.close();
+        workspace = SearchWorkspace();
+        backwardWorkspace = SearchWorkspace();
+        vector<SearchWorkspace>().swap(workerSpaces);
+        vector<AlternativeRoutes>().swap(workerAlternatives);
+        hierarchy = ContractionHierarchy();
+        hierarchyBuilt = false;
+        vector<pair<int, int> >().swap(pendingRoadChanges);
+        heuristic = RouteHeuristic();
+        heuristicBuilt = false;
+        profiles.clear();
+        timeBounds = RouteHeuristic();
+        timeBoundsBuilt = false;
+        timeWorkspace = SearchWorkspace();
+        spatial = SpatialIndex();
+        spatialBuilt = false;
+        activeTrees.clear();
+        vector<unsigned char>().swap(roadQueued);
+        vector<unsigned char>().swap(signalDirty);
+        resetCorridors();
+        topologyVersion++;
+        if (publishedCount > 0) {
+            publishRoads(); // Concurrent readers get the empty network, and the old copy goes
+        }
+    }
+
+    // Concurrent reads. All other methods belong to one writer thread; routeConcurrently
+    // may be called from any number of threads at the same time, and reads the roads as
+    // they were at the last publishRoads call. The writer applies a batch of updates and
+    // then publishes them together, so a query sees all of a batch or none of it.
+
+    // Publish a copy of the current roads (weights, closures and topology). Readers never
+    // wait for this; the version they replace is freed once the last of its readers leaves.
+    void publishRoads() {
+        unique_ptr<RoadVersion> version(new RoadVersion());
+        version->roads = roads;
+        version->bounds.buildFromCoordinates(roads, intersections);
+        version->number = ++publishedCount;
+        publishedRoads.publish(move(version));
+    }
+
+    // Number of the version the next routeConcurrently call reads (0 if none yet)
+    unsigned publishedVersion() const { return publishedCount; }
+
+    // Shortest route on the published roads with bidirectional A* (plain bidirectional
+    // Dijkstra without coordinates). Lock-free; each calling thread passes its own
+    // workspaces. Returns INF if there is no route, an index is out of range or nothing
+    // was published yet. 'version', if given, receives the version number used.
+    int routeConcurrently(int startIndex, int endIndex, SearchWorkspace& forward, SearchWorkspace& backward,
+        vector<int>* path = nullptr, unsigned* version = nullptr) const {
+        Versioned<RoadVersion>::Reader reader(publishedRoads);
+        const RoadVersion* published = reader.get();
+        if (path != nullptr) {
+            path->clear();
+        }
+        if (version != nullptr) {
+            *version = published != nullptr ? published->number : 0;
+        }
+        if (published == nullptr || startIndex < 0 || endIndex < 0
+            || startIndex >= published->roads.nodeCount() || endIndex >= published->roads.nodeCount()) {
+            return INF;
+        }
+        int meeting;
+        int distance = runBidirectionalAStar(published->roads, startIndex, endIndex, published->bounds,
+            forward, backward, meeting);
+        if (path != nullptr && meeting != -1) {
+            for (int node = meeting; node != -1; node = forward.prev[node]) {
+                path->push_back(node);
+            }
+            reverse(path->begin(), path->end());
+            for (int node = backward.prev[meeting]; node != -1; node = backward.prev[node]) {
+                path->push_back(node);
+            }
+        }
+        return distance;
+    }
+
+    // Change the weight of the road from -> to; returns false if there is no such road
+    bool updateRoadWeightById(int fromIndex, int toIndex, int newWeight) {
+        if (!isValidIndex(fromIndex) || !isValidIndex(toIndex) || newWeight < 0) {
+            return false;
+        }
+        int arc = roads.findArc(fromIndex, toIndex);
+        if (arc == -1) {
+            return false;
+        }
+        bool faster = newWeight < roads.weights[arc];
+        roads.weights[arc] = newWeight;
+        roads.baseWeights[arc] = newWeight;
+        roadWeightChanged(fromIndex, toIndex, faster);
+        eventLog.add(LOG_INFO, LOG_ROAD_WEIGHT, fromIndex, toIndex, newWeight);
+        return true;
+    }
+
+    // Apply a batch of congestion readings in one pass. Each reading sets the vehicle count
+    // of one direction of a road (the last reading of a road wins); the road's weight
+    // becomes its base weight plus one second per CONGESTION_VEHICLES vehicles, and the
+    // green times of the intersections whose outgoing counts changed are recomputed once
+    // at the end, however many of their roads were updated.
+    CountUpdateReport applyVehicleCounts(const vector<RoadCount>& readings) {
+        ScopedTimer timer(TIME_COUNT_BATCH);
+        CountUpdateReport report;
+        roadQueued.resize(roads.weights.size(), 0);
+        signalDirty.resize(intersectionCount(), 0);
+        updateArcs.clear();
+        updateTails.clear();
+
+        // Pass 1: store the counts and mark what they affect
+        for (size_t i = 0; i < readings.size(); ++i) {
+            const RoadCount& reading = readings[i];
+            int arc = -1;
+            if (isValidIndex(reading.from) && isValidIndex(reading.to) && reading.count >= 0) {
+                arc = roads.findArc(reading.from, reading.to);
+            }
+            if (arc == -1) {
+                report.skipped++;
+                continue;
+            }
+            roads.vehicleCounts[arc] = reading.count;
+            eventLog.add(LOG_DEBUG, LOG_VEHICLE_COUNT, reading.from, reading.to, reading.count);
+            report.applied++;
+            if (!roadQueued[arc]) {
+                roadQueued[arc] = 1;
+                updateArcs.push_back(arc);
+                updateTails.push_back(reading.from);
+            }
+            markSignalDirty(reading.from);
+        }
+
+        // Pass 2: gather the inputs side by side so the weight loop has no indirection
+        int updated = (int)updateArcs.size();
+        updateBase.resize(updated);
+        updateCounts.resize(updated);
+        updateWeights.resize(updated);
+        const int* arcs = updateArcs.data();
+        int* base = updateBase.data();
+        int* counts = updateCounts.data();
+        int* weights = updateWeights.data();
+        for (int i = 0; i < updated; ++i) {
+            base[i] = roads.baseWeights[arcs[i]];
+            counts[i] = roads.vehicleCounts[arcs[i]];
+            roadQueued[arcs[i]] = 0;
+        }
+        for (int i = 0; i < updated; ++i) {
+            weights[i] = base[i] + counts[i] / CONGESTION_VEHICLES;
+        }
+
+        // Pass 3: write back the weights that changed and keep the route caches informed
+        for (int i = 0; i < updated; ++i) {
+            int arc = arcs[i];
+            if (roads.weights[arc] != weights[i]) {
+                bool faster = weights[i] < roads.weights[arc];
+                roads.weights[arc] = weights[i];
+                roadWeightChanged(updateTails[i], roads.targets[arc], faster);
+                report.weightsChanged++;
+            }
+        }
+
+        metrics.add(COUNT_COUNT_READINGS, report.applied);
+        metrics.add(COUNT_SIGNAL_UPDATES, dirtyIntersections.size());
+        report.signalsChanged = refreshDirtySignals();
+        eventLog.add(LOG_INFO, LOG_COUNT_BATCH, report.applied, report.skipped, report.weightsChanged,
+            report.signalsChanged);
+        return report;
+    }
+
+    // Length of the shortest open route (INF if unreachable). If 'path' is given it
+    // receives the intersections along the route, start first.
+    int shortestPathById(int startIndex, int endIndex, vector<int>* path = nullptr) {
+        return shortestPathById(startIndex, endIndex, routingAlgorithm, path);
+    }
+
+    // Same, with a specific algorithm. getLastSettledCount() reports the search effort.
+    // Routes from an active source are read off its maintained tree whatever the algorithm;
+    // the effort reported then is the number of nodes the tree repair recomputed.
+    int shortestPathById(int startIndex, int endIndex, RoutingAlgorithm algorithm, vector<int>* path = nullptr) {
+        ScopedTimer timer(TIME_ROUTE);
+        int distance = findShortestPath(startIndex, endIndex, algorithm, path);
+        metrics.add(COUNT_ROUTE_QUERIES);
+        metrics.add(COUNT_NODES_SETTLED, lastSettled);
+        return distance;
+    }
+
+    // Give the road from -> to a travel-time profile of (second of the day, travel time)
+    // breakpoints, or remove its profile with an empty list. While a road has a profile it
+    // stands in for the base weight in time-dependent routing; congestion still adds on
+    // top. Returns false if there is no such road or the profile is invalid.
+    bool setRoadProfileById(int fromIndex, int toIndex, const vector<pair<int, int> >& points) {
+        if (!isValidIndex(fromIndex) || !isValidIndex(toIndex)) {
+            return false;
+        }
+        int arc = roads.findArc(fromIndex, toIndex);
+        if (arc == -1) {
+            return false;
+        }
+        int profile = -1;
+        if (!points.empty()) {
+            profile = profiles.add(points);
+            if (profile == -1) {
+                return false;
+            }
+        }
+        roads.profiles[arc] = profile;
+        timeBoundsBuilt = false;
+        return true;
+    }
+
+    // Earliest arrival at endIndex, in seconds after midnight of the departure day, when
+    // leaving startIndex 'departure' seconds after midnight. Roads follow their profiles
+    // and every intersection on the way adds its signal wait. Runs A* on all-day lower
+    // bounds unless plain Dijkstra is the selected routing algorithm. Returns INF if the
+    // end cannot be reached.
+    int earliestArrivalById(int startIndex, int endIndex, int departure, vector<int>* path = nullptr) {
+        ScopedTimer timer(TIME_ROUTE);
+        lastSettled = 0;
+        if (path) {
+            path->clear();
+        }
+        if (!isValidIndex(startIndex) || !isValidIndex(endIndex) || departure < 0) {
+            return INF;
+        }
+        const RouteHeuristic noBounds;
+        const RouteHeuristic& bounds = routingAlgorithm == ROUTE_DIJKSTRA ? noBounds : prepareTimeBounds();
+        int lastArc;
+        int arrival = runTimeDependentSearch(roads, profiles, startIndex, endIndex, departure, bounds,
+            [this](int from, int at, int time) { return signalWait(from, at, time); }, timeWorkspace, lastArc);
+        lastSettled = timeWorkspace.settledCount;
+        countSearchWork(timeWorkspace);
+        metrics.add(COUNT_ROUTE_QUERIES);
+        metrics.add(COUNT_NODES_SETTLED, lastSettled);
+
+        if (path && arrival != INF) {
+            for (int arc = lastArc; arc != -1; arc = timeWorkspace.prev[arc]) {
+                path->push_back(roads.targets[arc]);
+            }
+            path->push_back(startIndex);
+            reverse(path->begin(), path->end());
+        }
+        return arrival;
+    }
+
+private:
+    // Add a search's road scans and heap operations to the metrics
+    static void countSearchWork(const SearchWorkspace& ws) {
+        metrics.add(COUNT_ROADS_SCANNED, ws.scannedRoads);
+        metrics.add(COUNT_HEAP_PUSHES, ws.heapPushes);
+    }
+
+    int findShortestPath(int startIndex, int endIndex, RoutingAlgorithm algorithm, vector<int>* path) {
+        lastSettled = 0;
+        if (!isValidIndex(startIndex) || !isValidIndex(endIndex)) {
+            return INF;
+        }
+        int slot = activeTrees.slotOf(startIndex);
+        if (slot != -1) {
+            prepareActiveTrees();
+            lastSettled = activeTrees.lastRepairedCount();
+            if (path != nullptr) {
+                activeTrees.path(slot, endIndex, *path);
+            }
+            return activeTrees.distance(slot, endIndex);
+        }
+        if (algorithm == ROUTE_CONTRACTION) {
+            prepareHierarchy();
+            int distance = hierarchy.query(startIndex, endIndex, path);
+            lastSettled = hierarchy.lastScannedCount();
+            return distance;
+        }
+        if (algorithm == ROUTE_BIDIRECTIONAL_ASTAR) {
+            prepareHeuristic();
+            int meeting;
+            int distance = runBidirectionalAStar(roads, startIndex, endIndex, heuristic, workspace, backwardWorkspace, meeting);
+            lastSettled = workspace.settledCount + backwardWorkspace.settledCount;
+            countSearchWork(workspace);
+            countSearchWork(backwardWorkspace);
+            if (path != nullptr) {
+                path->clear();
+                if (meeting != -1) {
+                    for (int node = meeting; node != -1; node = workspace.prev[node]) {
+                        path->push_back(node);
+                    }
+                    reverse(path->begin(), path->end());
+                    for (int node = backwardWorkspace.prev[meeting]; node != -1; node = backwardWorkspace.prev[node]) {
+                        path->push_back(node);
+                    }
+                }
+            }
+            return distance;
+        }
+
+        int distance;
+        if (algorithm == ROUTE_ASTAR) {
+            prepareHeuristic();
+            distance = runAStar(roads, startIndex, endIndex, heuristic, workspace);
+        }
+        else {
+            distance = runDijkstra(roads, startIndex, endIndex, heapKind, workspace);
+        }
+        lastSettled = workspace.settledCount;
+        countSearchWork(workspace);
+        if (path != nullptr) {
+            path->clear();
+            if (distance != INF) {
+                for (int node = endIndex; node != -1; node = workspace.prev[node]) {
+                    path->push_back(node);
+                }
+                reverse(path->begin(), path->end());
+            }
+        }
+        return distance;
+    }
+
+public:
+    // Nodes the last route query settled (for the hierarchy: nodes scanned)
+    int getLastSettledCount() const { return lastSettled; }
+
+    // Keep a shortest-path tree for this intersection, repaired in place on every weight
+    // or closure change. Returns false if it already is an active source or the trees
+    // would use more than DynamicShortestPaths::MEMORY_LIMIT bytes.
+    bool addActiveSource(int index) {
+        if (!isValidIndex(index)) {
+            return false;
+        }
+        prepareActiveTrees(); // Existing trees must match the roads the new one is grown on
+        if (activeTrees.sourceCount() == 0) {
+            treesTopology = topologyVersion;
+        }
+        return activeTrees.addSource(roads, index);
+    }
+    bool removeActiveSource(int index) { return activeTrees.removeSource(index); }
+    void clearActiveSources() { activeTrees.clear(); }
+    int activeSourceCount() const { return activeTrees.sourceCount(); }
+
+    // Register the origins of all loaded vehicles (or emergency vehicles) as active sources
+    void activateVehicleOrigins(bool emergency) {
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        int added = 0;
+        bool full = false;
+        size_t count = emergency ? emergencyVehicles.size() : vehicles.size();
+        for (size_t i = 0; i < count && !full; ++i) {
+            int origin = emergency ? emergencyVehicles[i].origin : vehicles[i].origin;
+            if (activeTrees.slotOf(origin) != -1) {
+                continue;
+            }
+            if (addActiveSource(origin)) {
+                added++;
+            }
+            else {
+                full = true;
+            }
+        }
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        cout << "Added " << added << " active sources in " << milliseconds << " ms (" << activeSourceCount()
+            << " in total, " << activeTrees.memoryUsage() / (1024 * 1024) << " MB of trees)." << '\n';
+        if (full) {
+            cout << "Stopped at the tree memory limit." << '\n';
+        }
+    }
+
+    bool isValidIndex(int index) const {
+        return index >= 0 && index < intersectionCount();
+    }
+
+    // Place an intersection on the map; A* uses straight-line bounds once all have coordinates
+    bool setIntersectionCoordinates(int index, double x, double y) {
+        if (!isValidIndex(index)) {
+            return false;
+        }
+        Intersection& intersection = intersections[index];
+        if (!intersection.hasCoordinates || intersection.x != (float)x || intersection.y != (float)y) {
+            intersection.x = (float)x;
+            intersection.y = (float)y;
+            intersection.hasCoordinates = true;
+            heuristicBuilt = false;
+            spatialBuilt = false;
+        }
+        return true;
+    }
+
+    // Closest intersection to a map position, or -1 if no intersection has coordinates.
+    // 'distance' receives how far away it is.
+    int nearestIntersection(double x, double y, float* distance = nullptr) {
+        prepareSpatialIndex();
+        return spatial.nearestIntersection((float)x, (float)y, distance);
+    }
+
+    // Closest point of the road network to a map position; false if no road has
+    // coordinates at both ends
+    bool snapToRoad(double x, double y, RoadSnap& snap) {
+        prepareSpatialIndex();
+        return spatial.nearestRoad((float)x, (float)y, snap);
+    }
+
+    // Snap many positions at once, spread over the worker pool in blocks. The positions
+    // are taken in Hilbert order, so each query starts from the answer to a neighbour and
+    // finds the tree nodes it needs still in cache.
+    void snapPositions(const vector<MapPoint>& points, vector<RoadSnap>& snaps) {
+        const int BLOCK = 4096;
+        prepareSpatialIndex();
+        int count = (int)points.size();
+        snaps.resize(count);
+        int blockCount = (count + BLOCK - 1) / BLOCK;
+        vector<pair<unsigned, int> > order(count);
+        workers->parallelFor(blockCount, [&](int, int block) {
+            for (int i = block * BLOCK; i < min(count, (block + 1) * BLOCK); ++i) {
+                order[i] = make_pair(spatial.curvePosition(points[i].x, points[i].y), i);
+            }
+        });
+        sort(order.begin(), order.end());
+        workers->parallelFor(blockCount, [&](int, int block) {
+            int hint = -1;
+            for (int i = block * BLOCK; i < min(count, (block + 1) * BLOCK); ++i) {
+                const MapPoint& point = points[order[i].second];
+                spatial.nearestRoad(point.x, point.y, snaps[order[i].second], &hint);
+            }
+        });
+    }
+
+    // Travel time between two map positions (INF if there is no route). Each position
+    // snaps to the closest road that is open in at least one direction; the trip starts
+    // with the rest of that road towards either end and finishes with the part of the
+    // end road up to the position, in proportion to the roads' weights. The route between
+    // the roads comes from the selected routing algorithm. 'path' receives the
+    // intersections passed, empty if the trip stays on one road.
+    int routeBetweenPoints(MapPoint start, MapPoint end, RoadSnap& startSnap, RoadSnap& endSnap,
+        vector<int>* path = nullptr) {
+        prepareSpatialIndex();
+        if (path) {
+            path->clear();
+        }
+        auto open = [this](int from, int to) {
+            int arc = roads.findArc(from, to);
+            return arc != -1 && !roads.closed[arc];
+        };
+        auto usable = [&](int from, int to) { return open(from, to) || open(to, from); };
+        if (!spatial.nearestRoad(start.x, start.y, startSnap, usable) || !spatial.nearestRoad(end.x, end.y, endSnap, usable)) {
+            return INF;
+        }
+        // Seconds to drive 'fraction' of the road from -> to, or INF if it cannot be driven
+        auto part = [&](int from, int to, double fraction) {
+            return open(from, to) ? (int)lround(fraction * roads.weights[roads.findArc(from, to)]) : INF;
+        };
+
+        int best = INF; // Staying on the road, if both positions are on the same one
+        if (startSnap.from == endSnap.from && startSnap.to == endSnap.to) {
+            best = endSnap.fraction >= startSnap.fraction
+                ? part(startSnap.from, startSnap.to, endSnap.fraction - startSnap.fraction)
+                : part(startSnap.to, startSnap.from, startSnap.fraction - endSnap.fraction);
+        }
+        int exits[2] = { startSnap.to, startSnap.from };
+        int exitCost[2] = { part(startSnap.from, startSnap.to, 1 - startSnap.fraction),
+            part(startSnap.to, startSnap.from, startSnap.fraction) };
+        int entries[2] = { endSnap.from, endSnap.to };
+        int entryCost[2] = { part(endSnap.from, endSnap.to, endSnap.fraction),
+            part(endSnap.to, endSnap.from, 1 - endSnap.fraction) };
+        vector<int> between;
+        for (int i = 0; i < 2; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                if (exitCost[i] == INF || entryCost[j] == INF || exitCost[i] + entryCost[j] >= best) {
+                    continue;
+                }
+                int distance = shortestPathById(exits[i], entries[j], path ? &between : nullptr);
+                if (distance != INF && exitCost[i] + distance + entryCost[j] < best) {
+                    best = exitCost[i] + distance + entryCost[j];
+                    if (path) {
+                        path->swap(between);
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    // Method to print where a map position lies on the road network
+    void printRoadSnap(const char* label, const RoadSnap& snap) {
+        cout << label << " snapped to road " << names.name(snap.from) << " - " << names.name(snap.to) << " ("
+            << (int)lround(snap.fraction * 100) << "% along, " << snap.distance << " units away)" << '\n';
+    }
+
+    // Method to find the route between two map positions, such as GPS fixes
+    void routeBetweenPositions(double x1, double y1, double x2, double y2) {
+        MapPoint start = { (float)x1, (float)y1 };
+        MapPoint end = { (float)x2, (float)y2 };
+        RoadSnap startSnap, endSnap;
+        vector<int> path;
+        int distance = routeBetweenPoints(start, end, startSnap, endSnap, &path);
+        if (startSnap.from == -1 || endSnap.from == -1) {
+            cout << "No open road with map coordinates to snap to." << '\n';
+            return;
+        }
+        printRoadSnap("Start", startSnap);
+        printRoadSnap("End", endSnap);
+        if (distance == INF) {
+            cout << "No path found between the two positions." << '\n';
+            return;
+        }
+        cout << "Travel time between the positions is " << distance << " time units." << '\n';
+        cout << "Path: ";
+        if (path.empty()) {
+            cout << "stays on the road";
+        }
+        else {
+            printPath(path);
+        }
+        cout << '\n';
+    }
+
+    // Method to snap a file of vehicle positions (VehicleID,X,Y) to the road network
+    void snapPositionsFile(const string& filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cout << "Error: Unable to open file " << filename << '\n';
+            return;
+        }
+        vector<MapPoint> points;
+        vector<string_view> ids;
+        points.reserve(CsvReader::countLines(file.data(), file.size()));
+        LoadReport report;
+        CsvReader reader(file.data(), file.size());
+        while (reader.next()) {
+            double x, y;
+            if (reader.fieldCount() < 3 || !parseDouble(reader[1], x) || !parseDouble(reader[2], y)) {
+                countSkippedRow(reader, report);
+                continue;
+            }
+            MapPoint point = { (float)x, (float)y };
+            points.push_back(point);
+            ids.push_back(reader[0]);
+            report.records++;
+        }
+
+        prepareSpatialIndex(); // Not part of the snapping time
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        vector<RoadSnap> snaps;
+        snapPositions(points, snaps);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        const size_t SHOWN = 20;
+        for (size_t i = 0; i < snaps.size() && i < SHOWN; ++i) {
+            if (snaps[i].from == -1) {
+                cout << ids[i] << ": no road to snap to" << '\n';
+                continue;
+            }
+            cout << ids[i] << ": road " << names.name(snaps[i].from) << " - " << names.name(snaps[i].to) << ", "
+                << (int)lround(snaps[i].fraction * 100) << "% along, " << snaps[i].distance << " units away" << '\n';
+        }
+        if (snaps.size() > SHOWN) {
+            cout << "... and " << snaps.size() - SHOWN << " more." << '\n';
+        }
+        cout << "Snapped " << snaps.size() << " positions in " << seconds * 1000 << " ms ("
+            << (seconds > 0 ? snaps.size() / seconds : 0) << " per second), " << report.skipped
+            << " rows skipped." << '\n';
+    }
+
+    // Set the closure flag on both directions of a road; returns false if there is no such road
+    bool setRoadClosed(int fromIndex, int toIndex, bool isClosed) {
+        if (!isValidIndex(fromIndex) || !isValidIndex(toIndex)) {
+            return false;
+        }
+        int forwardArc = roads.findArc(fromIndex, toIndex);
+        int reverseArc = roads.findArc(toIndex, fromIndex); // Assuming roads are bidirectional
+        if (forwardArc == -1 && reverseArc == -1) {
+            return false;
+        }
+        if (forwardArc != -1) {
+            roads.closed[forwardArc] = isClosed;
+        }
+        if (reverseArc != -1) {
+            roads.closed[reverseArc] = isClosed;
+        }
+        roadWeightChanged(fromIndex, toIndex, !isClosed);
+        eventLog.add(LOG_INFO, LOG_ROAD_CLOSED, fromIndex, toIndex, isClosed ? 1 : 0);
+        return true;
+    }
+
+    // Choose the algorithm behind dijkstra and rerouteTraffic
+    void setRoutingAlgorithm(RoutingAlgorithm algorithm) {
+        routingAlgorithm = algorithm;
+        announceAlgorithm(algorithm, "Routing");
+    }
+    RoutingAlgorithm getRoutingAlgorithm() const { return routingAlgorithm; }
+
+    // Choose the algorithm behind emergencyVehicleRouting (bidirectional A* by default)
+    void setEmergencyRoutingAlgorithm(RoutingAlgorithm algorithm) {
+        emergencyAlgorithm = algorithm;
+        announceAlgorithm(algorithm, "Emergency routing");
+    }
+    RoutingAlgorithm getEmergencyRoutingAlgorithm() const { return emergencyAlgorithm; }
+
+    // Method to simulate system performance under road closures
+    void simulateDisruption() {
+        // Example: Simulate the shortest path calculation during disruptions
+        string start, end;
+        cout << "Enter start intersection: ";
+        cin >> start;
+        cout << "Enter end intersection: ";
+        cin >> end;
+        dijkstra(start, end); // Recalculate shortest path affected by closures
+    }
+
+    void emergencyVehicleRouting(const string& startName, const string& endName) {
+        cout << "Routing emergency vehicle from " << startName << " to " << endName << '\n';
+
+        int startIndex = findIntersection(startName);
+        int endIndex = findIntersection(endName);
+
+        if (startIndex == -1 || endIndex == -1) {
+            cout << "Start or end intersection not found: " << startName << ", " << endName << '\n';
+            return;
+        }
+
+        eventLog.add(LOG_INFO, LOG_EMERGENCY_ROUTE, startIndex, endIndex, emergencyAlgorithm);
+        Corridor corridor = dispatchEmergencyById(startIndex, endIndex);
+        const Route& route = corridor.route;
+        if (!route.found()) {
+            cout << "No path found from " << startName << " to " << endName << '\n';
+            return;
+        }
+        cout << "Emergency route from " << startName << " to " << endName << " is " << route.distance
+            << " time units; corridor scheduled in " << corridor.microseconds << " microseconds." << '\n';
+        if (corridor.held > 0) {
+            cout << "Held " << corridor.held << " seconds for other emergency corridors." << '\n';
+        }
+
+        // Follow the vehicle along its corridor: each signal is green for it when it arrives,
+        // and returns to normal once it has passed
+        for (size_t i = 0; i < route.intersections.size(); ++i) {
+            int at = route.intersections[i];
+            advanceEmergencyClock(corridor.departure + route.arrival[i] - corridorClock);
+            cout << "  +" << route.arrival[i] << "s  " << names.name(at) << " - Green Light Duration: "
+                << intersections[at].trafficSignal << " seconds"
+                << (intersections[at].emergencyOverride ? " (emergency override)" : "") << '\n';
+        }
+        advanceEmergencyClock(CORRIDOR_CLEAR);
+        cout << "Vehicle arrived at " << endName << "; its signal overrides have ended." << '\n';
+    }
+
+    // Route an emergency vehicle and schedule its corridor. Its route comes from the
+    // emergency routing algorithm, with arrival times from the current road weights (a
+    // vehicle with a green corridor never waits at a signal). Each intersection on the way
+    // gets an override from CORRIDOR_LEAD seconds before the vehicle arrives until
+    // CORRIDOR_CLEAR seconds after. An intersection serves one corridor at a time: where
+    // the window overlaps one promised to an earlier dispatch, the vehicle is held on the
+    // approach until that window ends and the rest of its trip shifts by as much. Promised
+    // windows are never taken back, so the most urgent vehicles must be dispatched first
+    // (scheduleEmergencyFleet does that). Overrides due now are applied at once; the rest
+    // as advanceEmergencyClock reaches them.
+    Corridor dispatchEmergencyById(int startIndex, int endIndex, int priority = 0, int vehicle = -1) {
+        ScopedTimer timer(TIME_EMERGENCY_DISPATCH);
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        Corridor corridor;
+        corridor.vehicle = vehicle;
+        corridor.priority = priority;
+        corridor.departure = corridorClock;
+        corridor.route = findRoute(startIndex, endIndex, emergencyAlgorithm);
+        Route& route = corridor.route;
+        if (route.found()) {
+            if ((int)windowHead.size() < intersectionCount()) {
+                windowHead.resize(intersectionCount(), -1);
+                activeOverrides.resize(intersectionCount(), 0);
+            }
+            for (size_t i = 0; i < route.intersections.size(); ++i) {
+                int at = route.intersections[i];
+                int arrival = corridor.departure + route.arrival[i] + corridor.held;
+                int begin = max(corridorClock, arrival - CORRIDOR_LEAD);
+                int length = arrival + CORRIDOR_CLEAR - begin;
+                int start = firstFreeWindow(at, begin, length);
+                corridor.held += start - begin;
+                reserveWindow(at, start, start + length);
+                route.arrival[i] += corridor.held;
+            }
+            advanceEmergencyClock(0);
+        }
+        eventLog.add(LOG_INFO, LOG_EMERGENCY_DISPATCH, vehicle, startIndex, endIndex, priority, corridor.held);
+        corridor.microseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - started).count();
+        return corridor;
+    }
+
+    // Dispatch every vehicle of emergency_vehicles.csv, most urgent first (ties in file
+    // order), so higher priorities get the intersections they need and lower ones yield
+    void scheduleEmergencyFleet(vector<Corridor>& corridors) {
+        priority_queue<pair<int, int> > pending; // (priority, -file position)
+        for (size_t i = 0; i < emergencyVehicles.size(); ++i) {
+            pending.push(make_pair(emergencyVehicles[i].priority, -(int)i));
+        }
+        corridors.clear();
+        corridors.reserve(emergencyVehicles.size());
+        while (!pending.empty()) {
+            const EmergencyVehicle& vehicle = emergencyVehicles[-pending.top().second];
+            pending.pop();
+            corridors.push_back(dispatchEmergencyById(vehicle.origin, vehicle.destination, vehicle.priority, vehicle.id));
+        }
+    }
+
+    // Method to dispatch all loaded emergency vehicles and report their corridors
+    void dispatchEmergencyFleet() {
+        if (emergencyVehicles.empty()) {
+            cout << "No emergency vehicles loaded." << '\n';
+            return;
+        }
+        vector<Corridor> corridors;
+        scheduleEmergencyFleet(corridors);
+        double slowest = 0;
+        for (size_t i = 0; i < corridors.size(); ++i) {
+            const Corridor& corridor = corridors[i];
+            const Route& route = corridor.route;
+            cout << "Vehicle " << vehicleNames.name(corridor.vehicle) << " (priority " << corridor.priority << "): ";
+            if (!route.found()) {
+                cout << "no path found." << '\n';
+            }
+            else {
+                cout << names.name(route.start) << " to " << names.name(route.end) << ", arrives after "
+                    << route.arrival.back() << " seconds";
+                if (corridor.held > 0) {
+                    cout << " (held " << corridor.held << " seconds for other corridors)";
+                }
+                cout << '\n';
+            }
+            slowest = max(slowest, corridor.microseconds);
+        }
+        cout << "Dispatched " << corridors.size() << " emergency vehicles at emergency clock " << corridorClock
+            << "s; slowest dispatch took " << slowest << " microseconds." << '\n';
+        cout << pendingOverrideCount() << " signal overrides are scheduled; advance the emergency clock to apply them." << '\n';
+    }
+
+    // Move the corridor clock forward and apply the overrides that start or end by then,
+    // retiming the affected signals. Returns how many signals switched in or out of override.
+    int advanceEmergencyClock(int seconds) {
+        if (seconds > 0) {
+            corridorClock += seconds;
+        }
+        int switched = 0;
+        while (!overrideEvents.empty() && overrideEvents.top().time <= corridorClock) {
+            OverrideEvent event = overrideEvents.top();
+            overrideEvents.pop();
+            activeOverrides[event.intersection] += event.on ? 1 : -1;
+            bool overridden = activeOverrides[event.intersection] > 0;
+            if (intersections[event.intersection].emergencyOverride != overridden) {
+                intersections[event.intersection].emergencyOverride = overridden;
+                updateGreenLightById(event.intersection);
+                switched++;
+            }
+        }
+        return switched;
+    }
+
+    // Method to advance the emergency clock and report the signals that switched
+    void runEmergencyClock(int seconds) {
+        int switched = advanceEmergencyClock(seconds);
+        cout << "Emergency clock at " << corridorClock << "s: " << switched << " signals switched, "
+            << pendingOverrideCount() << " overrides still scheduled." << '\n';
+    }
+
+    int emergencyClock() const { return corridorClock; }
+    int pendingOverrideCount() const { return (int)overrideEvents.size(); }
+
+
+};
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+// ANSI escape codes for colors
+#define RESET   "\033[0m"
+#define BOLD    "\033[1m"
+#define UNDERLINE "\033[4m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define YELLOW  "\033[33m"
+#define BLUE    "\033[34m"
+#define MAGENTA "\033[35m"
+#define CYAN    "\033[36m"
+#define WHITE   "\033[37m"
+#define BG_BLUE "\033[44m"
+#define BG_YELLOW "\033[43m"
+
+// Function to print a decorative border
+void printBorder() {
+    cout << BOLD << CYAN << "===========================================================" << RESET << '\n';
+}
+
+// Load a snapshot and report the outcome
+void loadSnapshotFile(TrafficGraph& cityGraph, const string& filename) {
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    if (!cityGraph.loadSnapshot(filename)) {
+        cout << RED << "Error: " << filename << " is missing or not a valid snapshot" << RESET << '\n';
+        return;
+    }
+    double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    cout << CYAN << "Snapshot " << filename << " loaded in " << milliseconds << " ms ("
+        << cityGraph.intersectionCount() << " intersections)" << RESET << '\n';
+}
+
+// Built-in benchmarks (--bench). Each synthetic network is written as a road_network.csv
+// file and loaded through the normal loader, then routing and update rates are measured.
+// Networks and query sets depend only on the seed, so runs are comparable across
+// versions; results go to stdout and, with --bench-out, to a JSON or CSV file.
+class BenchmarkSuite {
+public:
+    struct Result {
+        string network;    // grid, geometric or scalefree
+        int intersections;
+        int roads;         // Directed roads
+        string metric;
+        double value;
+        string unit;
+    };
+
+    BenchmarkSuite() : seed(1) {
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+        sizes.push_back(1000000);
+        networks.push_back("grid");
+        networks.push_back("geometric");
+        networks.push_back("scalefree");
+    }
+
+    // Read the --bench-* options; returns false (after printing why) on a bad value
+    bool parseArguments(int argc, char* argv[]) {
+        for (int i = 1; i + 1 < argc; ++i) {
+            string value = argv[i + 1];
+            if (strcmp(argv[i], "--bench-sizes") == 0) {
+                sizes.clear();
+                for (size_t start = 0; start <= value.size(); ) {
+                    size_t comma = value.find(',', start);
+                    string item = value.substr(start, comma == string::npos ? string::npos : comma - start);
+                    int size;
+                    if (!parseInt(item, size) || size < 4) {
+                        cerr << "Invalid benchmark size: " << item << '\n';
+                        return false;
+                    }
+                    sizes.push_back(size);
+                    start = comma == string::npos ? value.size() + 1 : comma + 1;
+                }
+            }
+            else if (strcmp(argv[i], "--bench-networks") == 0) {
+                networks.clear();
+                for (size_t start = 0; start <= value.size(); ) {
+                    size_t comma = value.find(',', start);
+                    string item = value.substr(start, comma == string::npos ? string::npos : comma - start);
+                    if (item != "grid" && item != "geometric" && item != "scalefree") {
+                        cerr << "Unknown benchmark network: " << item << " (use grid, geometric or scalefree)\n";
+                        return false;
+                    }
+                    networks.push_back(item);
+                    start = comma == string::npos ? value.size() + 1 : comma + 1;
+                }
+            }
+            else if (strcmp(argv[i], "--bench-seed") == 0) {
+                seed = (unsigned)strtoul(value.c_str(), nullptr, 10);
+            }
+            else if (strcmp(argv[i], "--bench-out") == 0) {
+                outputName = value;
+            }
+        }
+        return true;
+    }
+
+    // Run every network at every size; returns false if a file could not be written
+    bool run() {
+        cout << "Benchmark seed " << seed << ", " << thread::hardware_concurrency() << " hardware threads\n";
+        for (size_t n = 0; n < networks.size(); ++n) {
+            for (size_t s = 0; s < sizes.size(); ++s) {
+                if (!runOne(networks[n], sizes[s])) {
+                    return false;
+                }
+            }
+        }
+        return outputName.empty() || writeResults();
+    }
+
+private:
+    unsigned seed;
+    vector<int> sizes;
+    vector<string> networks;
+    string outputName;
+    vector<Result> results;
+
+    static const char* networkFile() { return "bench_network.csv"; }
+    static const char* snapshotFile() { return "bench_network.snap"; }
+
+    // Discards output but still pays for formatting it, like a redirected console
+    class NullBuffer : public streambuf {
+    protected:
+        int overflow(int c) { return c; }
+        streamsize xsputn(const char*, streamsize count) { return count; }
+    };
+
+    void add(const string& network, const TrafficGraph& graph, int roads, const string& metric, double value,
+        const string& unit) {
+        Result result = { network, graph.intersectionCount(), roads, metric, value, unit };
+        results.push_back(result);
+        char line[160];
+        snprintf(line, sizeof(line), "%-10s %8d %-28s %14.3f %s", network.c_str(), result.intersections,
+            metric.c_str(), value, unit.c_str());
+        cout << line << '\n';
+    }
+
+    static double millisecondsSince(chrono::steady_clock::time_point started) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    }
+
+    static double percentile(const vector<double>& sorted, int percent) {
+        size_t index = min(sorted.size() - 1, sorted.size() * percent / 100);
+        return sorted[index];
+    }
+
+    static void writeRoad(ofstream& out, int from, int to, int weight) {
+        out << 'i' << from << ",i" << to << ',' << weight << '\n';
+    }
+    static void writeRoad(ofstream& out, int from, int to, int weight, const vector<float>& x, const vector<float>& y) {
+        out << 'i' << from << ",i" << to << ',' << weight << ',' << x[from] << ',' << y[from]
+            << ',' << x[to] << ',' << y[to] << '\n';
+    }
+
+    // Square grid with random travel times
+    static void writeGrid(ofstream& out, int size, mt19937& rng) {
+        int side = max(2, (int)sqrt((double)size));
+        vector<float> x(side * side), y(side * side);
+        for (int i = 0; i < side * side; ++i) {
+            x[i] = (float)(i % side * 100);
+            y[i] = (float)(i / side * 100);
+        }
+        for (int i = 0; i < side * side; ++i) {
+            if (i % side + 1 < side) {
+                writeRoad(out, i, i + 1, 5 + rng() % 36, x, y);
+            }
+            if (i + side < side * side) {
+                writeRoad(out, i, i + side, 5 + rng() % 36, x, y);
+            }
+        }
+    }
+
+    // Random points in a square, each joined to the points within a radius that gives about
+    // six roads per intersection; travel time follows the distance
+    static void writeGeometric(ofstream& out, int size, mt19937& rng) {
+        double side = sqrt((double)size);
+        double radius = sqrt(6.0 / 3.14159265358979);
+        int cells = max(1, (int)(side / radius));
+        uniform_real_distribution<double> position(0, side);
+        vector<float> x(size), y(size);
+        vector<vector<int> > cell(cells * cells);
+        auto cellOf = [&](double value) { return min(cells - 1, (int)(value / side * cells)); };
+        for (int i = 0; i < size; ++i) {
+            x[i] = (float)position(rng);
+            y[i] = (float)position(rng);
+            cell[cellOf(y[i]) * cells + cellOf(x[i])].push_back(i);
+        }
+        for (int i = 0; i < size; ++i) {
+            int cx = cellOf(x[i]), cy = cellOf(y[i]);
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if (cx + dx < 0 || cx + dx >= cells || cy + dy < 0 || cy + dy >= cells) {
+                        continue;
+                    }
+                    const vector<int>& members = cell[(cy + dy) * cells + cx + dx];
+                    for (size_t m = 0; m < members.size(); ++m) {
+                        int j = members[m];
+                        double distance = hypot(x[i] - x[j], y[i] - y[j]);
+                        if (j > i && distance <= radius) {
+                            writeRoad(out, i, j, 1 + (int)(distance * 20), x, y);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Preferential attachment (Barabasi-Albert, two roads per new intersection): a few
+    // hubs with very high degree and no coordinates
+    static void writeScaleFree(ofstream& out, int size, mt19937& rng) {
+        vector<int> ends; // Every road end so far; sampling it picks nodes by degree
+        for (int i = 0; i < 3; ++i) {
+            for (int j = i + 1; j < 3; ++j) {
+                writeRoad(out, i, j, 5 + rng() % 36);
+                ends.push_back(i);
+                ends.push_back(j);
+            }
+        }
+        for (int i = 3; i < size; ++i) {
+            int first = ends[rng() % ends.size()];
+            int second = first;
+            while (second == first) {
+                second = ends[rng() % ends.size()];
+            }
+            writeRoad(out, i, first, 5 + rng() % 36);
+            writeRoad(out, i, second, 5 + rng() % 36);
+            ends.push_back(i);
+            ends.push_back(first);
+            ends.push_back(i);
+            ends.push_back(second);
+        }
+    }
 
-            // Find the unvisited node with the smallest distance
-            for (int j = 0; j < count; ++j) {
-                if (!visited[j] && dist[j] < minDist) {
-                    minDist = dist[j];
-                    u = j;
-                }
+    bool runOne(const string& network, int size) {
+        mt19937 rng(seed * 1000003u + (unsigned)size);
+        {
+            ofstream out(networkFile());
+            if (!out) {
+                cerr << "Error: Unable to create " << networkFile() << '\n';
+                return false;
+            }
+            out << "Intersection1,Intersection2,TravelTime,X1,Y1,X2,Y2\n";
+            if (network == "grid") {
+                writeGrid(out, size, rng);
+            }
+            else if (network == "geometric") {
+                writeGeometric(out, size, rng);
             }
+            else {
+                writeScaleFree(out, size, rng);
+            }
+        }
 
-            if (u == -1 || u == endIndex) break;  // No reachable nodes left, or found the destination
+        TrafficGraph graph;
+        LoadReport report;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        graph.loadRoadNetwork(networkFile(), report);
+        double loadMilliseconds = millisecondsSince(started);
+        remove(networkFile());
+        int nodes = graph.intersectionCount();
+        int roads = graph.roadCount();
+        add(network, graph, roads, "load_csv", loadMilliseconds, "ms");
+
+        started = chrono::steady_clock::now();
+        bool saved = graph.saveSnapshot(snapshotFile());
+        add(network, graph, roads, "save_snapshot", millisecondsSince(started), "ms");
+        if (saved) {
+            TrafficGraph loaded;
+            started = chrono::steady_clock::now();
+            loaded.loadSnapshot(snapshotFile());
+            add(network, graph, roads, "load_snapshot", millisecondsSince(started), "ms");
+        }
+        remove(snapshotFile());
 
-            visited[u] = true;
+        // Point-to-point latency
+        int queryCount = max(100, min(1000, 50000000 / nodes));
+        vector<double> latencies;
+        vector<int> path;
+        for (int q = 0; q < queryCount; ++q) {
+            int start = rng() % nodes, end = rng() % nodes;
+            started = chrono::steady_clock::now();
+            graph.shortestPathById(start, end, ROUTE_DIJKSTRA, &path);
+            latencies.push_back(millisecondsSince(started) * 1000.0);
+        }
+        sort(latencies.begin(), latencies.end());
+        add(network, graph, roads, "dijkstra_p50", percentile(latencies, 50), "us");
+        add(network, graph, roads, "dijkstra_p99", percentile(latencies, 99), "us");
 
-            // Traverse all neighbors (edges) of the current node
-            Edge* current = intersections[u].head;
-            while (current != NULL) {
-                int v = current->to;
+        // Batch throughput (distinct starts, so every query grows its own tree)
+        vector<RouteQuery> queries(max(50, min(20000, 50000000 / nodes)));
+        for (size_t q = 0; q < queries.size(); ++q) {
+            queries[q].start = rng() % nodes;
+            queries[q].end = rng() % nodes;
+        }
+        RouteBatch batch;
+        started = chrono::steady_clock::now();
+        graph.routeBatch(queries, batch, false);
+        add(network, graph, roads, "batch_routes", queries.size() / (millisecondsSince(started) / 1000.0), "queries/s");
 
-                // Skip if the road is closed or if the node is visited
-                if (!visited[v] && dist[u] + current->weight < dist[v] && !closedRoads[u][v]) {
-                    dist[v] = dist[u] + current->weight;
-                    prev[v] = u;
-                }
-                current = current->next;
+        // Map matching: vehicle positions spread over the area the network covers
+        MapPoint low = { numeric_limits<float>::max(), numeric_limits<float>::max() };
+        MapPoint high = { -low.x, -low.y };
+        MapPoint point;
+        for (int u = 0; u < nodes; ++u) {
+            if (graph.intersectionPosition(u, point)) {
+                low.x = min(low.x, point.x);
+                low.y = min(low.y, point.y);
+                high.x = max(high.x, point.x);
+                high.y = max(high.y, point.y);
+            }
+        }
+        if (low.x <= high.x) {
+            RoadSnap snap;
+            started = chrono::steady_clock::now();
+            graph.snapToRoad(low.x, low.y, snap); // The first query builds the index
+            add(network, graph, roads, "spatial_index_build", millisecondsSince(started), "ms");
+            vector<MapPoint> positions(max(100000, min(1000000, nodes)));
+            uniform_real_distribution<float> across(low.x, high.x), down(low.y, high.y);
+            for (size_t i = 0; i < positions.size(); ++i) {
+                positions[i].x = across(rng);
+                positions[i].y = down(rng);
             }
+            vector<RoadSnap> snaps;
+            started = chrono::steady_clock::now();
+            graph.snapPositions(positions, snaps);
+            add(network, graph, roads, "snap_positions", positions.size() / (millisecondsSince(started) / 1000.0), "positions/s");
         }
 
-        // If no path found to the destination, print the error message
-        if (dist[endIndex] == INF) {
-            cout << "No path found from " << startName << " to " << endName << endl;
-            return;
+        // Updates, on roads picked up front
+        const int UPDATES = 100000;
+        vector<RoadCount> readings(UPDATES);
+        for (int u = 0; u < UPDATES; ++u) {
+            int from = rng() % nodes;
+            while (graph.roadsFrom(from) == 0) {
+                from = rng() % nodes;
+            }
+            readings[u].from = from;
+            readings[u].to = graph.roadTarget(from, rng() % graph.roadsFrom(from));
+            readings[u].count = rng() % 200;
         }
+        NullBuffer discard;
+        streambuf* console = cout.rdbuf(&discard);
+        started = chrono::steady_clock::now();
+        for (int u = 0; u < UPDATES; ++u) {
+            graph.setVehicleCount(readings[u].from, readings[u].to, readings[u].count);
+        }
+        double setMilliseconds = millisecondsSince(started);
+        cout.rdbuf(console);
+        add(network, graph, roads, "set_vehicle_count", UPDATES / (setMilliseconds / 1000.0), "updates/s");
 
-        // Print the shortest path information
-        cout << "Shortest path from " << startName << " to " << endName << " is " << dist[endIndex] << " time units." << endl;
-        cout << "Path: ";
-        printPath(prev, endIndex);
-    }
+        started = chrono::steady_clock::now();
+        graph.applyVehicleCounts(readings);
+        add(network, graph, roads, "bulk_vehicle_counts", UPDATES / (millisecondsSince(started) / 1000.0), "updates/s");
 
+        // Concurrent reads: reader threads route on the published roads, first on their own
+        // and then while this thread applies count batches and publishes each one
+        const int PUBLISH_BATCH = 1000;
+        int readerCount = max(1, min(4, (int)thread::hardware_concurrency() - 1));
+        int readerQueries = max(50, min(500, 20000000 / nodes));
+        vector<vector<double> > readerLatencies(readerCount);
+        graph.publishRoads();
+        for (int updating = 0; updating < 2; ++updating) {
+            atomic<int> finished(0);
+            vector<thread> readers;
+            for (int r = 0; r < readerCount; ++r) {
+                readers.push_back(thread([&, r]() {
+                    mt19937 local(seed + (unsigned)r);
+                    SearchWorkspace forward, backward;
+                    vector<double>& latency = readerLatencies[r];
+                    latency.clear();
+                    for (int q = 0; q < readerQueries; ++q) {
+                        int start = local() % nodes, end = local() % nodes;
+                        chrono::steady_clock::time_point began = chrono::steady_clock::now();
+                        graph.routeConcurrently(start, end, forward, backward);
+                        latency.push_back(millisecondsSince(began) * 1000.0);
+                    }
+                    finished++;
+                }));
+            }
+            int applied = 0;
+            started = chrono::steady_clock::now();
+            while (updating && finished.load() < readerCount) {
+                int first = applied % UPDATES;
+                int count = min(PUBLISH_BATCH, UPDATES - first);
+                graph.applyVehicleCounts(vector<RoadCount>(readings.begin() + first, readings.begin() + first + count));
+                graph.publishRoads();
+                applied += count;
+            }
+            double writerMilliseconds = millisecondsSince(started);
+            for (size_t r = 0; r < readers.size(); ++r) {
+                readers[r].join();
+            }
+            vector<double> latencies;
+            for (int r = 0; r < readerCount; ++r) {
+                latencies.insert(latencies.end(), readerLatencies[r].begin(), readerLatencies[r].end());
+            }
+            sort(latencies.begin(), latencies.end());
+            string prefix = updating ? "concurrent_busy" : "concurrent_idle";
+            add(network, graph, roads, prefix + "_p50", percentile(latencies, 50), "us");
+            add(network, graph, roads, prefix + "_p99", percentile(latencies, 99), "us");
+            if (updating) {
+                add(network, graph, roads, "concurrent_updates", applied / (writerMilliseconds / 1000.0), "updates/s");
+            }
+        }
 
-    // Method to simulate road closure
-    void closeRoad(const string& from, const string& to) {
-        int fromIndex = findIntersection(from);
-        int toIndex = findIntersection(to);
+        // One network-wide signal control cycle over the counts just applied
+        add(network, graph, roads, "signal_plan_cycle", graph.optimizeSignals().seconds * 1000, "ms");
 
-        if (fromIndex == -1 || toIndex == -1) {
-            cout << "One or both intersections not found: " << from << ", " << to << endl;
-            return;
+        // Equilibrium assignment: a few origins (so large networks stay affordable) with
+        // trips to random destinations; a fixed number of steps, averaged per iteration
+        // (each iteration is one all-or-nothing assignment)
+        const int ASSIGNMENT_BENCH_STEPS = 3;
+        int origins = max(8, min(64, 2000000 / nodes));
+        vector<RouteQuery> trips;
+        for (int o = 0; o < origins; ++o) {
+            int start = rng() % nodes;
+            for (int d = 0; d < 32; ++d) {
+                RouteQuery trip = { start, (int)(rng() % nodes) };
+                trips.insert(trips.end(), 4, trip);
+            }
         }
+        AssignmentReport assignment = graph.assignTraffic(trips, ASSIGNMENT_BENCH_STEPS, 0);
+        add(network, graph, roads, "assignment_iteration", assignment.seconds * 1000 / (assignment.steps + 2), "ms");
 
-        closedRoads[fromIndex][toIndex] = true;
-        closedRoads[toIndex][fromIndex] = true; // Assuming roads are bidirectional
-
-        cout << "Road from " << from << " to " << to << " is now closed." << endl;
-    }
-    void printPath(int prev[], int current) {
-        if (current == -1) {
-            return; // Base case: we've reached the start node
+        started = chrono::steady_clock::now();
+        for (int u = 0; u < UPDATES; ++u) {
+            graph.setRoadClosed(readings[u].from, readings[u].to, u % 2 == 0);
         }
-        printPath(prev, prev[current]); // Recursively print the path from the start to the current node
-        cout << intersections[current].name << " "; // Print the current intersection's name
+        add(network, graph, roads, "close_road", UPDATES / (millisecondsSince(started) / 1000.0), "updates/s");
+        return true;
     }
 
+    static string jsonString(const string& text) {
+        return "\"" + text + "\""; // Names and units are plain identifiers
+    }
 
-    // Method to simulate road reopening
-    void reopenRoad(const string& from, const string& to) {
-        int fromIndex = findIntersection(from);
-        int toIndex = findIntersection(to);
-
-        if (fromIndex == -1 || toIndex == -1) {
-            cout << "One or both intersections not found: " << from << ", " << to << endl;
-            return;
+    bool writeResults() {
+        ofstream out(outputName.c_str());
+        if (!out) {
+            cerr << "Error: Unable to create " << outputName << '\n';
+            return false;
         }
-
-        closedRoads[fromIndex][toIndex] = false;
-        closedRoads[toIndex][fromIndex] = false; // Assuming roads are bidirectional
-
-        cout << "Road from " << from << " to " << to << " is now reopened." << endl;
+        bool csv = outputName.size() >= 4 && outputName.compare(outputName.size() - 4, 4, ".csv") == 0;
+        out.precision(10);
+        if (csv) {
+            out << "network,intersections,roads,metric,value,unit\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const Result& r = results[i];
+                out << r.network << ',' << r.intersections << ',' << r.roads << ',' << r.metric << ','
+                    << r.value << ',' << r.unit << '\n';
+            }
+        }
+        else {
+            out << "{\n  \"seed\": " << seed << ",\n  \"hardwareThreads\": " << thread::hardware_concurrency()
+                << ",\n  \"results\": [\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const Result& r = results[i];
+                out << "    {\"network\": " << jsonString(r.network) << ", \"intersections\": " << r.intersections
+                    << ", \"roads\": " << r.roads << ", \"metric\": " << jsonString(r.metric)
+                    << ", \"value\": " << r.value << ", \"unit\": " << jsonString(r.unit) << "}"
+                    << (i + 1 < results.size() ? ",\n" : "\n");
+            }
+            out << "  ]\n}\n";
+        }
+        cout << "Results written to " << outputName << '\n';
+        return true;
     }
+};
 
-    // Method to simulate system performance under road closures
-    void simulateDisruption() {
-        // Example: Simulate the shortest path calculation during disruptions
-        string start, end;
-        cout << "Enter start intersection: ";
-        cin >> start;
-        cout << "Enter end intersection: ";
-        cin >> end;
-        dijkstra(start, end); // Recalculate shortest path affected by closures
+// Print an event log as text, oldest record first. Intersections are shown by name when
+// 'cityGraph' has them (e.g. from --snapshot), otherwise by index. Vehicles are numbered
+// in vehicles.csv order. Returns false if the file is missing or not an event log.
+bool printEventLog(const TrafficGraph& cityGraph, const string& filename) {
+    ifstream in(filename.c_str(), ios::binary);
+    char magic[sizeof(EVENT_LOG_MAGIC)];
+    unsigned header[2];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) != 0
+        || !in.read((char*)header, sizeof(header)) || header[0] != EVENT_LOG_VERSION || header[1] != sizeof(LogRecord)) {
+        return false;
     }
+    vector<LogRecord> records;
+    LogRecord record;
+    while (in.read((char*)&record, sizeof(record))) {
+        records.push_back(record);
+    }
+    // Each thread's records are in order already; interleave them by time
+    stable_sort(records.begin(), records.end(),
+        [](const LogRecord& a, const LogRecord& b) { return a.time < b.time; });
 
-    void emergencyVehicleRouting(const string& startName, const string& endName) {
-        cout << "Routing emergency vehicle from " << startName << " to " << endName << endl;
-
-        int startIndex = findIntersection(startName);
-        int endIndex = findIntersection(endName);
+    struct Format {
+        const char* name;
+        const char* fields[5];
+        unsigned intersectionArgs; // Bit i set: argument i is an intersection index
+    };
+    static const Format formats[LOG_EVENT_TYPES] = {
+        { "data_loaded", { "file", "records", "skipped" }, 0 },
+        { "road_added", { "from", "to", "weight" }, 3 },
+        { "road_removed", { "from", "to" }, 3 },
+        { "road_weight", { "from", "to", "weight" }, 3 },
+        { "road_closed", { "from", "to", "closed" }, 3 },
+        { "vehicle_count", { "from", "to", "count" }, 3 },
+        { "count_batch", { "applied", "skipped", "weights_changed", "signals_changed" }, 0 },
+        { "signal_changed", { "intersection", "green" }, 1 },
+        { "route", { "start", "end", "distance", "settled", "algorithm" }, 3 },
+        { "emergency_route", { "start", "end", "algorithm" }, 3 },
+        { "reroute", { "vehicle", "at", "destination", "time" }, 6 },
+        { "simulation", { "arrived", "stranded", "en_route", "reroutes", "seconds" }, 0 },
+        { "emergency_dispatch", { "vehicle", "start", "end", "priority", "held" }, 6 },
+        { "signal_plan", { "signals", "changed", "microseconds" }, 0 },
+        { "assignment", { "trips", "unroutable", "steps", "gap_ppm", "milliseconds" }, 0 }
+    };
 
-        if (startIndex == -1 || endIndex == -1) {
-            cout << "Start or end intersection not found: " << startName << ", " << endName << endl;
-            return;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const LogRecord& entry = records[i];
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%14.6f ms  thread %-3u ", entry.time / 1e6, (unsigned)entry.thread);
+        cout << prefix;
+        if (entry.event >= LOG_EVENT_TYPES) {
+            cout << "unknown(" << entry.event << ")\n";
+            continue;
         }
-
-        intersections[startIndex].emergencyOverride = true;
-        intersections[endIndex].emergencyOverride = true;
-
-        // Call Dijkstra or another pathfinding algorithm to find the optimal route
-        dijkstra(startName, endName);
-
-        intersections[startIndex].emergencyOverride = false;
-        intersections[endIndex].emergencyOverride = false;
+        const Format& format = formats[entry.event];
+        cout << format.name;
+        for (int arg = 0; arg < 5 && format.fields[arg] != nullptr; ++arg) {
+            int value = entry.args[arg];
+            cout << ' ' << format.fields[arg] << '=';
+            if ((format.intersectionArgs & (1u << arg)) && value >= 0 && value < cityGraph.intersectionCount()) {
+                cout << cityGraph.intersectionName(value);
+            }
+            else {
+                cout << value;
+            }
+        }
+        cout << '\n';
     }
+    return true;
+}
 
+// Start (level 1 or 2) or stop (level 0) the event log and report the outcome
+void configureEventLog(const string& filename, int level) {
+    if (level <= LOG_OFF) {
+        eventLog.close();
+        cout << CYAN << "Event log closed (" << eventLog.droppedCount() << " records dropped)" << RESET << '\n';
+        return;
+    }
+    LogLevel wanted = level >= LOG_DEBUG ? LOG_DEBUG : LOG_INFO;
+    if (!eventLog.open(filename, wanted)) {
+        cout << RED << "Error: Unable to create log file " << filename << RESET << '\n';
+        return;
+    }
+    cout << CYAN << "Logging " << (wanted == LOG_DEBUG ? "actions and details" : "actions") << " to " << filename
+        << RESET << '\n';
+}
 
+// Silences cout while it is in scope, for calls that report to the console themselves
+struct QuietConsole {
+    streambuf* saved;
+    QuietConsole() : saved(cout.rdbuf(nullptr)) {}
+    ~QuietConsole() { cout.rdbuf(saved); }
 };
 
-#include <iostream>
-#include <string>
-using namespace std;
+// Batch mode (--script). Reads one command per line, runs it without prompts or colors
+// and writes one compact line per result; commands that only change the network print
+// nothing when they succeed. Errors go to 'errors' as "line N: message". Blank lines and
+// lines starting with # are skipped. Returns the number of failed commands.
+//
+//   add-intersection NAME          load                    -> load intersections N roads M
+//   add-road FROM TO WEIGHT        snapshot FILE           -> snapshot intersections N roads M
+//   remove-road FROM TO            counts FILE             (From,To,Count readings)
+//   weight FROM TO WEIGHT          algorithm dijkstra|contraction|astar|bidirectional
+//   close FROM TO                  route FROM TO           -> route FROM TO DISTANCE PATH...
+//   reopen FROM TO                 emergency FROM TO       -> same, with the emergency algorithm
+//   count FROM TO VEHICLES         simulate WINDOW LIMIT [REGIONS] -> simulate arrived N ...
+//   metrics                        (counts and count set one direction, like the feed)
+//   profiles FILE                  route-at FROM TO HH:MM  -> route-at FROM TO DEPART ARRIVE PATH...
+//   alternatives FROM TO [K]       -> alternative FROM TO RANK DISTANCE SHARE PATH... (one line each)
+//   reroute FROM TO [K]            -> reroute FROM TO affected N stranded N routes N... peak N shortest_peak N
+//   dispatch FROM TO [PRIORITY]    -> dispatch FROM TO arrive T held N NAME@T... (or "unreachable")
+//   dispatch-fleet                 -> dispatch VEHICLE FROM TO arrive T held N NAME@T... (one line each)
+//   clock SECONDS                  -> clock NOW switched N pending N
+//   optimize-signals               -> optimize-signals signals N changed N
+//   nearest X Y                    -> nearest X Y NAME DISTANCE (or "none")
+//   snap X Y                       -> snap X Y FROM TO FRACTION DISTANCE (or "none")
+//   route-points X1 Y1 X2 Y2       -> route-points X1 Y1 X2 Y2 DISTANCE PATH... (or "unreachable")
+//   assign [STEPS [GAP]]           -> assign trips N unroutable N steps N gap G
+int runScript(TrafficGraph& cityGraph, istream& in, ostream& out, ostream& errors) {
+    int failures = 0;
+    int lineNumber = 0;
+    string line;
+    vector<string_view> words;
+    vector<int> path;
+    while (getline(in, line)) {
+        lineNumber++;
+        words.clear();
+        for (size_t pos = 0; pos < line.size(); ) {
+            while (pos < line.size() && isspace((unsigned char)line[pos])) {
+                pos++;
+            }
+            size_t start = pos;
+            while (pos < line.size() && !isspace((unsigned char)line[pos])) {
+                pos++;
+            }
+            if (pos > start) {
+                words.push_back(string_view(line).substr(start, pos - start));
+            }
+        }
+        if (words.empty() || words[0][0] == '#') {
+            continue;
+        }
 
-#include <iostream>
-#include <string>
-using namespace std;
+        string_view command = words[0];
+        size_t argumentCount = words.size() - 1;
+        string error;
+        auto intersection = [&](size_t word) {
+            int index = cityGraph.findIntersection(words[word]);
+            if (index == -1 && error.empty()) {
+                error = "unknown intersection " + string(words[word]);
+            }
+            return index;
+        };
+        auto number = [&](size_t word) {
+            int value = 0;
+            if (!parseInt(words[word], value) && error.empty()) {
+                error = "not a number: " + string(words[word]);
+            }
+            return value;
+        };
+        auto decimal = [&](size_t word) {
+            double value = 0;
+            if (!parseDouble(words[word], value) && error.empty()) {
+                error = "not a number: " + string(words[word]);
+            }
+            return value;
+        };
+        auto expect = [&](size_t count) {
+            if (argumentCount != count) {
+                error = string(command) + " takes " + to_string(count) + " argument" + (count == 1 ? "" : "s");
+                return false;
+            }
+            return true;
+        };
 
-// ANSI escape codes for colors
-#define RESET   "\033[0m"
-#define BOLD    "\033[1m"
-#define UNDERLINE "\033[4m"
-#define RED     "\033[31m"
-#define GREEN   "\033[32m"
-#define YELLOW  "\033[33m"
-#define BLUE    "\033[34m"
-#define MAGENTA "\033[35m"
-#define CYAN    "\033[36m"
-#define WHITE   "\033[37m"
-#define BG_BLUE "\033[44m"
-#define BG_YELLOW "\033[43m"
+        if (command == "add-intersection") {
+            if (expect(1) && cityGraph.findIntersection(words[1]) == -1) {
+                cityGraph.internIntersection(words[1]);
+            }
+        }
+        else if (command == "add-road" || command == "weight" || command == "count") {
+            if (expect(3)) {
+                int from = intersection(1), to = intersection(2), value = number(3);
+                bool done = error.empty()
+                    && (command == "add-road" ? cityGraph.addRoadById(from, to, value)
+                        : command == "weight" ? cityGraph.updateRoadWeightById(from, to, value)
+                        : cityGraph.applyVehicleCounts(vector<RoadCount>(1, RoadCount{ from, to, value })).applied == 1);
+                if (error.empty() && !done) {
+                    error = command == "add-road" ? "road exists or weight is negative" : "no such road or negative value";
+                }
+            }
+        }
+        else if (command == "remove-road" || command == "close" || command == "reopen") {
+            if (expect(2)) {
+                int from = intersection(1), to = intersection(2);
+                bool done = error.empty()
+                    && (command == "remove-road" ? cityGraph.removeRoadById(from, to)
+                        : cityGraph.setRoadClosed(from, to, command == "close"));
+                if (error.empty() && !done) {
+                    error = "no such road";
+                }
+            }
+        }
+        else if (command == "route" || command == "emergency") {
+            if (expect(2)) {
+                int from = intersection(1), to = intersection(2);
+                if (error.empty()) {
+                    RoutingAlgorithm algorithm = command == "route" ? cityGraph.getRoutingAlgorithm()
+                        : cityGraph.getEmergencyRoutingAlgorithm();
+                    int distance;
+                    {
+                        QuietConsole quiet; // Preparing a hierarchy or landmarks reports on cout
+                        distance = cityGraph.shortestPathById(from, to, algorithm, &path);
+                    }
+                    out << command << ' ' << words[1] << ' ' << words[2];
+                    if (distance == INF) {
+                        out << " unreachable";
+                    }
+                    else {
+                        out << ' ' << distance;
+                        for (size_t i = 0; i < path.size(); ++i) {
+                            out << ' ' << cityGraph.intersectionName(path[i]);
+                        }
+                    }
+                    out << '\n';
+                }
+            }
+        }
+        else if (command == "alternatives" || command == "reroute") {
+            if (argumentCount == 2 || argumentCount == 3) {
+                int from = intersection(1), to = intersection(2);
+                int k = argumentCount == 3 ? number(3) : TrafficGraph::DEFAULT_ALTERNATIVES;
+                if (error.empty() && k < 1) {
+                    error = "K must be at least 1";
+                }
+                RouteBatch alternatives;
+                RerouteReport report;
+                if (error.empty() && command == "alternatives") {
+                    int count = cityGraph.alternativeRoutesById(from, to, k, TrafficGraph::DEFAULT_MAX_STRETCH, alternatives);
+                    vector<double> shares;
+                    TrafficGraph::routeShares(alternatives.routes.data(), count, shares);
+                    for (int i = 0; i < count; ++i) {
+                        const RouteResult& route = alternatives.routes[i];
+                        out << "alternative " << words[1] << ' ' << words[2] << ' ' << i + 1 << ' ' << route.distance
+                            << ' ' << shares[i];
+                        for (int step = 0; step < route.pathLength; ++step) {
+                            out << ' ' << cityGraph.intersectionName(alternatives.paths[route.pathOffset + step]);
+                        }
+                        out << '\n';
+                    }
+                    if (count == 0) {
+                        out << "alternative " << words[1] << ' ' << words[2] << " unreachable\n";
+                    }
+                }
+                else if (error.empty() && !cityGraph.rerouteAroundClosureById(from, to, k, TrafficGraph::DEFAULT_MAX_STRETCH, report)) {
+                    error = "no such road";
+                }
+                else if (error.empty()) {
+                    out << "reroute " << words[1] << ' ' << words[2] << " affected " << report.affected
+                        << " stranded " << report.stranded << " routes";
+                    for (size_t i = 0; i < report.routeUsers.size(); ++i) {
+                        out << ' ' << report.routeUsers[i];
+                    }
+                    out << " peak " << report.spreadPeak << " shortest_peak " << report.shortestPeak << '\n';
+                }
+            }
+            else {
+                error = string(command) + " takes 2 or 3 arguments";
+            }
+        }
+        else if (command == "dispatch" || command == "dispatch-fleet") {
+            vector<Corridor> corridors;
+            if (command == "dispatch" && (argumentCount == 2 || argumentCount == 3)) {
+                int from = intersection(1), to = intersection(2), priority = argumentCount == 3 ? number(3) : 0;
+                if (error.empty()) {
+                    QuietConsole quiet;
+                    corridors.push_back(cityGraph.dispatchEmergencyById(from, to, priority));
+                }
+            }
+            else if (command == "dispatch") {
+                error = "dispatch takes 2 or 3 arguments";
+            }
+            else if (expect(0)) {
+                QuietConsole quiet;
+                cityGraph.scheduleEmergencyFleet(corridors);
+            }
+            for (size_t i = 0; i < corridors.size(); ++i) {
+                const Corridor& corridor = corridors[i];
+                const Route& route = corridor.route;
+                out << "dispatch ";
+                if (corridor.vehicle != -1) {
+                    out << cityGraph.vehicleName(corridor.vehicle) << ' ';
+                }
+                out << cityGraph.intersectionName(route.start) << ' ' << cityGraph.intersectionName(route.end);
+                if (!route.found()) {
+                    out << " unreachable\n";
+                    continue;
+                }
+                out << " arrive " << corridor.departure + route.arrival.back() << " held " << corridor.held;
+                for (size_t step = 0; step < route.intersections.size(); ++step) {
+                    out << ' ' << cityGraph.intersectionName(route.intersections[step]) << '@'
+                        << corridor.departure + route.arrival[step];
+                }
+                out << '\n';
+            }
+        }
+        else if (command == "nearest" || command == "snap") {
+            if (expect(2)) {
+                double x = decimal(1), y = decimal(2);
+                if (error.empty()) {
+                    out << command << ' ' << words[1] << ' ' << words[2];
+                    float distance;
+                    RoadSnap snap;
+                    int index = command == "nearest" ? cityGraph.nearestIntersection(x, y, &distance) : -1;
+                    if (command == "nearest" && index != -1) {
+                        out << ' ' << cityGraph.intersectionName(index) << ' ' << distance << '\n';
+                    }
+                    else if (command == "snap" && cityGraph.snapToRoad(x, y, snap)) {
+                        out << ' ' << cityGraph.intersectionName(snap.from) << ' ' << cityGraph.intersectionName(snap.to)
+                            << ' ' << snap.fraction << ' ' << snap.distance << '\n';
+                    }
+                    else {
+                        out << " none\n";
+                    }
+                }
+            }
+        }
+        else if (command == "route-points") {
+            if (expect(4)) {
+                MapPoint start = { (float)decimal(1), (float)decimal(2) };
+                MapPoint end = { (float)decimal(3), (float)decimal(4) };
+                if (error.empty()) {
+                    RoadSnap startSnap, endSnap;
+                    int distance;
+                    {
+                        QuietConsole quiet;
+                        distance = cityGraph.routeBetweenPoints(start, end, startSnap, endSnap, &path);
+                    }
+                    out << command;
+                    for (size_t word = 1; word <= 4; ++word) {
+                        out << ' ' << words[word];
+                    }
+                    if (distance == INF) {
+                        out << " unreachable";
+                    }
+                    else {
+                        out << ' ' << distance;
+                        for (size_t i = 0; i < path.size(); ++i) {
+                            out << ' ' << cityGraph.intersectionName(path[i]);
+                        }
+                    }
+                    out << '\n';
+                }
+            }
+        }
+        else if (command == "optimize-signals") {
+            if (expect(0)) {
+                SignalPlanReport report = cityGraph.optimizeSignals();
+                out << "optimize-signals signals " << report.signals << " changed " << report.changed << '\n';
+            }
+        }
+        else if (command == "assign") {
+            if (argumentCount <= 2) {
+                int steps = argumentCount >= 1 ? number(1) : TrafficGraph::ASSIGNMENT_STEPS;
+                double gap = argumentCount == 2 ? decimal(2) : TrafficGraph::ASSIGNMENT_GAP;
+                if (error.empty()) {
+                    vector<RouteQuery> trips;
+                    cityGraph.vehicleTrips(trips);
+                    AssignmentReport report = cityGraph.assignTraffic(trips, steps, gap);
+                    out << "assign trips " << report.trips << " unroutable " << report.unroutable << " steps "
+                        << report.steps << " gap " << report.relativeGap << '\n';
+                }
+            }
+            else {
+                error = "assign takes 0 to 2 arguments";
+            }
+        }
+        else if (command == "clock") {
+            if (expect(1)) {
+                int seconds = number(1);
+                if (error.empty()) {
+                    int switched = cityGraph.advanceEmergencyClock(seconds);
+                    out << "clock " << cityGraph.emergencyClock() << " switched " << switched
+                        << " pending " << cityGraph.pendingOverrideCount() << '\n';
+                }
+            }
+        }
+        else if (command == "algorithm") {
+            if (expect(1)) {
+                QuietConsole quiet;
+                string_view name = words[1];
+                if (name == "dijkstra") cityGraph.setRoutingAlgorithm(ROUTE_DIJKSTRA);
+                else if (name == "contraction") cityGraph.setRoutingAlgorithm(ROUTE_CONTRACTION);
+                else if (name == "astar") cityGraph.setRoutingAlgorithm(ROUTE_ASTAR);
+                else if (name == "bidirectional") cityGraph.setRoutingAlgorithm(ROUTE_BIDIRECTIONAL_ASTAR);
+                else error = "unknown algorithm " + string(name);
+            }
+        }
+        else if (command == "load" || command == "snapshot") {
+            if (expect(command == "load" ? 0 : 1)) {
+                QuietConsole quiet;
+                if (command == "load") {
+                    vector<string> missing = cityGraph.loadAllData();
+                    for (size_t i = 0; i < missing.size(); ++i) {
+                        error += (i == 0 ? "unable to open " : ", ") + missing[i];
+                    }
+                }
+                else if (!cityGraph.loadSnapshot(string(words[1]))) {
+                    error = string(words[1]) + " is missing or not a valid snapshot";
+                }
+            }
+            if (error.empty()) {
+                out << command << " intersections " << cityGraph.intersectionCount()
+                    << " roads " << cityGraph.roadCount() << '\n';
+            }
+        }
+        else if (command == "counts" || command == "profiles") {
+            if (expect(1)) {
+                QuietConsole quiet;
+                if (command == "counts") {
+                    if (!cityGraph.applyVehicleCountFeed(string(words[1]))) {
+                        error = "unable to open " + string(words[1]);
+                    }
+                }
+                else if (!cityGraph.loadTravelTimeProfiles(string(words[1]))) {
+                    error = "unable to open " + string(words[1]);
+                }
+            }
+        }
+        else if (command == "route-at") {
+            if (expect(3)) {
+                int from = intersection(1), to = intersection(2), departure = 0;
+                if (!parseClockTime(words[3], departure) && error.empty()) {
+                    error = "not a time: " + string(words[3]);
+                }
+                if (error.empty()) {
+                    int arrival;
+                    {
+                        QuietConsole quiet;
+                        arrival = cityGraph.earliestArrivalById(from, to, departure, &path);
+                    }
+                    out << command << ' ' << words[1] << ' ' << words[2] << ' ' << formatClockTime(departure);
+                    if (arrival == INF) {
+                        out << " unreachable";
+                    }
+                    else {
+                        out << ' ' << formatClockTime(arrival);
+                        for (size_t i = 0; i < path.size(); ++i) {
+                            out << ' ' << cityGraph.intersectionName(path[i]);
+                        }
+                    }
+                    out << '\n';
+                }
+            }
+        }
+        else if (command == "simulate") {
+            if (argumentCount == 2 || argumentCount == 3) {
+                int window = number(1), limit = number(2), regions = argumentCount == 3 ? number(3) : 1;
+                if (error.empty()) {
+                    SimulationReport report = regions == 1 ? cityGraph.simulateTraffic(window, limit)
+                        : cityGraph.simulateTrafficPartitioned(window, limit, regions);
+                    out << "simulate arrived " << report.arrived << " stranded " << report.stranded
+                        << " en_route " << report.enRoute << " reroutes " << report.reroutes
+                        << " end " << report.endTime << '\n';
+                }
+            }
+            else {
+                error = "simulate takes 2 or 3 arguments";
+            }
+        }
+        else if (command == "metrics") {
+            if (expect(0)) {
+                printMetrics(out);
+            }
+        }
+        else {
+            error = "unknown command " + string(command);
+        }
 
-// Function to print a decorative border
-void printBorder() {
-    cout << BOLD << CYAN << "===========================================================" << RESET << endl;
+        if (!error.empty()) {
+            errors << "line " << lineNumber << ": " << error << '\n';
+            failures++;
+        }
+    }
+    return failures;
 }
 
 // Main function
-int main() {
+// Usage: program [--snapshot file] [--log file [--log-level 1|2]]
+//        program [--snapshot file] --decode-log file
+//        program [--snapshot file] [--log file [--log-level 1|2]] --script file|-
+//        program --bench [--bench-sizes 1000,10000,...] [--bench-networks grid,geometric,scalefree]
+//                        [--bench-seed n] [--bench-out results.json|results.csv]
+// --snapshot loads a prebuilt network before the menu starts. --log records an event log
+// (level 1 = actions, 2 = also per-item detail). --decode-log prints a log and exits,
+// naming intersections from the snapshot if one is given. --script runs a command script
+// (- reads standard input; see runScript) and exits, with status 1 if a command failed.
+// --bench runs the benchmarks (see BenchmarkSuite) and exits.
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            BenchmarkSuite bench;
+            return bench.parseArguments(argc, argv) && bench.run() ? 0 : 1;
+        }
+    }
+
     TrafficGraph cityGraph;
     int choice;
 
+    string snapshotName, logName, decodeName, scriptName;
+    int logLevel = LOG_INFO;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshotName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--log") == 0) {
+            logName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--log-level") == 0) {
+            logLevel = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--decode-log") == 0) {
+            decodeName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--script") == 0) {
+            scriptName = argv[++i];
+        }
+    }
+    if (!decodeName.empty()) {
+        if (!snapshotName.empty() && !cityGraph.loadSnapshot(snapshotName)) {
+            cerr << "Error: " << snapshotName << " is missing or not a valid snapshot\n";
+        }
+        if (!printEventLog(cityGraph, decodeName)) {
+            cerr << "Error: " << decodeName << " is missing or not an event log\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (!scriptName.empty()) {
+        if (!snapshotName.empty() && !cityGraph.loadSnapshot(snapshotName)) {
+            cerr << "Error: " << snapshotName << " is missing or not a valid snapshot\n";
+            return 1;
+        }
+        if (!logName.empty()) {
+            eventLog.open(logName, logLevel >= LOG_DEBUG ? LOG_DEBUG : LOG_INFO);
+        }
+        int failures;
+        if (scriptName == "-") {
+            failures = runScript(cityGraph, cin, cout, cerr);
+        }
+        else {
+            ifstream script(scriptName);
+            if (!script) {
+                cerr << "Error: Unable to open " << scriptName << '\n';
+                return 1;
+            }
+            failures = runScript(cityGraph, script, cout, cerr);
+        }
+        eventLog.close();
+        return failures == 0 ? 0 : 1;
+    }
+
     printBorder();
-    cout << endl;
-    cout << BOLD << CYAN << "===   _____   Smart Traffic Management System   _____    ===" << endl;
-    cout << "    __|_|_|__                                 __|_|_|__       " << endl;
-    cout << "   |_0_____0_|                               |_0_____0_|      " << RESET << endl;
-    cout << endl;
+    cout << '\n';
+    cout << BOLD << CYAN << "===   _____   Smart Traffic Management System   _____    ===" << '\n';
+    cout << "    __|_|_|__                                 __|_|_|__       " << '\n';
+    cout << "   |_0_____0_|                               |_0_____0_|      " << RESET << '\n';
+    cout << '\n';
     printBorder();
 
+    if (!snapshotName.empty()) {
+        loadSnapshotFile(cityGraph, snapshotName);
+    }
+    if (!logName.empty()) {
+        configureEventLog(logName, logLevel);
+    }
+
     do {
-        cout << endl;
+        cout << '\n';
 
         // Display the menu options with colored and styled text
-        cout << BOLD << BLUE << "Main Menu" << RESET << endl;
+        cout << BOLD << BLUE << "Main Menu" << RESET << '\n';
         printBorder();
 
-        cout << GREEN << "1. Load And Display All 5 Data Files" << RESET << endl;
-        cout << GREEN << "2. Add Intersection" << RESET << endl;
-        cout << GREEN << "3. Add Road" << RESET << endl;
-        cout << GREEN << "4. Update Road Weight" << RESET << endl;
-        cout << GREEN << "5. Find Shortest Path" << RESET << endl;
-        cout << GREEN << "6. Set Vehicle Count" << RESET << endl;
-        cout << GREEN << "7. Get Vehicle Count" << RESET << endl;
-        cout << GREEN << "8. Close Road" << RESET << endl;
-        cout << GREEN << "9. Reopen Road" << RESET << endl;
-        cout << GREEN << "10. Simulate Disruption" << RESET << endl;
-        cout << GREEN << "11. Emergency Vehicle Routing" << RESET << endl;
-        cout << GREEN << "12. Real-Time Traffic Monitoring" << RESET << endl;
-        cout << GREEN << "13. Display Traffic Signal Timers" << RESET << endl;
-        cout << RED << "14. Exit" << RESET << endl;
+        cout << GREEN << "1. Load All 5 Data Files" << RESET << '\n';
+        cout << GREEN << "2. Add Intersection" << RESET << '\n';
+        cout << GREEN << "3. Add Road" << RESET << '\n';
+        cout << GREEN << "4. Update Road Weight" << RESET << '\n';
+        cout << GREEN << "5. Find Shortest Path" << RESET << '\n';
+        cout << GREEN << "6. Set Vehicle Count" << RESET << '\n';
+        cout << GREEN << "7. Get Vehicle Count" << RESET << '\n';
+        cout << GREEN << "8. Close Road" << RESET << '\n';
+        cout << GREEN << "9. Reopen Road" << RESET << '\n';
+        cout << GREEN << "10. Simulate Disruption" << RESET << '\n';
+        cout << GREEN << "11. Emergency Vehicle Routing" << RESET << '\n';
+        cout << GREEN << "12. Real-Time Traffic Monitoring" << RESET << '\n';
+        cout << GREEN << "13. Display Traffic Signal Timers" << RESET << '\n';
+        cout << GREEN << "14. Select Shortest Path Engine" << RESET << '\n';
+        cout << GREEN << "15. Save Network Snapshot" << RESET << '\n';
+        cout << GREEN << "16. Load Network Snapshot" << RESET << '\n';
+        cout << GREEN << "17. Route All Vehicles (Batch)" << RESET << '\n';
+        cout << GREEN << "18. Select Routing Algorithm" << RESET << '\n';
+        cout << GREEN << "19. Select Emergency Routing Algorithm" << RESET << '\n';
+        cout << GREEN << "20. Register Active Sources" << RESET << '\n';
+        cout << GREEN << "21. Run Traffic Simulation" << RESET << '\n';
+        cout << GREEN << "22. Remove Road" << RESET << '\n';
+        cout << GREEN << "23. Clear Network" << RESET << '\n';
+        cout << GREEN << "24. Apply Vehicle Count Feed" << RESET << '\n';
+        cout << GREEN << "25. Configure Event Log" << RESET << '\n';
+        cout << GREEN << "26. Show Metrics" << RESET << '\n';
+        cout << GREEN << "27. Write Metrics File (Prometheus)" << RESET << '\n';
+        cout << GREEN << "28. Load Travel Time Profiles" << RESET << '\n';
+        cout << GREEN << "29. Time-Dependent Route" << RESET << '\n';
+        cout << GREEN << "30. Alternative Routes" << RESET << '\n';
+        cout << GREEN << "31. Close Road and Spread Rerouted Vehicles" << RESET << '\n';
+        cout << GREEN << "32. Dispatch Emergency Fleet" << RESET << '\n';
+        cout << GREEN << "33. Advance Emergency Clock" << RESET << '\n';
+        cout << GREEN << "34. Optimize Signals (Max Pressure)" << RESET << '\n';
+        cout << GREEN << "35. Route Between Map Positions" << RESET << '\n';
+        cout << GREEN << "36. Snap Vehicle Positions" << RESET << '\n';
+        cout << GREEN << "37. Assign Traffic (User Equilibrium)" << RESET << '\n';
+        cout << RED << "0. Exit" << RESET << '\n';
 
         printBorder();
 
         // Asking for the user's choice
         cout << CYAN << "Enter your choice: " << RESET;
-        cin >> choice;
+        if (!(cin >> choice)) {
+            // End of input exits; anything that is not a number is skipped
+            if (cin.eof()) {
+                break;
+            }
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            choice = -1;
+        }
 
         if (choice == 1) {
-            // List of files to load
-            string filenames[] = {
-                "accidents_or_closures.csv",
-                "emergency_vehicles.csv",
-                "road_network.csv",
-                "traffic_signal_timings.csv",
-                "vehicles.csv"
-            };
-
-            // Iterate through each file and load it
-            for (const string& filename : filenames) {
-                cityGraph.loadAndDisplayFile(filename); // Corrected function call
-            }
+            cityGraph.loadAllData();
         }
         else if (choice == 2) {
             string name;
@@ -573,7 +9017,7 @@ int main() {
             cin >> to;
             int fromIndex = cityGraph.findIntersection(from);
             int toIndex = cityGraph.findIntersection(to);
-            cout << CYAN << "Vehicle count: " << cityGraph.getVehicleCount(fromIndex, toIndex) << RESET << endl;
+            cout << CYAN << "Vehicle count: " << cityGraph.getVehicleCount(fromIndex, toIndex) << RESET << '\n';
         }
         else if (choice == 8) {
             string from, to;
@@ -610,13 +9054,202 @@ int main() {
         }
 
         else if (choice == 14) {
-            cout << RED << "Exiting program..." << RESET << endl;
+            int engine;
+            cout << GREEN << "Enter engine (1 = indexed 4-ary heap, 2 = radix heap): " << RESET;
+            cin >> engine;
+            cityGraph.setHeapKind(engine == 2 ? RADIX_HEAP : DARY_HEAP);
+        }
+        else if (choice == 15) {
+            string filename;
+            cout << GREEN << "Enter snapshot file name: " << RESET;
+            cin >> filename;
+            if (cityGraph.saveSnapshot(filename)) {
+                cout << CYAN << "Snapshot saved to " << filename << RESET << '\n';
+            }
+            else {
+                cout << RED << "Error: Unable to write snapshot " << filename << RESET << '\n';
+            }
+        }
+        else if (choice == 16) {
+            string filename;
+            cout << GREEN << "Enter snapshot file name: " << RESET;
+            cin >> filename;
+            loadSnapshotFile(cityGraph, filename);
+        }
+        else if (choice == 17) {
+            cityGraph.routeAllVehicles();
+        }
+        else if (choice == 18 || choice == 19) {
+            int algorithm;
+            cout << GREEN << "Enter algorithm (1 = Dijkstra, 2 = contraction hierarchy, 3 = A*, 4 = bidirectional A*): " << RESET;
+            cin >> algorithm;
+            RoutingAlgorithm selected = algorithm == 2 ? ROUTE_CONTRACTION : algorithm == 3 ? ROUTE_ASTAR
+                : algorithm == 4 ? ROUTE_BIDIRECTIONAL_ASTAR : ROUTE_DIJKSTRA;
+            if (choice == 18) {
+                cityGraph.setRoutingAlgorithm(selected);
+            }
+            else {
+                cityGraph.setEmergencyRoutingAlgorithm(selected);
+            }
+        }
+        else if (choice == 20) {
+            int kind;
+            cout << GREEN << "Enter sources (1 = vehicle origins, 2 = emergency vehicle origins, 3 = one intersection, 4 = clear all): " << RESET;
+            cin >> kind;
+            if (kind == 1 || kind == 2) {
+                cityGraph.activateVehicleOrigins(kind == 2);
+            }
+            else if (kind == 3) {
+                string name;
+                cout << GREEN << "Enter intersection: " << RESET;
+                cin >> name;
+                if (cityGraph.addActiveSource(cityGraph.findIntersection(name))) {
+                    cout << CYAN << name << " is now an active source." << RESET << '\n';
+                }
+                else {
+                    cout << RED << "Error: " << name << " is unknown, already active, or over the tree memory limit." << RESET << '\n';
+                }
+            }
+            else if (kind == 4) {
+                cityGraph.clearActiveSources();
+                cout << CYAN << "Active sources cleared." << RESET << '\n';
+            }
+        }
+        else if (choice == 21) {
+            int departureWindow, timeLimit;
+            cout << GREEN << "Enter departure window in seconds (e.g. 3600 for a rush hour): " << RESET;
+            cin >> departureWindow;
+            cout << GREEN << "Enter simulated time limit in seconds: " << RESET;
+            cin >> timeLimit;
+            int regionCount;
+            cout << GREEN << "Enter number of regions (1 = single thread, 0 = one per hardware thread): " << RESET;
+            cin >> regionCount;
+            cityGraph.runSimulation(departureWindow, timeLimit, regionCount);
+        }
+        else if (choice == 22) {
+            string from, to;
+            cout << GREEN << "Enter start intersection: " << RESET;
+            cin >> from;
+            cout << GREEN << "Enter end intersection: " << RESET;
+            cin >> to;
+            cityGraph.removeRoad(from, to);
+        }
+        else if (choice == 23) {
+            cityGraph.clearNetwork();
+            cout << "Network cleared." << '\n';
+        }
+        else if (choice == 24) {
+            string filename;
+            cout << GREEN << "Enter vehicle count file (From,To,Count): " << RESET;
+            cin >> filename;
+            cityGraph.applyVehicleCountFeed(filename);
+        }
+        else if (choice == 25) {
+            int level;
+            string filename;
+            cout << GREEN << "Enter log level (0 = off, 1 = actions, 2 = actions and details): " << RESET;
+            cin >> level;
+            if (level > 0) {
+                cout << GREEN << "Enter log file name: " << RESET;
+                cin >> filename;
+            }
+            configureEventLog(filename, level);
+        }
+        else if (choice == 26) {
+            printMetrics(cout);
+        }
+        else if (choice == 27) {
+            string filename;
+            cout << GREEN << "Enter metrics file name: " << RESET;
+            cin >> filename;
+            if (writePrometheusMetrics(filename)) {
+                cout << CYAN << "Metrics written to " << filename << RESET << '\n';
+            }
+            else {
+                cout << RED << "Error: Unable to write " << filename << RESET << '\n';
+            }
+        }
+        else if (choice == 28) {
+            string filename;
+            cout << GREEN << "Enter profile file name (e.g. road_profiles.csv): " << RESET;
+            cin >> filename;
+            cityGraph.loadTravelTimeProfiles(filename);
+        }
+        else if (choice == 29) {
+            string start, end, clock;
+            int departure;
+            cout << GREEN << "Enter start intersection: " << RESET;
+            cin >> start;
+            cout << GREEN << "Enter end intersection: " << RESET;
+            cin >> end;
+            cout << GREEN << "Enter departure time (HH:MM): " << RESET;
+            cin >> clock;
+            if (!parseClockTime(clock, departure)) {
+                cout << RED << "Invalid time: " << clock << RESET << '\n';
+            }
+            else {
+                cityGraph.timeDependentRoute(start, end, departure);
+            }
+        }
+        else if (choice == 30 || choice == 31) {
+            string from, to;
+            int routes;
+            cout << GREEN << "Enter start intersection: " << RESET;
+            cin >> from;
+            cout << GREEN << "Enter end intersection: " << RESET;
+            cin >> to;
+            cout << GREEN << "Enter number of routes (e.g. 3): " << RESET;
+            cin >> routes;
+            if (routes < 1) {
+                cout << "Number of routes must be at least 1." << '\n';
+            }
+            else if (choice == 31) {
+                cityGraph.rerouteAroundClosure(from, to, routes);
+            }
+            else if (cityGraph.findIntersection(from) == -1 || cityGraph.findIntersection(to) == -1) {
+                cout << "Start or end intersection not found: " << from << ", " << to << '\n';
+            }
+            else {
+                cityGraph.printAlternativeRoutes(cityGraph.findIntersection(from), cityGraph.findIntersection(to), routes);
+            }
+        }
+        else if (choice == 32) {
+            cityGraph.dispatchEmergencyFleet();
+        }
+        else if (choice == 33) {
+            int seconds;
+            cout << GREEN << "Enter seconds to advance: " << RESET;
+            cin >> seconds;
+            cityGraph.runEmergencyClock(seconds);
+        }
+        else if (choice == 34) {
+            cityGraph.optimizeSignalTimings();
+        }
+        else if (choice == 35) {
+            double x1, y1, x2, y2;
+            cout << GREEN << "Enter start position (x y): " << RESET;
+            cin >> x1 >> y1;
+            cout << GREEN << "Enter end position (x y): " << RESET;
+            cin >> x2 >> y2;
+            cityGraph.routeBetweenPositions(x1, y1, x2, y2);
+        }
+        else if (choice == 36) {
+            string filename;
+            cout << GREEN << "Enter positions file (VehicleID,X,Y): " << RESET;
+            cin >> filename;
+            cityGraph.snapPositionsFile(filename);
+        }
+        else if (choice == 37) {
+            cityGraph.assignVehicleTraffic();
+        }
+        else if (choice == 0) {
+            cout << RED << "Exiting program..." << RESET << '\n';
         }
         else {
-            cout << YELLOW << "Invalid choice. Please try again." << RESET << endl;
+            cout << YELLOW << "Invalid choice. Please try again." << RESET << '\n';
         }
 
-    } while (choice != 14);
+    } while (choice != 0);
 
     return 0;
 }